@@ -0,0 +1,102 @@
+// Counts heap allocations made by the driver over full command/response
+// cycles - the request path (frame -> send) and the response path (read ->
+// de-frame -> correlate) should both be allocation-free once warmed up.
+//
+// The "device" is a thread answering commands on the master side of a pty,
+// so no sim or socat is needed. Exits non-zero if anything allocated.
+//
+// usage: bench_alloc_count [cycles]
+
+#include "driver.h"
+#include "gyro_xyz.h"
+#include "io_interface.h"
+#include "uart_interface.h"
+#include <atomic>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <poll.h>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+// only count allocations made on the thread running the driver
+static thread_local bool counting = false;
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+  if (counting) {
+    allocations++;
+  }
+  void *ptr = std::malloc(size ? size : 1);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+// answers every 3 byte command with a response echoing its addr
+static void respond(int master_fd, std::atomic<bool> &running) {
+  uint8_t cmd[3];
+  size_t have = 0;
+  struct pollfd pfd = {.fd = master_fd, .events = POLLIN, .revents = 0};
+
+  while (running.load()) {
+    if (poll(&pfd, 1, 10) <= 0) {
+      continue;
+    }
+    ssize_t ret = read(master_fd, cmd + have, sizeof(cmd) - have);
+    if (ret <= 0) {
+      continue;
+    }
+    have += ret;
+    if (have == sizeof(cmd)) {
+      uint8_t resp[3] = {cmd[0], MODE_ARG_MANUAL, DELIM};
+      if (write(master_fd, resp, sizeof(resp)) != sizeof(resp)) {
+        throw std::runtime_error("Failed to respond");
+      }
+      have = 0;
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t cycles = argc > 1 ? std::atol(argv[1]) : 10000;
+
+  int master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+    std::cerr << "Failed to open a pty" << std::endl;
+    return 1;
+  }
+
+  UartInterface io(ptsname(master_fd), 38400);
+  SensorDriver driver(io);
+  driver.init();
+
+  std::atomic<bool> running(true);
+  std::thread device(respond, master_fd, std::ref(running));
+
+  // warm up, anything lazily allocated on first use happens here
+  for (int i = 0; i < 10; i++) {
+    driver.getMode();
+  }
+
+  counting = true;
+  for (size_t i = 0; i < cycles; i++) {
+    driver.getMode();
+  }
+  counting = false;
+
+  running.store(false);
+  device.join();
+  driver.shutdown();
+  close(master_fd);
+
+  std::cout << "{\"cycles\": " << cycles << ", \"allocations\": " << allocations
+            << ", \"allocations_per_cycle\": " << (double)allocations / cycles
+            << "}" << std::endl;
+  return allocations == 0 ? 0 : 1;
+}
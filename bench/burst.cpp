@@ -0,0 +1,191 @@
+// What burst frames buy over one data frame per sample, at each burst size:
+//
+// - bytes_per_sample on the wire, and the most samples/sec that fits through
+//   a line at a few baud rates (10 bits per byte, 8N1).
+// - decode_ns_per_sample: `FrameDecoder::decode` (de-framing, unpacking and
+//   the clock model) over a recorded stream of them, best of several rounds.
+// - live: a `SensorSim` in this process over a `LoopbackLink`, at its top
+//   output rate, in auto and then burst mode - samples/sec through the
+//   driver, samples lost, bytes read per sample, and CPU time per sample
+//   (the whole process - sim and driver both).
+//
+// usage: bench_burst [rounds] [live_seconds]
+
+#include "byte_ring.h"
+#include "driver.h"
+#include "frame_decoder.h"
+#include "gyro_xyz.h"
+#include "loopback_interface.h"
+#include "message_coder.h"
+#include "sim.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <span>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+// samples in the recorded stream - about a ring's worth at the largest size
+const size_t RECORDED_SAMPLES = 256;
+
+const double BAUD_RATES[] = {38400, 115200, 921600};
+
+// keeps the compiler from optimizing the work away
+static volatile size_t sink;
+
+static double cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// A recording of `n_samples` samples, sent one per data frame if
+// `burst_samples` is 0, and otherwise `burst_samples` to a burst frame
+static std::vector<uint8_t> recordStream(size_t n_samples,
+                                         size_t burst_samples) {
+  MessageCoder<DataResponseRaw_t> data_coder(DELIM);
+  BurstCoder burst_coder(DELIM);
+  std::vector<uint8_t> stream(n_samples * BURST_MAX_FRAME_LENGTH);
+  size_t len = 0;
+
+  BurstSampleRaw_t burst[BURST_MAX_SAMPLES];
+  for (size_t i = 0; i < n_samples;) {
+    auto out = std::span<uint8_t>(stream).subspan(len);
+    if (burst_samples == 0) {
+      len += data_coder.frame(DataResponseRaw_t{.addr = DATA_GET_REG,
+                                                .count = (uint16_t)i,
+                                                .x_rate = 0.1f,
+                                                .y_rate = 0.2f,
+                                                .z_rate = 0.3f,
+                                                .delim = DELIM},
+                              out);
+      i++;
+      continue;
+    }
+
+    size_t n = std::min(burst_samples, n_samples - i);
+    for (size_t j = 0; j < n; j++) {
+      burst[j] =
+          BurstSampleRaw_t{.x_rate = 0.1f, .y_rate = 0.2f, .z_rate = 0.3f};
+    }
+    len += burst_coder.frame(
+        BurstHeaderRaw_t{.addr = BURST_DATA_REG,
+                         .flags = 0,
+                         .samples = (uint8_t)n,
+                         .count = (uint16_t)i},
+        0, std::span<const BurstSampleRaw_t>(burst, n), out);
+    i += n;
+  }
+
+  stream.resize(len);
+  return stream;
+}
+
+// Best ns per sample to decode `stream` (of `n_samples` samples)
+static double decodeNs(const std::vector<uint8_t> &stream, size_t n_samples,
+                       size_t rounds) {
+  MessageCoder<ResponseRaw_t> response_coder(DELIM);
+  MessageCoder<DataResponseRaw_t> data_coder(DELIM);
+  FrameDecoder decoder(response_coder, data_coder);
+  ByteRing ring;
+  const size_t reps = 64;
+
+  double best = 1e30;
+  for (size_t r = 0; r < rounds; r++) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reps; i++) {
+      ring.clear();
+      ring.write(stream.data(), stream.size());
+      sink = decoder.decode(ring, r * reps + i);
+      decoder.dataResponses().clear();
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    best = std::min(best, elapsed / (reps * n_samples));
+  }
+  return best;
+}
+
+// Runs the sim in `mode` for `seconds` and prints what the driver got
+static void live(const char *name, uint8_t mode, uint8_t burst_samples,
+                 double seconds) {
+  LoopbackLink link;
+  SensorSim sim(link.second());
+  sim.setOutputRate(MAX_OUTPUT_RATE_HZ);
+  sim.init();
+  std::thread sim_thread([&] { sim.run(); });
+
+  SensorDriver driver(link.first());
+  driver.init();
+  if (burst_samples > 0) {
+    driver.setBurst(burst_samples, true);
+  }
+
+  size_t samples = 0;
+  size_t lost = 0;
+  double temperature_c = 0;
+  driver.startStreaming([&](const TimedSample_t &sample) {
+    samples++;
+    lost += sample.lost;
+    temperature_c = sample.temperature_c;
+  });
+
+  driver.setMode(mode);
+  auto bytes_before = driver.metrics().io.bytes_in;
+  size_t samples_before = samples;
+  double cpu_start = cpuSeconds();
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  double cpu = cpuSeconds() - cpu_start;
+  size_t got = samples - samples_before;
+  auto bytes = driver.metrics().io.bytes_in - bytes_before;
+  driver.setMode(MODE_ARG_MANUAL);
+  driver.stopStreaming();
+
+  driver.shutdown();
+  sim.stop();
+  sim_thread.join();
+  sim.shutdown();
+
+  std::cout << "{\"live\": \"" << name << "\", \"samples_per_sec\": "
+            << got / elapsed << ", \"lost\": " << lost
+            << ", \"bytes_per_sample\": " << (got ? (double)bytes / got : 0)
+            << ", \"cpu_us_per_sample\": " << (got ? 1e6 * cpu / got : 0);
+  if (burst_samples > 0) {
+    std::cout << ", \"temperature_c\": " << temperature_c;
+  }
+  std::cout << "}" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  size_t rounds = argc > 1 ? std::atoi(argv[1]) : 200;
+  double live_seconds = argc > 2 ? std::atof(argv[2]) : 1.0;
+
+  // 0 is one data frame per sample
+  for (size_t burst_samples : {0, 1, 4, 8, 16, 32}) {
+    auto stream = recordStream(RECORDED_SAMPLES, burst_samples);
+    double bytes_per_sample = (double)stream.size() / RECORDED_SAMPLES;
+
+    std::cout << "{\"burst_samples\": " << burst_samples
+              << ", \"bytes_per_sample\": " << bytes_per_sample;
+    for (double baud : BAUD_RATES) {
+      std::cout << ", \"max_samples_per_sec_" << baud
+                << "\": " << baud / 10 / bytes_per_sample;
+    }
+    std::cout << ", \"decode_ns_per_sample\": "
+              << decodeNs(stream, RECORDED_SAMPLES, rounds) << "}"
+              << std::endl;
+  }
+
+  live("auto", MODE_ARG_AUTO, 0, live_seconds);
+  live("burst_16", MODE_ARG_BURST, 16, live_seconds);
+  return 0;
+}
@@ -0,0 +1,191 @@
+// Throughput of delimiter scanning and of de-framing a backlog, in MB/s,
+// across buffer sizes.
+//
+// - scan_*: `findByte` over a buffer with no delimiter in it (the worst case,
+//   every byte has to be looked at), per implementation, and `scan_mb_s`
+//   for `findByte` itself. The sizes past BYTE_RING_CAPACITY are where AVX2
+//   catches up with SSE2 - longer than `findByte` is ever given.
+// - decode_*: `FrameDecoder::decode` over a buffer of recorded stream - a mix
+//   of data frames and responses, either clean, or with bursts of line noise
+//   in between so the decoder keeps losing sync. `bytewise` is the same
+//   decoder logic resyncing a byte at a time, as it used to.
+//
+// The ring only holds BYTE_RING_CAPACITY bytes, so decoding is only run up to
+// that size.
+//
+// usage: bench_delim_scan [rounds]
+
+#include "byte_ring.h"
+#include "byte_scan.h"
+#include "frame_decoder.h"
+#include "gyro_xyz.h"
+#include "message_coder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// keeps the compiler from optimizing the work away
+static volatile size_t sink;
+
+// each timed round covers about this many bytes, so small buffers aren't
+// just measuring the clock
+const size_t BYTES_PER_ROUND = 1 << 20;
+
+// Times `rounds` rounds of `work` (which goes over `bytes` bytes), returns
+// the best MB/s
+template <typename F> static double bestOf(size_t rounds, size_t bytes, F work) {
+  size_t reps = std::max<size_t>(1, BYTES_PER_ROUND / bytes);
+  double best = 0;
+  for (size_t r = 0; r < rounds; r++) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reps; i++) {
+      work();
+    }
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    best = std::max(best, reps * bytes / elapsed / 1e6);
+  }
+  return best;
+}
+
+// A recording of device output, `len` bytes long: data frames with the odd
+// response, with `noise` bytes of random junk (no delimiters) after each
+// frame
+static std::vector<uint8_t> recordStream(size_t len, size_t noise,
+                                         std::mt19937 &rng) {
+  MessageCoder<DataResponseRaw_t> data_coder(DELIM);
+  MessageCoder<ResponseRaw_t> response_coder(DELIM);
+  std::uniform_int_distribution<int> junk(0, 255);
+  std::vector<uint8_t> out;
+  uint8_t frame[32];
+  uint16_t count = 0;
+
+  while (out.size() < len) {
+    size_t n;
+    if (count % 8 == 7) {
+      n = response_coder.frame(
+          ResponseRaw_t{.addr = MODE_GET_REG, .data = 0, .delim = DELIM},
+          frame);
+    } else {
+      n = data_coder.frame(DataResponseRaw_t{.addr = DATA_GET_REG,
+                                             .count = count,
+                                             .x_rate = 0.1f * count,
+                                             .y_rate = -0.2f,
+                                             .z_rate = 0.3f,
+                                             .delim = DELIM},
+                           frame);
+    }
+    count++;
+    out.insert(out.end(), frame, frame + n);
+    for (size_t i = 0; i < noise; i++) {
+      uint8_t b = junk(rng);
+      out.push_back(b == DELIM ? 0 : b);
+    }
+  }
+  out.resize(len);
+  return out;
+}
+
+// the decoder's loop as it was, sliding forward one byte on a bad frame
+static size_t decodeBytewise(ByteRing &ring,
+                             MessageCoder<ResponseRaw_t> &response_coder,
+                             MessageCoder<DataResponseRaw_t> &data_coder) {
+  size_t count = 0;
+  while (!ring.empty()) {
+    if (ring.peek(0) == DATA_GET_REG) {
+      if (ring.size() < data_coder.getFrameLength()) {
+        break;
+      }
+      if (data_coder.frameAt(ring)) {
+        DataResponseRaw_t data_resp;
+        data_coder.decodeFrame(ring, data_resp);
+        count++;
+        continue;
+      }
+    } else {
+      if (ring.size() < response_coder.getFrameLength()) {
+        break;
+      }
+      if (response_coder.frameAt(ring)) {
+        ResponseRaw_t resp;
+        response_coder.decodeFrame(ring, resp);
+        count++;
+        continue;
+      }
+    }
+    ring.consume(1);
+  }
+  return count;
+}
+
+int main(int argc, char *argv[]) {
+  size_t rounds = argc > 1 ? std::atoi(argv[1]) : 20;
+  const size_t sizes[] = {256, 1024, 4096, 8192, 16384, 65536};
+  std::mt19937 rng(1234);
+
+  MessageCoder<ResponseRaw_t> response_coder(DELIM);
+  MessageCoder<DataResponseRaw_t> data_coder(DELIM);
+  FrameDecoder decoder(response_coder, data_coder);
+  ByteRing ring;
+
+  const size_t n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  std::cout << "{\"avx2\": " << (haveAvx2() ? "true" : "false")
+            << ", \"results\": [" << std::endl;
+  for (size_t s = 0; s < n_sizes; s++) {
+    size_t size = sizes[s];
+
+    std::vector<uint8_t> no_delim(size, 0x55);
+    auto scan = [&](size_t (*find)(const uint8_t *, size_t, uint8_t)) {
+      return bestOf(rounds, size, [&] {
+        sink = find(no_delim.data(), no_delim.size(), DELIM);
+      });
+    };
+
+    auto clean = recordStream(size, 0, rng);
+    auto noisy = recordStream(size, 64, rng);
+    std::vector<uint8_t> junk = recordStream(size, size, rng);
+
+    // the ring is refilled each round, so the clear/write is in the timing
+    // for every variant alike
+    auto decode = [&](const std::vector<uint8_t> &stream) {
+      return bestOf(rounds, size, [&] {
+        ring.clear();
+        ring.write(stream.data(), stream.size());
+        sink = decoder.decode(ring, 0);
+        decoder.responses().clear();
+        decoder.dataResponses().clear();
+      });
+    };
+    auto decode_bytewise = [&](const std::vector<uint8_t> &stream) {
+      return bestOf(rounds, size, [&] {
+        ring.clear();
+        ring.write(stream.data(), stream.size());
+        sink = decodeBytewise(ring, response_coder, data_coder);
+      });
+    };
+
+    std::cout << "    {\"buffer_bytes\": " << size
+              << ", \"scan_scalar_mb_s\": " << scan(findByteScalar)
+              << ", \"scan_sse2_mb_s\": " << scan(findByteSse2)
+              << ", \"scan_avx2_mb_s\": " << scan(findByteAvx2)
+              << ", \"scan_mb_s\": " << scan(findByte);
+    if (size <= BYTE_RING_CAPACITY) {
+      std::cout << ", \"decode_clean_mb_s\": " << decode(clean)
+                << ", \"decode_noisy_mb_s\": " << decode(noisy)
+                << ", \"decode_noisy_bytewise_mb_s\": "
+                << decode_bytewise(noisy)
+                << ", \"decode_junk_mb_s\": " << decode(junk)
+                << ", \"decode_junk_bytewise_mb_s\": "
+                << decode_bytewise(junk);
+    }
+    std::cout << "}" << (s + 1 < n_sizes ? "," : "") << std::endl;
+  }
+  std::cout << "  ]" << std::endl << "}" << std::endl;
+  return 0;
+}
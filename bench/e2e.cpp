@@ -0,0 +1,246 @@
+// The benchmark suite - everything in one run, as one JSON document, so runs
+// can be diffed between releases:
+//
+// - coder: ns per frame for `MessageCoder::frame` and `deFrame`, per frame
+//   type, over batches of back to back frames.
+// - transports: a `SensorSim` and `SensorDriver` in this process, connected
+//   over a pty (through the kernel tty layer, like socat), a socketpair, and
+//   an in-memory `LoopbackLink`. For each: round trip latency of `getMode()`
+//   and `getRates()`, and sustained auto-mode throughput at the sim's top
+//   output rate - along with how far each sample's interval from the last
+//   strays from the sim's period, by receive time and by the driver's
+//   `SampleClock` estimate.
+//
+// latencies are reported as p50/p99/p99.9 (plus min/max).
+//
+// usage: bench_e2e [round_trips] [stream_seconds]
+
+#include "driver.h"
+#include "fd_interface.h"
+#include "gyro_xyz.h"
+#include "loopback_interface.h"
+#include "message_coder.h"
+#include "sim.h"
+#include "uart_interface.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// frames per timed batch in the coder benchmarks
+const size_t CODER_BATCH_FRAMES = 256;
+const size_t CODER_ROUNDS = 2000;
+
+// `samples` (sorted in place) as a JSON object of percentiles
+static std::string percentiles(std::vector<double> &samples) {
+  if (samples.empty()) {
+    return "{\"n\": 0}";
+  }
+  std::sort(samples.begin(), samples.end());
+  auto at = [&](double p) {
+    size_t index = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+    return samples[index];
+  };
+
+  std::ostringstream out;
+  out << "{\"n\": " << samples.size() << ", \"min\": " << samples.front()
+      << ", \"p50\": " << at(0.5) << ", \"p99\": " << at(0.99)
+      << ", \"p99_9\": " << at(0.999) << ", \"max\": " << samples.back()
+      << "}";
+  return out.str();
+}
+
+static double elapsedNs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// ns per frame to frame, and to de-frame, batches of `frames`
+template <typename T>
+static std::string benchCoder(const char *name, const T &frame) {
+  MessageCoder<T> coder(DELIM);
+  size_t len = coder.getFrameLength();
+  std::vector<uint8_t> wire(CODER_BATCH_FRAMES * len);
+  std::vector<T> decoded(CODER_BATCH_FRAMES);
+  ByteRing ring;
+
+  std::vector<double> frame_ns;
+  std::vector<double> deframe_ns;
+  for (size_t r = 0; r < CODER_ROUNDS; r++) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < CODER_BATCH_FRAMES; i++) {
+      coder.frame(frame, std::span<uint8_t>(&wire[i * len], len));
+    }
+    frame_ns.push_back(elapsedNs(start) / CODER_BATCH_FRAMES);
+
+    ring.clear();
+    ring.write(wire.data(), wire.size());
+    start = std::chrono::steady_clock::now();
+    size_t n = coder.deFrame(ring, decoded.data(), decoded.size());
+    deframe_ns.push_back(elapsedNs(start) / CODER_BATCH_FRAMES);
+
+    if (n != CODER_BATCH_FRAMES) {
+      throw std::runtime_error(std::string("Failed to de-frame ") + name);
+    }
+  }
+
+  std::ostringstream out;
+  out << "{\"type\": \"" << name << "\", \"frame_ns\": "
+      << percentiles(frame_ns) << ", \"deframe_ns\": "
+      << percentiles(deframe_ns) << "}";
+  return out.str();
+}
+
+// microseconds for each of `n` calls to `call`
+static std::vector<double> roundTrips(size_t n, std::function<void()> call) {
+  // warm up first - page faults, lazily created state and so on
+  for (size_t i = 0; i < 100; i++) {
+    call();
+  }
+  std::vector<double> samples;
+  samples.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    auto start = std::chrono::steady_clock::now();
+    call();
+    samples.push_back(elapsedNs(start) / 1000);
+  }
+  return samples;
+}
+
+// Runs a sim on `sim_io` and a driver on `driver_io`, returns the results
+static std::string benchTransport(const char *name, IOInterface &driver_io,
+                                  IOInterface &sim_io, size_t round_trips,
+                                  double stream_seconds) {
+  SensorSim sim(sim_io);
+  sim.setOutputRate(MAX_OUTPUT_RATE_HZ);
+  sim.init();
+  std::thread sim_thread([&] { sim.run(); });
+
+  SensorDriver driver(driver_io);
+  driver.init();
+
+  auto get_mode = roundTrips(round_trips, [&] { driver.getMode(); });
+  auto get_rates = roundTrips(round_trips, [&] { driver.getRates(); });
+
+  // auto mode, with samples handed straight over on the reader thread
+  size_t frames = 0;
+  size_t lost = 0;
+  const double period_ns = 1e9 / MAX_OUTPUT_RATE_HZ;
+  std::vector<double> rx_jitter, estimate_jitter;
+  rx_jitter.reserve(stream_seconds * MAX_OUTPUT_RATE_HZ * 2);
+  estimate_jitter.reserve(stream_seconds * MAX_OUTPUT_RATE_HZ * 2);
+  TimedSample_t last = {};
+  driver.startStreaming([&](const TimedSample_t &sample) {
+    if (frames > 0 && sample.lost == 0) {
+      // signed, so a step backwards shows up as one rather than wrapping
+      int64_t rx_step = sample.rx_ns - last.rx_ns;
+      int64_t estimate_step = sample.time_ns - last.time_ns;
+      rx_jitter.push_back(std::abs(rx_step - period_ns) / 1000);
+      estimate_jitter.push_back(std::abs(estimate_step - period_ns) / 1000);
+    }
+    lost += sample.lost;
+    last = sample;
+    frames++;
+  });
+  driver.setMode(MODE_ARG_AUTO);
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(stream_seconds));
+  double elapsed = elapsedNs(start) / 1e9;
+  driver.setMode(MODE_ARG_MANUAL);
+  driver.stopStreaming();
+  size_t streamed = frames;
+  auto driver_metrics = driver.metrics();
+
+  driver.shutdown();
+  sim.stop();
+  sim_thread.join();
+  sim.shutdown();
+
+  std::ostringstream out;
+  out << "{\"transport\": \"" << name
+      << "\", \"get_mode_us\": " << percentiles(get_mode)
+      << ", \"get_rates_us\": " << percentiles(get_rates)
+      << ", \"auto\": {\"rate_hz\": " << MAX_OUTPUT_RATE_HZ
+      << ", \"frames\": " << streamed
+      << ", \"frames_per_sec\": " << streamed / elapsed
+      << ", \"lost\": " << lost
+      << ", \"rx_jitter_us\": " << percentiles(rx_jitter)
+      << ", \"estimate_jitter_us\": " << percentiles(estimate_jitter)
+      << "}, \"driver\": ";
+  writeJson(out, driver_metrics);
+  out << ", \"sim\": ";
+  writeJson(out, sim.metrics());
+  out << "}";
+  return out.str();
+}
+
+int main(int argc, char *argv[]) {
+  size_t round_trips = argc > 1 ? std::atol(argv[1]) : 5000;
+  double stream_seconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+
+  std::vector<std::string> coder = {
+      benchCoder("command",
+                 CommandRaw_t{.addr = MODE_GET_REG, .data = 0, .delim = DELIM}),
+      benchCoder("response", ResponseRaw_t{.addr = MODE_GET_REG,
+                                           .data = MODE_ARG_MANUAL,
+                                           .delim = DELIM}),
+      benchCoder("data", DataResponseRaw_t{.addr = DATA_GET_REG,
+                                           .count = 1,
+                                           .x_rate = 0.1f,
+                                           .y_rate = 0.2f,
+                                           .z_rate = 0.3f,
+                                           .delim = DELIM}),
+  };
+
+  std::vector<std::string> transports;
+  {
+    // the driver on the slave side, as if it were the real port; the sim
+    // on the master
+    int master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_fd < 0 || grantpt(master_fd) != 0 ||
+        unlockpt(master_fd) != 0) {
+      std::cerr << "Failed to open a pty" << std::endl;
+      return 1;
+    }
+    UartInterface driver_io(ptsname(master_fd), 38400);
+    FdInterface sim_io(master_fd, master_fd);
+    transports.push_back(benchTransport("pty", driver_io, sim_io, round_trips,
+                                        stream_seconds));
+  }
+  {
+    int a, b;
+    openSocketPair(a, b);
+    FdInterface driver_io(a, a);
+    FdInterface sim_io(b, b);
+    transports.push_back(benchTransport("socketpair", driver_io, sim_io,
+                                        round_trips, stream_seconds));
+  }
+  {
+    LoopbackLink link;
+    transports.push_back(benchTransport("loopback", link.first(),
+                                        link.second(), round_trips,
+                                        stream_seconds));
+  }
+
+  std::cout << "{\"coder\": [" << std::endl;
+  for (size_t i = 0; i < coder.size(); i++) {
+    std::cout << "  " << coder[i] << (i + 1 < coder.size() ? "," : "")
+              << std::endl;
+  }
+  std::cout << "], \"transports\": [" << std::endl;
+  for (size_t i = 0; i < transports.size(); i++) {
+    std::cout << "  " << transports[i]
+              << (i + 1 < transports.size() ? "," : "") << std::endl;
+  }
+  std::cout << "]}" << std::endl;
+  return 0;
+}
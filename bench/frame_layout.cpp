@@ -0,0 +1,195 @@
+// Compares the `WireLayout` big-endian encode/decode against the old approach
+// of memcpy'ing the packed struct straight onto the wire (host byte order),
+// for data frames - the only multi-byte ones.
+//
+// Frames are encoded into / decoded out of a buffer of back to back frames,
+// like a burst off the wire, and the best of several rounds is reported in
+// ns per frame. The `ring_` numbers decode out of a `ByteRing` the way the
+// driver does, with both paths getting the same access to it (straight out of
+// its storage, unless a frame wraps) - the raw numbers isolate the cost of the
+// byte swapping.
+//
+// The two take turns, round by round, so both see the same clock speed and
+// neighbours. `layout_at_least_as_fast` says whether every layout number came
+// in within SAME_SPEED_TOLERANCE of its cast counterpart. With a byte shuffle
+// (see `frame_layout.h`) the layout compiles to the cast's 16-byte load and
+// store plus one shuffle.
+//
+// usage: bench_frame_layout [frames] [rounds]
+
+#include "byte_ring.h"
+#include "frame_layout.h"
+#include "message_coder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+typedef WireLayout<DataResponseRaw_t> DataLayout;
+
+// layout over cast time that still counts as the same speed - where a loop
+// happens to land in the binary moves these numbers by more than that
+// between builds
+const double SAME_SPEED_TOLERANCE = 1.10;
+
+// times the ring is refilled and drained per round, so a round is long
+// enough to time properly
+const size_t RING_PASSES = 16;
+
+// keeps the compiler from optimizing the work away
+static volatile uint32_t sink;
+
+static uint32_t checksum(const std::vector<DataResponseRaw_t> &frames) {
+  uint32_t sum = 0;
+  for (auto &frame : frames) {
+    sum += frame.count + (uint32_t)frame.x_rate;
+  }
+  return sum;
+}
+
+// Runs `work` once, returns how long it took in ns per frame
+template <typename F> static double timeOnce(size_t frames, F &work) {
+  auto start = std::chrono::steady_clock::now();
+  work();
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         frames;
+}
+
+// fastest of each side, in ns per frame
+struct Comparison {
+  double cast_ns;
+  double layout_ns;
+
+  bool sameSpeed() const {
+    return layout_ns <= cast_ns * SAME_SPEED_TOLERANCE;
+  };
+};
+
+// Runs `cast` and `layout` `rounds` times each, taking turns
+template <typename C, typename L>
+static Comparison compare(size_t rounds, size_t frames, C cast, L layout) {
+  Comparison result = {.cast_ns = 1e30, .layout_ns = 1e30};
+  for (size_t r = 0; r < rounds; r++) {
+    result.cast_ns = std::min(result.cast_ns, timeOnce(frames, cast));
+    result.layout_ns = std::min(result.layout_ns, timeOnce(frames, layout));
+  }
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n_frames = argc > 1 ? std::atoi(argv[1]) : 4096;
+  size_t rounds = argc > 2 ? std::atoi(argv[2]) : 200;
+
+  std::vector<DataResponseRaw_t> frames(n_frames);
+  for (size_t i = 0; i < n_frames; i++) {
+    frames[i] = DataResponseRaw_t{.addr = 0x80,
+                                  .count = (uint16_t)i,
+                                  .x_rate = 0.5f * i,
+                                  .y_rate = -0.25f * i,
+                                  .z_rate = 1.0f,
+                                  .delim = 0x0D};
+  }
+  std::vector<DataResponseRaw_t> decoded(n_frames);
+
+  // the wire buffer sits half a page off `decoded` - back to back allocations
+  // land a multiple of 4 KiB apart, and then the cpu mistakes loads from one
+  // for stores to the other (4K aliasing), which swamps what's measured here
+  std::vector<uint8_t> wire_storage(n_frames * DataLayout::size + 4096);
+  size_t skew = ((uintptr_t)decoded.data() - (uintptr_t)wire_storage.data() +
+                 2048) %
+                4096;
+  uint8_t *wire = wire_storage.data() + skew;
+
+  auto encode = compare(
+      rounds, n_frames,
+      [&] {
+        for (size_t i = 0; i < n_frames; i++) {
+          std::memcpy(&wire[i * sizeof(DataResponseRaw_t)], &frames[i],
+                      sizeof(DataResponseRaw_t));
+        }
+        sink = wire[n_frames / 2];
+      },
+      [&] {
+        for (size_t i = 0; i < n_frames; i++) {
+          DataLayout::encode(frames[i], &wire[i * DataLayout::size]);
+        }
+        sink = wire[n_frames / 2];
+      });
+  auto decode = compare(
+      rounds, n_frames,
+      [&] {
+        for (size_t i = 0; i < n_frames; i++) {
+          std::memcpy(&decoded[i], &wire[i * sizeof(DataResponseRaw_t)],
+                      sizeof(DataResponseRaw_t));
+        }
+        sink = checksum(decoded);
+      },
+      [&] {
+        for (size_t i = 0; i < n_frames; i++) {
+          DataLayout::decode(&wire[i * DataLayout::size], decoded[i]);
+        }
+        sink = checksum(decoded);
+      });
+
+  // de-framing out of the receive ring: the old cast path copied straight
+  // into the struct, the coder decodes the fields - both out of the ring's
+  // storage in place, the same way `MessageCoder::decodeFrame` does
+  MessageCoder<DataResponseRaw_t> coder(0x0D);
+  ByteRing ring;
+  const size_t ring_frames = BYTE_RING_CAPACITY / DataLayout::size;
+  auto refill = [&] {
+    ring.clear();
+    ring.write(wire, ring_frames * DataLayout::size);
+  };
+
+  auto ring_decode = compare(
+      rounds, ring_frames * RING_PASSES,
+      [&] {
+        for (size_t pass = 0; pass < RING_PASSES; pass++) {
+          refill();
+          for (size_t i = 0; i < ring_frames; i++) {
+            auto out = reinterpret_cast<uint8_t *>(&decoded[i]);
+            const uint8_t *bytes =
+                ring.contiguous(0, sizeof(DataResponseRaw_t));
+            if (bytes) {
+              std::memcpy(out, bytes, sizeof(DataResponseRaw_t));
+            } else {
+              ring.copyOut(0, out, sizeof(DataResponseRaw_t));
+            }
+            ring.consume(sizeof(DataResponseRaw_t));
+          }
+        }
+        sink = decoded[ring_frames / 2].count;
+      },
+      [&] {
+        for (size_t pass = 0; pass < RING_PASSES; pass++) {
+          refill();
+          for (size_t i = 0; i < ring_frames; i++) {
+            coder.decodeFrame(ring, decoded[i]);
+          }
+        }
+        sink = decoded[ring_frames / 2].count;
+      });
+
+  // sanity check the round trip before reporting anything
+  bool round_trip_ok = checksum(decoded) == checksum(frames);
+  bool as_fast =
+      encode.sameSpeed() && decode.sameSpeed() && ring_decode.sameSpeed();
+
+  std::cout << "{\"frames\": " << n_frames << ", \"rounds\": " << rounds
+            << ", \"cast_encode_ns\": " << encode.cast_ns
+            << ", \"cast_decode_ns\": " << decode.cast_ns
+            << ", \"layout_encode_ns\": " << encode.layout_ns
+            << ", \"layout_decode_ns\": " << decode.layout_ns
+            << ", \"ring_cast_decode_ns\": " << ring_decode.cast_ns
+            << ", \"ring_layout_decode_ns\": " << ring_decode.layout_ns
+            << ", \"layout_at_least_as_fast\": " << (as_fast ? "true" : "false")
+            << ", \"round_trip_ok\": " << (round_trip_ok ? "true" : "false")
+            << "}" << std::endl;
+  return round_trip_ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+// What batching register access buys: a `SensorSim` on a pty in this process,
+// and a `SensorDriver` on the other end, configuring it `writes` registers at
+// a time and reading back every readable register in the map - once with a
+// round trip per register (`writeRegister` / `sendRegisterRead`), and once
+// batched (`writeRegisters` / `readRegisters`). For each, over `rounds`
+// rounds, prints a JSON line with the time per round in us (p50/p99/max) and
+// the registers per second that comes to.
+//
+// usage: bench_registers [rounds] [writes]
+
+#include "driver.h"
+#include "gyro_xyz.h"
+#include "pty_interface.h"
+#include "register_map.h"
+#include "sim.h"
+#include "uart_interface.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void report(const char *op, const char *how, size_t registers,
+                   std::vector<double> &round_us) {
+  std::sort(round_us.begin(), round_us.end());
+  double total_us = 0;
+  for (auto us : round_us) {
+    total_us += us;
+  }
+  auto at = [&](double p) {
+    return round_us[std::min(round_us.size() - 1,
+                             (size_t)(p * round_us.size()))];
+  };
+
+  std::cout << "{\"op\": \"" << op << "\", \"how\": \"" << how
+            << "\", \"registers\": " << registers
+            << ", \"rounds\": " << round_us.size()
+            << ", \"p50_us\": " << at(0.5) << ", \"p99_us\": " << at(0.99)
+            << ", \"max_us\": " << round_us.back()
+            << ", \"registers_per_sec\": "
+            << registers * round_us.size() / (total_us / 1e6) << "}"
+            << std::endl;
+}
+
+// time `rounds` calls of `round`, in us each
+static std::vector<double> timeRounds(size_t rounds,
+                                      const std::function<void()> &round) {
+  std::vector<double> round_us;
+  for (size_t r = 0; r < rounds; r++) {
+    auto start = std::chrono::steady_clock::now();
+    round();
+    round_us.push_back(std::chrono::duration<double, std::micro>(
+                           std::chrono::steady_clock::now() - start)
+                           .count());
+  }
+  return round_us;
+}
+
+int main(int argc, char *argv[]) {
+  size_t rounds = argc > 1 ? std::atoi(argv[1]) : 200;
+  size_t n_writes = argc > 2 ? std::atoi(argv[2]) : 32;
+
+  // a configuration: the plain storage registers, dealt out to `n_writes`
+  // writes with values that vary, so they all stick
+  std::vector<uint8_t> writable;
+  std::vector<uint8_t> readable;
+  for (size_t addr = 0; addr < 256; addr++) {
+    auto reg = findRegister(addr);
+    if (isWritable(addr) && reg->effect == RegEffect::None) {
+      writable.push_back(addr);
+    }
+    if (isReadable(addr)) {
+      readable.push_back(addr);
+    }
+  }
+  std::vector<RegisterWrite_t> writes;
+  for (size_t i = 0; i < n_writes; i++) {
+    writes.push_back(RegisterWrite_t{.addr = writable[i % writable.size()],
+                                     .value = uint8_t(i)});
+  }
+  std::vector<uint8_t> values(readable.size());
+
+  PtyInterface port("/tmp/ttyBENCHREGS");
+  SensorSim sim(port);
+  sim.init();
+  std::thread sim_thread([&] { sim.run(); });
+
+  UartInterface io(port.link(), 38400);
+  SensorDriver driver(io);
+  driver.init();
+
+  auto one_write = timeRounds(rounds, [&] {
+    for (auto &write : writes) {
+      driver.writeRegister(write.addr, write.value);
+    }
+  });
+  auto batch_write =
+      timeRounds(rounds, [&] { driver.writeRegisters(writes); });
+
+  auto one_read = timeRounds(rounds, [&] {
+    for (size_t i = 0; i < readable.size(); i++) {
+      values[i] = driver.sendRegisterRead(readable[i]);
+    }
+  });
+  auto batch_read =
+      timeRounds(rounds, [&] { driver.readRegisters(readable, values); });
+
+  // make sure the batches did what they said - the product id reads back
+  // whole, and the last write to each register stuck
+  auto indexOf = [&](uint8_t addr) {
+    return std::find(readable.begin(), readable.end(), addr) - readable.begin();
+  };
+  size_t prod_id = indexOf(PROD_ID_REG);
+  if (std::string(values.begin() + prod_id, values.begin() + prod_id + 8) !=
+      "G370PDF1") {
+    throw std::runtime_error("Read back the wrong product id");
+  }
+  for (auto &write : writes) {
+    auto last = std::find_if(writes.rbegin(), writes.rend(), [&](auto &other) {
+      return other.addr == write.addr;
+    });
+    if (values[indexOf(write.addr)] != last->value) {
+      throw std::runtime_error("Register write didn't stick");
+    }
+  }
+
+  report("write", "one_by_one", writes.size(), one_write);
+  report("write", "batched", writes.size(), batch_write);
+  report("read", "one_by_one", readable.size(), one_read);
+  report("read", "batched", readable.size(), batch_read);
+
+  driver.shutdown();
+  sim.stop();
+  sim_thread.join();
+  return 0;
+}
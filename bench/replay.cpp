@@ -0,0 +1,80 @@
+// Replays a stream recording into the driver as fast as it will go, and
+// reports decode throughput - real device output, including whatever noise
+// and chunking the port produced, without a device (or sim) in the loop.
+//
+// With --paced the recording comes back at its original timing instead,
+// which should reproduce the original session's sample rate.
+//
+// make a recording with e.g.
+//   SENSOR_RECORD_FILE=/tmp/stream.rec ./bin/bench_throughput 5 /tmp/ttyDRIVER 38400
+//
+// usage: bench_replay <recording> [--paced]
+
+#include "driver.h"
+#include "replay_interface.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <recording> [--paced]" << std::endl;
+    return 1;
+  }
+  bool paced = argc > 2 && std::string(argv[2]) == "--paced";
+
+  // total the recording up front, for the MB/s
+  StreamRecording recording(argv[1]);
+  recording.init();
+  StreamChunk_t chunk;
+  size_t chunks = 0;
+  size_t bytes = 0;
+  while (recording.next(chunk)) {
+    chunks++;
+    bytes += chunk.data.size();
+  }
+  recording.shutdown();
+
+  ReplayInterface io(argv[1], paced ? ReplayPacing::Original
+                                    : ReplayPacing::AsFastAsPossible);
+  SensorDriver driver(io);
+  driver.init();
+
+  // the callback runs on the reader thread, so nothing is dropped for want
+  // of popping fast enough
+  std::atomic<size_t> frames(0);
+  size_t lost = 0;
+  bool have_last = false;
+  uint16_t last_count = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  driver.startStreaming([&](const DataResponseRaw_t &sample) {
+    if (have_last) {
+      lost += (uint16_t)(sample.count - last_count - 1);
+    }
+    last_count = sample.count;
+    have_last = true;
+    frames.fetch_add(1, std::memory_order_relaxed);
+  });
+
+  // the reader stops itself when the recording runs out
+  while (driver.isStreaming()) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  double elapsed =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  driver.stopStreaming();
+
+  std::cout << "{\"paced\": " << (paced ? "true" : "false")
+            << ", \"chunks\": " << chunks << ", \"bytes\": " << bytes
+            << ", \"frames\": " << frames.load()
+            << ", \"lost\": " << lost << ", \"seconds\": " << elapsed
+            << ", \"frames_per_sec\": " << frames.load() / elapsed
+            << ", \"mb_per_sec\": " << bytes / elapsed / 1e6 << "}"
+            << std::endl;
+  return 0;
+}
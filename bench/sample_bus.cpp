@@ -0,0 +1,200 @@
+// Fan-out over a `SampleBus`: one writer publishing at `rate_hz` for a
+// while, and 1, 2, 4, 8, 16 (up to `max_readers`) reader processes forked
+// off to read the bus, each checking every sample's sequence number. Readers
+// spin on `read()`, yielding the CPU when there's nothing new. For each
+// reader count, prints a JSON line with:
+//
+// - published, and the fewest samples any reader got - they should match
+// - lost (lapped by the writer) and mismatches (out of sequence) across all
+//   readers
+// - publish to read latency in us - the worst p50/p99/max of any reader
+// - publish_ns: the writer's mean cost per sample, clock reads included
+//
+// usage: bench_sample_bus [max_readers] [rate_hz] [seconds]
+
+#include "clock.h"
+#include "metrics.h"
+#include "sample_bus.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sched.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+const char *BUS_NAME = "/bench_sample_bus";
+const size_t READ_BATCH = 256;
+
+// what each reader reports back, through memory shared with the parent
+struct ReaderResult {
+  uint64_t samples;
+  uint64_t lost;
+  uint64_t mismatches;
+  HistogramSnapshot_t latency_ns;
+};
+
+struct Shared {
+  std::atomic<uint32_t> ready;
+  std::atomic<bool> done;
+  ReaderResult results[];
+};
+
+// body of a forked reader - read until the writer is done and we've caught up
+static void readerMain(Shared &shared, size_t index) {
+  SampleBusReader reader(BUS_NAME);
+  reader.init();
+  auto latency_ns = std::make_unique<LatencyHistogram>();
+  shared.ready.fetch_add(1, std::memory_order_release);
+
+  TimedSample_t samples[READ_BATCH];
+  uint64_t n_samples = 0;
+  uint64_t mismatches = 0;
+  uint64_t expected = UINT64_MAX;
+  uint64_t lost = 0;
+  while (true) {
+    size_t n = reader.read(samples, READ_BATCH);
+    if (n == 0) {
+      if (shared.done.load(std::memory_order_acquire) &&
+          reader.available() == 0) {
+        break;
+      }
+      sched_yield();
+      continue;
+    }
+
+    // sequence numbers only ever go up, and whatever they skip has to add
+    // up to what the reader says it lost to laps
+    uint64_t now_ns = monotonicNanos();
+    uint64_t skipped = 0;
+    for (size_t i = 0; i < n; i++) {
+      auto &sample = samples[i];
+      if (expected != UINT64_MAX) {
+        if (sample.sequence < expected) {
+          mismatches++;
+        } else {
+          skipped += sample.sequence - expected;
+        }
+      }
+      expected = sample.sequence + 1;
+      latency_ns->record(now_ns - sample.rx_ns);
+    }
+    if (expected != UINT64_MAX && skipped != reader.lost() - lost) {
+      mismatches++;
+    }
+    lost = reader.lost();
+    n_samples += n;
+  }
+
+  shared.results[index] = ReaderResult{.samples = n_samples,
+                                       .lost = reader.lost(),
+                                       .mismatches = mismatches,
+                                       .latency_ns = latency_ns->snapshot()};
+}
+
+static void run(size_t n_readers, double rate_hz, double seconds) {
+  SampleBusWriter bus(BUS_NAME);
+  bus.init();
+
+  size_t shared_size = sizeof(Shared) + n_readers * sizeof(ReaderResult);
+  void *map = mmap(nullptr, shared_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    std::cerr << "Failed to map shared results" << std::endl;
+    std::exit(1);
+  }
+  auto &shared = *new (map) Shared{};
+
+  std::vector<pid_t> children;
+  for (size_t i = 0; i < n_readers; i++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      readerMain(shared, i);
+      _exit(0);
+    }
+    children.push_back(pid);
+  }
+  while (shared.ready.load(std::memory_order_acquire) < n_readers) {
+    sched_yield();
+  }
+
+  // paced off absolute deadlines - whatever's due goes out, then we give the
+  // readers the CPU
+  int64_t period_ns = 1e9 / rate_hz;
+  int64_t start_ns = monotonicNanos();
+  int64_t end_ns = start_ns + seconds * 1e9;
+  int64_t next_ns = start_ns;
+  uint64_t publish_ns = 0;
+  TimedSample_t sample = {};
+  while (next_ns < end_ns) {
+    int64_t now_ns = monotonicNanos();
+    if (now_ns < next_ns) {
+      sched_yield();
+      continue;
+    }
+    while (next_ns <= now_ns && next_ns < end_ns) {
+      uint64_t before_ns = monotonicNanos();
+      sample.sequence = bus.published();
+      sample.data.count = (uint16_t)sample.sequence;
+      sample.rx_ns = before_ns;
+      sample.time_ns = next_ns;
+      bus.publish(sample);
+      publish_ns += monotonicNanos() - before_ns;
+      next_ns += period_ns;
+    }
+  }
+
+  shared.done.store(true, std::memory_order_release);
+  for (auto pid : children) {
+    waitpid(pid, nullptr, 0);
+  }
+
+  uint64_t min_samples = UINT64_MAX;
+  uint64_t lost = 0;
+  uint64_t mismatches = 0;
+  uint64_t p50_ns = 0;
+  uint64_t p99_ns = 0;
+  uint64_t max_ns = 0;
+  for (size_t i = 0; i < n_readers; i++) {
+    auto &result = shared.results[i];
+    min_samples = std::min(min_samples, result.samples);
+    lost += result.lost;
+    mismatches += result.mismatches;
+    p50_ns = std::max(p50_ns, result.latency_ns.percentile(0.5));
+    p99_ns = std::max(p99_ns, result.latency_ns.percentile(0.99));
+    max_ns = std::max(max_ns, result.latency_ns.max);
+  }
+
+  std::cout << "{\"readers\": " << n_readers << ", \"rate_hz\": " << rate_hz
+            << ", \"published\": " << bus.published()
+            << ", \"min_read\": " << min_samples << ", \"lost\": " << lost
+            << ", \"mismatches\": " << mismatches
+            << ", \"p50_us\": " << p50_ns / 1e3
+            << ", \"p99_us\": " << p99_ns / 1e3
+            << ", \"max_us\": " << max_ns / 1e3 << ", \"publish_ns\": "
+            << (double)publish_ns / std::max<uint64_t>(1, bus.published())
+            << "}" << std::endl;
+
+  munmap(map, shared_size);
+  bus.shutdown();
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_readers = argc > 1 ? std::atoi(argv[1]) : 16;
+  double rate_hz = argc > 2 ? std::atof(argv[2]) : 20000;
+  double seconds = argc > 3 ? std::atof(argv[3]) : 2;
+
+  for (size_t n = 1; n <= max_readers; n *= 2) {
+    run(n, rate_hz, seconds);
+  }
+  if (max_readers > 1 && (max_readers & (max_readers - 1)) != 0) {
+    run(max_readers, rate_hz, seconds);
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+// Measures how a single SensorManager thread copes as the number of sensors
+// grows: every port given on the command line is put into auto mode, then the
+// manager is run for a while and its sample rate and CPU use are reported.
+//
+// usage: bench_sensor_manager <seconds> <port> [port...]
+// see sensor_manager.sh for setting up the sims/ports
+
+#include "driver.h"
+#include "gyro_xyz.h"
+#include "io_interface.h"
+#include "sensor_manager.h"
+#include "uart_interface.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+static double cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <seconds> <port> [port...]"
+              << std::endl;
+    return 1;
+  }
+  double duration = std::atof(argv[1]);
+
+  std::vector<std::unique_ptr<UartInterface>> ios;
+  std::vector<std::unique_ptr<SensorDriver>> drivers;
+  SensorManager manager;
+
+  for (int i = 2; i < argc; i++) {
+    ios.emplace_back(new UartInterface(argv[i], 38400));
+    drivers.emplace_back(new SensorDriver(*ios.back()));
+    drivers.back()->init();
+    drivers.back()->setMode(MODE_ARG_AUTO);
+    manager.addSensor(*drivers.back());
+  }
+
+  std::vector<size_t> counts(drivers.size(), 0);
+  manager.setSampleCallback(
+      [&counts](const SensorSample &sample) { counts[sample.sensor]++; });
+
+  double cpu_start = cpuSeconds();
+  auto wall_start = std::chrono::steady_clock::now();
+
+  std::thread stopper([&manager, duration] {
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+    manager.stop();
+  });
+  manager.run();
+  stopper.join();
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                              wall_start)
+                    .count();
+  double cpu = cpuSeconds() - cpu_start;
+
+  size_t total = 0;
+  for (auto count : counts) {
+    total += count;
+  }
+
+  for (auto &driver : drivers) {
+    driver->setMode(MODE_ARG_MANUAL);
+  }
+
+  std::cout << "{\"sensors\": " << drivers.size() << ", \"seconds\": " << wall
+            << ", \"samples\": " << total
+            << ", \"samples_per_sec\": " << total / wall
+            << ", \"cpu_percent\": " << 100.0 * cpu / wall
+            << ", \"cpu_ns_per_sample\": " << (total ? 1e9 * cpu / total : 0)
+            << "}" << std::endl;
+  return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Sweeps bench_sensor_manager over 1..N sensors, all hosted by a single
+# bin/sim on ptys of its own. Prints one JSON line per sensor count.
+#
+# usage: bench/sensor_manager.sh [max_sensors] [seconds] [rate_hz]   (from the repo root)
+
+MAX_SENSORS=${1:-16}
+SECONDS_PER_RUN=${2:-5}
+RATE_HZ=${3:-10}
+
+for ((n = 1; n <= MAX_SENSORS; n *= 2)); do
+  ./bin/sim /tmp/ttySENSOR 38400 "$RATE_HZ" "$n" >/dev/null &
+  pid=$!
+  sleep 0.5
+
+  ports=()
+  for ((i = 0; i < n; i++)); do
+    ports+=(/tmp/ttySENSOR$i)
+  done
+  ./bin/bench_sensor_manager "$SECONDS_PER_RUN" "${ports[@]}"
+
+  kill "$pid" 2>/dev/null
+  wait 2>/dev/null
+done
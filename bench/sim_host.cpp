@@ -0,0 +1,148 @@
+// How many sensors one `SimHost` thread can keep up with: for 1, 4, 16, 64
+// (up to `max_sensors`) sims on ptys of their own, all in auto mode at
+// `rate_hz`, run for a while with a `SensorManager` reading every one of them
+// from a second thread, and report:
+//
+// - samples_per_sec against expected_per_sec (sensors x rate), and samples
+//   lost on the way
+// - the sims' cycle lateness (worst and mean, in us) and overruns - cycles
+//   that ran a whole period or more late
+// - sim_cpu_percent: CPU time of the host thread, against wall time; and
+//   cpu_percent for the whole process (host and manager both)
+//
+// usage: bench_sim_host [max_sensors] [rate_hz] [seconds]
+
+#include "driver.h"
+#include "gyro_xyz.h"
+#include "pty_interface.h"
+#include "sensor_manager.h"
+#include "sim.h"
+#include "sim_host.h"
+#include "uart_interface.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+static double cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static double threadCpuSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(size_t n_sensors, double rate_hz, double seconds) {
+  std::vector<std::unique_ptr<PtyInterface>> ports;
+  std::vector<std::unique_ptr<SensorSim>> sims;
+  SimHost host;
+  for (size_t i = 0; i < n_sensors; i++) {
+    ports.push_back(std::make_unique<PtyInterface>("/tmp/ttyBENCHSIM" +
+                                                   std::to_string(i)));
+    sims.push_back(std::make_unique<SensorSim>(*ports.back()));
+    sims.back()->setOutputRate(rate_hz);
+    sims.back()->init();
+    host.addSim(*sims.back());
+  }
+
+  double sim_cpu = 0;
+  std::thread host_thread([&] {
+    double start = threadCpuSeconds();
+    host.run();
+    sim_cpu = threadCpuSeconds() - start;
+  });
+
+  std::vector<std::unique_ptr<UartInterface>> ios;
+  std::vector<std::unique_ptr<SensorDriver>> drivers;
+  SensorManager manager;
+  for (size_t i = 0; i < n_sensors; i++) {
+    ios.push_back(std::make_unique<UartInterface>(ports[i]->link(), 38400));
+    drivers.push_back(std::make_unique<SensorDriver>(*ios.back()));
+    drivers.back()->init();
+    drivers.back()->setMode(MODE_ARG_AUTO);
+    manager.addSensor(*drivers.back());
+  }
+
+  size_t samples = 0;
+  size_t lost = 0;
+  manager.setSampleCallback([&](const SensorSample &sample) {
+    samples++;
+    lost += sample.lost;
+  });
+
+  // let everything settle into auto mode before counting
+  auto settle = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+  while (std::chrono::steady_clock::now() < settle) {
+    manager.poll(10);
+  }
+  samples = 0;
+  lost = 0;
+
+  double cpu_start = cpuSeconds();
+  auto start = std::chrono::steady_clock::now();
+  auto end = start + std::chrono::duration<double>(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    manager.poll(10);
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  double cpu = cpuSeconds() - cpu_start;
+
+  for (auto &driver : drivers) {
+    driver->setMode(MODE_ARG_MANUAL);
+  }
+  host.stop();
+  host_thread.join();
+
+  uint64_t overruns = 0;
+  int64_t max_lateness_ns = 0;
+  double mean_lateness_ns = 0;
+  for (auto &sim : sims) {
+    auto &stats = sim->getCycleStats();
+    overruns += stats.overruns;
+    max_lateness_ns = std::max(max_lateness_ns, stats.max_lateness_ns);
+    mean_lateness_ns += stats.mean_lateness_ns / n_sensors;
+  }
+
+  // the host thread's CPU covers the settling time too
+  std::cout << "{\"sensors\": " << n_sensors << ", \"rate_hz\": " << rate_hz
+            << ", \"samples_per_sec\": " << samples / elapsed
+            << ", \"expected_per_sec\": " << n_sensors * rate_hz
+            << ", \"lost\": " << lost
+            << ", \"max_lateness_us\": " << max_lateness_ns / 1e3
+            << ", \"mean_lateness_us\": " << mean_lateness_ns / 1e3
+            << ", \"overruns\": " << overruns << ", \"sim_cpu_percent\": "
+            << 100.0 * sim_cpu / (elapsed + 0.2)
+            << ", \"cpu_percent\": " << 100.0 * cpu / elapsed << "}"
+            << std::endl;
+
+  for (auto &driver : drivers) {
+    driver->shutdown();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_sensors = argc > 1 ? std::atoi(argv[1]) : 64;
+  double rate_hz = argc > 2 ? std::atof(argv[2]) : 1000;
+  double seconds = argc > 3 ? std::atof(argv[3]) : 3;
+
+  for (size_t n = 1; n <= max_sensors; n *= 4) {
+    run(n, rate_hz, seconds);
+  }
+  if (max_sensors > 1 && (max_sensors & (max_sensors - 1)) != 0) {
+    run(max_sensors, rate_hz, seconds);
+  }
+  return 0;
+}
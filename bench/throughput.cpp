@@ -0,0 +1,93 @@
+// Measures sustained auto-mode throughput from a sim into the driver at a
+// given baud rate: frames/sec and bytes/sec actually received, how many
+// samples went missing (gaps in `count`), and what the line could carry.
+//
+// Note that ptys (including socat's) ignore the configured speed, so against
+// bin/sim this measures the sim/driver rather than the line - point it at a
+// real uart to see the baud rate bite.
+//
+// usage: bench_throughput <seconds> <port> <baud>
+// see throughput.sh for sweeping across rates
+
+#include "driver.h"
+#include "gyro_xyz.h"
+#include "io_interface.h"
+#include "stream_recorder.h"
+#include "uart_interface.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+int main(int argc, char *argv[]) {
+  if (argc < 4) {
+    std::cerr << "usage: " << argv[0] << " <seconds> <port> <baud>"
+              << std::endl;
+    return 1;
+  }
+  double duration = std::atof(argv[1]);
+  int baud_rate = std::atoi(argv[3]);
+
+  UartInterface io(argv[2], baud_rate);
+  SensorDriver driver(io);
+
+  // SENSOR_RECORD_FILE=path keeps the stream, e.g. as input for
+  // bench_replay
+  const char *record_path = std::getenv("SENSOR_RECORD_FILE");
+  StreamRecorder recorder(record_path ? record_path : "");
+  if (record_path) {
+    recorder.init();
+    io.setRecorder(&recorder);
+  }
+  driver.init();
+
+  const size_t batch_size = 256;
+  DataResponseRaw_t batch[batch_size];
+  size_t frames = 0;
+  size_t lost = 0;
+  bool have_last = false;
+  uint16_t last_count = 0;
+
+  driver.startStreaming();
+  driver.setMode(MODE_ARG_AUTO);
+
+  auto start = std::chrono::steady_clock::now();
+  auto end = start + std::chrono::duration<double>(duration);
+  while (std::chrono::steady_clock::now() < end) {
+    size_t n = driver.popSamples(batch, batch_size);
+    if (n == 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (have_last) {
+        lost += (uint16_t)(batch[i].count - last_count - 1);
+      }
+      last_count = batch[i].count;
+      have_last = true;
+    }
+    frames += n;
+  }
+  double elapsed =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  driver.setMode(MODE_ARG_MANUAL);
+  driver.stopStreaming();
+
+  // 8N1 - 10 bits on the wire per byte
+  const size_t frame_size = WireLayout<DataResponseRaw_t>::size;
+  double line_frames_per_sec = baud_rate / 10.0 / frame_size;
+
+  std::cout << "{\"baud\": " << baud_rate << ", \"seconds\": " << elapsed
+            << ", \"frames\": " << frames
+            << ", \"frames_per_sec\": " << frames / elapsed
+            << ", \"bytes_per_sec\": "
+            << frames * frame_size / elapsed
+            << ", \"lost\": " << lost
+            << ", \"overflows\": " << driver.sampleOverflows()
+            << ", \"line_frames_per_sec\": " << line_frames_per_sec << "}"
+            << std::endl;
+  return 0;
+}
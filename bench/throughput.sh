@@ -0,0 +1,24 @@
+#!/bin/bash
+# Runs bench_throughput against bin/sim over a socat PTY pair at each
+# supported baud rate (both sides configured to match). Prints one JSON line
+# per rate.
+#
+# usage: bench/throughput.sh [seconds] [rates...]   (from the repo root)
+
+SECONDS_PER_RUN=${1:-5}
+shift
+RATES=${@:-9600 19200 38400 57600 115200 230400 460800 921600 1000000 2000000 4000000}
+
+for baud in $RATES; do
+  socat PTY,link=/tmp/ttyDRIVER,raw,echo=0 PTY,link=/tmp/ttySIM,raw,echo=0 &
+  socat_pid=$!
+  sleep 0.5
+  ./bin/sim /tmp/ttySIM "$baud" >/dev/null &
+  sim_pid=$!
+  sleep 0.5
+
+  ./bin/bench_throughput "$SECONDS_PER_RUN" /tmp/ttyDRIVER "$baud"
+
+  kill $sim_pid $socat_pid 2>/dev/null
+  wait 2>/dev/null
+done
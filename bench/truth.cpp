@@ -0,0 +1,159 @@
+// What the truth sources cost the sim per sample:
+//
+// - open_us: `init()` - the mapped file should open in about the same time
+//   whatever its size, since nothing past the header is read.
+// - sequential_ns: per lookup, stepping through the whole trajectory a
+//   sample period at a time, as the sim does. For the mapped file this is
+//   run cold (the file dropped from the page cache first, so the pages come
+//   in through readahead as playback goes) and then warm.
+// - seek_ns: per lookup, at random times - the jump path.
+//
+// The binary file has `hours` of records at 1 kHz, looked up at 2 kHz so
+// every other lookup interpolates; the CSV has a minute of them.
+//
+// usage: bench_truth [hours] [dir]
+
+#include "truth_source.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+const int64_t RECORD_INTERVAL_NS = 1000000; // 1 kHz
+const int64_t LOOKUP_INTERVAL_NS = 500000;  // 2 kHz
+const size_t SEEKS = 1000000;
+
+// keeps the compiler from optimizing the work away
+static volatile float sink;
+
+static double since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+static TruthSample_t trajectory(int64_t time_ns) {
+  double t = time_ns / 1e9;
+  return TruthSample_t{.time_ns = time_ns,
+                       .x_rate = (float)std::sin(t),
+                       .y_rate = (float)std::cos(0.7 * t),
+                       .z_rate = (float)std::sin(0.3 * t)};
+}
+
+static void writeBinary(const std::string &path, int64_t duration_ns) {
+  TruthWriter writer(path);
+  writer.init();
+  for (int64_t t = 0; t <= duration_ns; t += RECORD_INTERVAL_NS) {
+    writer.write(trajectory(t));
+  }
+  writer.shutdown();
+}
+
+static void writeCsv(const std::string &path, int64_t duration_ns) {
+  FILE *file = std::fopen(path.c_str(), "w");
+  std::fprintf(file, "time_s,x_rate,y_rate,z_rate\n");
+  for (int64_t t = 0; t <= duration_ns; t += RECORD_INTERVAL_NS) {
+    auto sample = trajectory(t);
+    std::fprintf(file, "%.6f,%.7g,%.7g,%.7g\n", t / 1e9, sample.x_rate,
+                 sample.y_rate, sample.z_rate);
+  }
+  std::fclose(file);
+}
+
+// Drop `path` from the page cache
+static void evict(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+static double sequentialNs(TruthSource &truth, int64_t duration_ns) {
+  float sum = 0;
+  size_t n = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t t = 0; t <= duration_ns; t += LOOKUP_INTERVAL_NS) {
+    sum += truth.at(t).x_rate;
+    n++;
+  }
+  double elapsed = since(start);
+  sink = sum;
+  return elapsed / n;
+}
+
+static double seekNs(TruthSource &truth, int64_t duration_ns, size_t seeks) {
+  std::mt19937_64 rng(1);
+  std::uniform_int_distribution<int64_t> times(0, duration_ns);
+  float sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < seeks; i++) {
+    sum += truth.at(times(rng)).x_rate;
+  }
+  double elapsed = since(start);
+  sink = sum;
+  return elapsed / seeks;
+}
+
+int main(int argc, char *argv[]) {
+  double hours = argc > 1 ? std::atof(argv[1]) : 1;
+  std::string dir(argc > 2 ? argv[2] : "/tmp");
+  int64_t duration_ns = hours * 3600e9;
+  int64_t csv_duration_ns = 60e9;
+  std::string bin_path = dir + "/bench_truth.bin";
+  std::string csv_path = dir + "/bench_truth.csv";
+
+  writeBinary(bin_path, duration_ns);
+  writeCsv(csv_path, csv_duration_ns);
+
+  {
+    SineTruth truth;
+    std::cout << "{\"source\": \"sine\", \"sequential_ns\": "
+              << sequentialNs(truth, duration_ns)
+              << ", \"seek_ns\": " << seekNs(truth, duration_ns, SEEKS) << "}"
+              << std::endl;
+  }
+
+  {
+    evict(bin_path);
+    MappedTruth truth(bin_path);
+    auto start = std::chrono::steady_clock::now();
+    truth.init();
+    double open_us = since(start) / 1e3;
+    double cold_ns = sequentialNs(truth, duration_ns);
+    double warm_ns = sequentialNs(truth, duration_ns);
+    std::cout << "{\"source\": \"mapped\", \"records\": " << truth.size()
+              << ", \"file_mb\": "
+              << (truth.size() * sizeof(TruthSample_t)) / 1e6
+              << ", \"open_us\": " << open_us
+              << ", \"sequential_cold_ns\": " << cold_ns
+              << ", \"sequential_ns\": " << warm_ns
+              << ", \"seek_ns\": " << seekNs(truth, duration_ns, SEEKS) << "}"
+              << std::endl;
+    truth.shutdown();
+  }
+
+  {
+    CsvTruth truth(csv_path);
+    auto start = std::chrono::steady_clock::now();
+    truth.init();
+    double open_us = since(start) / 1e3;
+    // every seek backwards rereads the file from the top, so only a few
+    std::cout << "{\"source\": \"csv\", \"open_us\": " << open_us
+              << ", \"sequential_ns\": "
+              << sequentialNs(truth, csv_duration_ns)
+              << ", \"seek_ns\": " << seekNs(truth, csv_duration_ns, 100)
+              << "}" << std::endl;
+    truth.shutdown();
+  }
+
+  unlink(bin_path.c_str());
+  unlink(csv_path.c_str());
+  return 0;
+}
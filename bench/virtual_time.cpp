@@ -0,0 +1,158 @@
+// Pushes samples through a `SensorDriver` as fast as it can take them, from a
+// `SensorSim` running in virtual time (a `VirtualInterface` over a
+// `LoopbackLink`) - no sleeps, timers or threads, the sim just steps each
+// time the driver reads. The first two runs drive it with `serviceInput()`;
+// the last streams to a callback from the driver's reader thread.
+//
+// every sample is checked on the way out: its sequence number has to follow
+// on from the last one, and its rates have to be the sim's truth at the time
+// the sim generated it. Per run it prints:
+// - samples_per_sec, and sim_seconds / speedup: how much device time went by,
+//   and how much faster than real time that is.
+// - mismatches, lost, resyncs and discarded_bytes - all should be zero, and
+//   the exit status is non-zero if they aren't.
+// - time_error_ns: worst distance between the clock model's estimated sample
+//   time and when the sim actually generated the sample.
+//
+// usage: bench_virtual_time [samples]
+
+#include "driver.h"
+#include "gyro_xyz.h"
+#include "loopback_interface.h"
+#include "sim.h"
+#include "truth_source.h"
+#include "virtual_interface.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+const size_t POP_BATCH = 256;
+
+// checks samples against what the sim should have sent
+class Checker {
+public:
+  Checker(int64_t first_time_ns, int64_t period_ns)
+      : samples_(0), mismatches_(0), lost_(0), max_time_error_ns_(0),
+        first_time_ns_(first_time_ns), period_ns_(period_ns),
+        first_sequence_(0){};
+
+  void check(const TimedSample_t &sample) {
+    if (samples_ == 0) {
+      first_sequence_ = sample.sequence;
+    }
+    // the sample counter starts wherever manual mode left it
+    int64_t expected_ns =
+        first_time_ns_ + (sample.sequence - first_sequence_) * period_ns_;
+    auto truth = truth_.at(expected_ns);
+    if (sample.sequence != first_sequence_ + samples_ ||
+        sample.data.x_rate != truth.x_rate ||
+        sample.data.y_rate != truth.y_rate ||
+        sample.data.z_rate != truth.z_rate) {
+      mismatches_++;
+    }
+    lost_ += sample.lost;
+    max_time_error_ns_ =
+        std::max(max_time_error_ns_,
+                 std::abs((int64_t)sample.time_ns - expected_ns));
+    samples_++;
+  }
+
+  size_t samples_;
+  size_t mismatches_;
+  size_t lost_;
+  int64_t max_time_error_ns_;
+
+private:
+  int64_t first_time_ns_;
+  int64_t period_ns_;
+  uint64_t first_sequence_;
+  SineTruth truth_;
+};
+
+// Runs `samples` samples through in `mode`, returns whether they all checked
+// out
+static bool run(const char *name, uint8_t mode, uint8_t burst_samples,
+                bool streaming, size_t samples) {
+  LoopbackLink link;
+  SensorSim sim(link.second());
+  sim.setOutputRate(MAX_OUTPUT_RATE_HZ);
+  sim.init();
+  VirtualInterface port(link.first(), sim);
+  SensorDriver driver(port);
+  driver.init();
+  if (burst_samples > 0) {
+    driver.setBurst(burst_samples, false);
+  }
+
+  // the step that answers this generates the first sample
+  int64_t period_ns = std::llround(1e9 / MAX_OUTPUT_RATE_HZ);
+  int64_t start_sim_ns = sim.simTimeNs();
+  driver.setMode(mode);
+  Checker checker(sim.simTimeNs(), period_ns);
+
+  // the read that got the response may have decoded the first sample(s)
+  // already
+  TimedSample_t out[POP_BATCH];
+  size_t n = driver.popSamples(out, POP_BATCH);
+  for (size_t i = 0; i < n; i++) {
+    checker.check(out[i]);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  if (streaming) {
+    std::atomic<size_t> done(0);
+    driver.startStreaming([&](const TimedSample_t &sample) {
+      checker.check(sample);
+      done.store(checker.samples_, std::memory_order_release);
+    });
+    while (done.load(std::memory_order_acquire) < samples) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    driver.stopStreaming();
+  } else {
+    while (checker.samples_ < samples) {
+      driver.serviceInput();
+      n = driver.popSamples(out, POP_BATCH);
+      for (size_t i = 0; i < n; i++) {
+        checker.check(out[i]);
+      }
+    }
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  double sim_seconds = (sim.simTimeNs() - start_sim_ns) / 1e9;
+
+  auto metrics = driver.metrics();
+  driver.shutdown();
+  sim.shutdown();
+
+  std::cout << "{\"run\": \"" << name << "\", \"samples\": " << checker.samples_
+            << ", \"seconds\": " << elapsed
+            << ", \"samples_per_sec\": " << checker.samples_ / elapsed
+            << ", \"sim_seconds\": " << sim_seconds
+            << ", \"speedup\": " << sim_seconds / elapsed
+            << ", \"mismatches\": " << checker.mismatches_
+            << ", \"lost\": " << checker.lost_
+            << ", \"resyncs\": " << metrics.decoder.resyncs
+            << ", \"discarded_bytes\": " << metrics.decoder.discarded_bytes
+            << ", \"time_error_ns\": " << checker.max_time_error_ns_ << "}"
+            << std::endl;
+
+  return checker.mismatches_ == 0 && checker.lost_ == 0 &&
+         metrics.decoder.resyncs == 0 && metrics.decoder.discarded_bytes == 0;
+}
+
+int main(int argc, char *argv[]) {
+  size_t samples = argc > 1 ? std::atoll(argv[1]) : 10000000;
+
+  bool ok = run("auto", MODE_ARG_AUTO, 0, false, samples);
+  ok &= run("burst_16", MODE_ARG_BURST, 16, false, samples);
+  ok &= run("auto_streaming", MODE_ARG_AUTO, 0, true, samples);
+  return ok ? 0 : 1;
+}
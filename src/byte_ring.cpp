@@ -0,0 +1,43 @@
+#include "byte_ring.h"
+#include "byte_scan.h"
+#include <algorithm>
+#include <cstring>
+
+size_t ByteRing::write(const uint8_t *data, size_t len) {
+  len = std::min(len, space());
+
+  // the write may wrap around the end of the storage, so copy in (at most) two
+  // contiguous pieces
+  size_t start = tail_ & MASK;
+  size_t first = std::min(len, BYTE_RING_CAPACITY - start);
+  std::memcpy(&buf_[start], data, first);
+  std::memcpy(&buf_[0], data + first, len - first);
+
+  tail_ += len;
+  return len;
+}
+
+void ByteRing::copyOut(size_t offset, uint8_t *dst, size_t len) const {
+  size_t start = (head_ + offset) & MASK;
+  size_t first = std::min(len, BYTE_RING_CAPACITY - start);
+  std::memcpy(dst, &buf_[start], first);
+  std::memcpy(dst + first, &buf_[0], len - first);
+}
+
+size_t ByteRing::find(uint8_t byte, size_t from) const {
+  if (from >= size()) {
+    return size();
+  }
+
+  // same as `copyOut` - the stored bytes may wrap, so search (at most) two
+  // contiguous pieces
+  size_t len = size() - from;
+  size_t start = (head_ + from) & MASK;
+  size_t first = std::min(len, BYTE_RING_CAPACITY - start);
+
+  size_t found = findByte(&buf_[start], first, byte);
+  if (found < first) {
+    return from + found;
+  }
+  return from + first + findByte(&buf_[0], len - first, byte);
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// must be a power of two so indices can be wrapped with a mask
+const size_t BYTE_RING_CAPACITY = 4096;
+
+// fixed-capacity byte fifo used as the receive buffer for de-framing
+// bytes are appended at the tail as they come off the wire, and consumed from
+// the head as frames are decoded - so a partial frame at the end of a read just
+// waits in here for the rest of its bytes
+class ByteRing {
+public:
+  ByteRing() : head_(0), tail_(0){};
+
+  // number of bytes currently held
+  size_t size() const { return tail_ - head_; }
+
+  // number of bytes that can be written before the ring is full
+  size_t space() const { return BYTE_RING_CAPACITY - size(); }
+
+  bool empty() const { return head_ == tail_; }
+
+  // byte `offset` positions past the head - caller must check `size()`
+  uint8_t peek(size_t offset) const { return buf_[(head_ + offset) & MASK]; }
+
+  // Append up to `len` bytes from `data`, returns how many actually fit
+  size_t write(const uint8_t *data, size_t len);
+
+  // The largest contiguous chunk of free space, starting at the tail - lets a
+  // read go straight into the ring. Follow up with `commit()`.
+  std::span<uint8_t> writableSpan() {
+    size_t start = tail_ & MASK;
+    return std::span<uint8_t>(&buf_[start],
+                              std::min(space(), BYTE_RING_CAPACITY - start));
+  }
+
+  // Mark `len` bytes written into `writableSpan()` as part of the ring
+  void commit(size_t len) { tail_ += len; }
+
+  // Pointer to the `len` bytes starting `offset` past the head, if they sit in
+  // one piece in the storage - nullptr if they wrap (use `copyOut` then)
+  const uint8_t *contiguous(size_t offset, size_t len) const {
+    size_t start = (head_ + offset) & MASK;
+    return start + len <= BYTE_RING_CAPACITY ? &buf_[start] : nullptr;
+  }
+
+  // Offset (from the head) of the first `byte` at or after `from`, or `size()`
+  // if there isn't one
+  size_t find(uint8_t byte, size_t from) const;
+
+  // Copy `len` bytes starting `offset` past the head into `dst`
+  void copyOut(size_t offset, uint8_t *dst, size_t len) const;
+
+  // Drop `len` bytes from the head
+  void consume(size_t len) { head_ += len; }
+
+  void clear() { head_ = tail_ = 0; }
+
+private:
+  static const size_t MASK = BYTE_RING_CAPACITY - 1;
+  static_assert((BYTE_RING_CAPACITY & MASK) == 0,
+                "BYTE_RING_CAPACITY must be a power of two");
+
+  std::array<uint8_t, BYTE_RING_CAPACITY> buf_;
+
+  // free-running indices, only masked on access
+  size_t head_;
+  size_t tail_;
+};
@@ -0,0 +1,102 @@
+#include "byte_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BYTE_SCAN_X86
+#include <immintrin.h>
+#endif
+
+size_t findByteScalar(const uint8_t *data, size_t len, uint8_t byte) {
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] == byte) {
+      return i;
+    }
+  }
+  return len;
+}
+
+#ifdef BYTE_SCAN_X86
+
+// SSE2 is part of x86-64, so this needs no runtime check
+size_t findByteSse2(const uint8_t *data, size_t len, uint8_t byte) {
+  const __m128i needle = _mm_set1_epi8((char)byte);
+  size_t i = 0;
+
+  // compare 16 bytes at a time, the movemask has a bit set per match
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + findByteScalar(data + i, len - i, byte);
+}
+
+__attribute__((target("avx2"))) static size_t
+findByteAvx2Impl(const uint8_t *data, size_t len, uint8_t byte) {
+  const __m256i needle = _mm256_set1_epi8((char)byte);
+  size_t i = 0;
+
+  // two 32 byte compares per pass - most of a backlog has no delimiter in it
+  // at all, so it pays to test 64 bytes per branch
+  for (; i + 64 <= len; i += 64) {
+    __m256i lo =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    __m256i hi =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 32));
+    __m256i lo_eq = _mm256_cmpeq_epi8(lo, needle);
+    __m256i hi_eq = _mm256_cmpeq_epi8(hi, needle);
+    if (!_mm256_testz_si256(_mm256_or_si256(lo_eq, hi_eq),
+                            _mm256_or_si256(lo_eq, hi_eq))) {
+      uint64_t mask = (uint32_t)_mm256_movemask_epi8(lo_eq) |
+                      ((uint64_t)(uint32_t)_mm256_movemask_epi8(hi_eq) << 32);
+      return i + __builtin_ctzll(mask);
+    }
+  }
+  for (; i + 32 <= len; i += 32) {
+    __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + findByteSse2(data + i, len - i, byte);
+}
+
+bool haveAvx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+size_t findByteAvx2(const uint8_t *data, size_t len, uint8_t byte) {
+  if (!haveAvx2()) {
+    return findByteSse2(data, len, byte);
+  }
+  return findByteAvx2Impl(data, len, byte);
+}
+
+#else
+
+size_t findByteSse2(const uint8_t *data, size_t len, uint8_t byte) {
+  return findByteScalar(data, len, byte);
+}
+
+size_t findByteAvx2(const uint8_t *data, size_t len, uint8_t byte) {
+  return findByteScalar(data, len, byte);
+}
+
+bool haveAvx2() { return false; }
+
+#endif
+
+size_t findByte(const uint8_t *data, size_t len, uint8_t byte) {
+#ifdef BYTE_SCAN_X86
+  // not AVX2 - touching the ymm registers has a fixed cost per call (as much
+  // as ~175ns on some virtualized parts), more than a ring's worth of scan
+  // ever makes back (see byte_scan.h)
+  return findByteSse2(data, len, byte);
+#else
+  return findByteScalar(data, len, byte);
+#endif
+}
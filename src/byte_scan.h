@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// finding a byte value in a block of memory - used to jump straight to the
+// next delimiter when the decoders lose sync, rather than stepping through a
+// backlog one byte at a time
+//
+// `findByte` uses SSE2 on x86 (plain C++ elsewhere). The individual versions
+// are exposed for benchmarking; on non-x86 builds they all fall back to the
+// scalar one.
+//
+// AVX2 is there for bench_delim_scan only: everything `findByte` scans lives
+// in a `ByteRing`, so it's never longer than BYTE_RING_CAPACITY (4 KiB), and
+// AVX2 only catches SSE2 up at around 8 KiB - e.g. 9.5 vs 21 GB/s at 2 KiB,
+// 15 vs 24 GB/s at 4 KiB, 34 vs 29 GB/s at 8 KiB and 49 vs 30 GB/s at 16 KiB.
+
+// Returns the index of the first `byte` in `data[0, len)`, or `len` if there
+// isn't one
+size_t findByte(const uint8_t *data, size_t len, uint8_t byte);
+
+size_t findByteScalar(const uint8_t *data, size_t len, uint8_t byte);
+size_t findByteSse2(const uint8_t *data, size_t len, uint8_t byte);
+size_t findByteAvx2(const uint8_t *data, size_t len, uint8_t byte);
+
+// whether `findByteAvx2` actually uses AVX2 on this machine
+bool haveAvx2();
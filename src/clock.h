@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+#include <time.h>
+
+// CLOCK_MONOTONIC in nanoseconds - used for stamping samples as they come in
+inline uint64_t monotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
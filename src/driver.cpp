@@ -1,157 +1,773 @@
 #include "driver.h"
+#include "clock.h"
 #include "gyro_xyz.h"
+#include "logger.h"
 #include "message_coder.h"
+#include "register_map.h"
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <stdexcept>
 #include <unistd.h>
 #include <vector>
 
 SensorDriver::SensorDriver(IOInterface &interface)
-    : command_message_coder_(DELIM), response_message_coder_(DELIM),
-      data_response_message_coder_(DELIM), io_interface_(interface){};
+    : rx_ns_(0), tx_len_(0), command_message_coder_(DELIM),
+      decoder_(MessageCoder<ResponseRaw_t>(DELIM),
+               MessageCoder<DataResponseRaw_t>(DELIM)),
+      pending_(), next_handle_(0), streaming_(false), stop_reader_(false),
+      bus_(nullptr), io_interface_(interface){};
 
 SensorDriver::SensorDriver(MessageCoder<CommandRaw_t> command_coder,
                            MessageCoder<ResponseRaw_t> response_coder,
                            MessageCoder<DataResponseRaw_t> data_response_coder,
                            IOInterface &interface)
-    : command_message_coder_(command_coder),
-      response_message_coder_(response_coder),
-      data_response_message_coder_(data_response_coder),
+    : rx_ns_(0), tx_len_(0), command_message_coder_(command_coder),
+      decoder_(response_coder, data_response_coder), pending_(),
+      next_handle_(0), streaming_(false), stop_reader_(false), bus_(nullptr),
       io_interface_(interface){};
 
 void SensorDriver::init() { io_interface_.init(); }
-void SensorDriver::shutdown() { io_interface_.shutdown(); }
+void SensorDriver::shutdown() {
+  stopStreaming();
+  io_interface_.shutdown();
+}
 
-bool SensorDriver::isAlive() {
+bool SensorDriver::isAlive(std::chrono::milliseconds timeout) {
   // each of these functions behaves pretty similarly:
-  // 1. send command
-  // 2. look for, and consume, a response
-  // With a proper decoder this would be a little less dubious. e.g. what if
-  // between step 1.) and step 2.) we get sent an automated data message?
-  // Currently these two steps have to happen back-to-back to keep from losing
-  // sync.
-
-  sendCommand(VERSION_GET_REG);
-  auto data = receiveResponse(VERSION_GET_REG);
+  // 1. queue a command, getting back a handle for it
+  // 2. wait on the handle, which sends the command and consumes its response
+  // If an automated data message shows up between step 1.) and step 2.) the
+  // decoder just parks it on the data queue for `receiveDataResponse`.
+
+  auto data = waitResponse(getVersionAsync(timeout), timeout);
   if (data.data != 0) {
     return true;
   }
   return false;
 };
 
-uint8_t SensorDriver::getVersion() {
-  sendCommand(VERSION_GET_REG);
-  auto data = receiveResponse(VERSION_GET_REG);
-  return data.data;
+uint8_t SensorDriver::getVersion(std::chrono::milliseconds timeout) {
+  return waitResponse(getVersionAsync(timeout), timeout).data;
 };
 
-uint8_t SensorDriver::setMode(uint8_t mode) {
-  // io_interface_.flush();
-  sendCommand(MODE_SET_REG, mode);
-  auto data = receiveResponse(MODE_SET_REG);
-  return data.data;
+uint8_t SensorDriver::setMode(uint8_t mode,
+                              std::chrono::milliseconds timeout) {
+  return waitResponse(setModeAsync(mode, timeout), timeout).data;
 };
 
 // gets the mode the device is currently in
-uint8_t SensorDriver::getMode() {
-  sendCommand(MODE_GET_REG);
-  auto data = receiveResponse(MODE_GET_REG);
-  return data.data;
+uint8_t SensorDriver::getMode(std::chrono::milliseconds timeout) {
+  return waitResponse(getModeAsync(timeout), timeout).data;
+};
+
+uint8_t SensorDriver::setBurst(uint8_t samples, bool temperature,
+                              std::chrono::milliseconds timeout) {
+  return waitResponse(setBurstAsync(samples, temperature, timeout), timeout)
+      .data;
 };
 
 // get some number of rates
-std::vector<DataResponseRaw_t> SensorDriver::getRates() {
-  sendCommand(DATA_GET_REG);
-  auto data = receiveDataResponse();
-  return data;
+std::vector<DataResponseRaw_t>
+SensorDriver::getRates(std::chrono::milliseconds timeout) {
+  std::vector<DataResponseRaw_t> rates{
+      waitDataResponse(getRatesAsync(timeout), timeout)};
+
+  // along with everything else decoded by now, as it's always been
+  DataResponseRaw_t rest[DATA_RESPONSE_QUEUE_SIZE];
+  size_t n_rest = popSamples(rest, DATA_RESPONSE_QUEUE_SIZE);
+  rates.insert(rates.end(), rest, rest + n_rest);
+  return rates;
 };
 
+bool SensorDriver::writeRegister(uint8_t addr, uint8_t value,
+                                 std::chrono::milliseconds timeout) {
+  return waitResponse(writeRegisterAsync(addr, value, timeout), timeout).data ==
+         value;
+}
+
+uint8_t SensorDriver::sendRegisterRead(uint8_t addr,
+                                       std::chrono::milliseconds timeout) {
+  return waitResponse(readRegisterAsync(addr, timeout), timeout).data;
+}
+
+bool SensorDriver::writeRegisters(std::span<const RegisterWrite_t> writes,
+                                  std::chrono::milliseconds timeout) {
+  // checked up front, so a bad address doesn't leave half a configuration
+  // written
+  for (auto &write : writes) {
+    if (!isWritable(write.addr)) {
+      throw std::runtime_error("Register not writable");
+    }
+  }
+
+  std::vector<ResponseRaw_t> responses(writes.size());
+  auto deadline = deadlineAfter(timeout);
+  batchCommands(
+      writes.size(),
+      [&](size_t i) {
+        return submitPending(writes[i].addr, writes[i].value, writes[i].addr,
+                             deadline);
+      },
+      responses.data(), deadline);
+
+  bool as_written = true;
+  for (size_t i = 0; i < writes.size(); i++) {
+    as_written &= responses[i].data == writes[i].value;
+  }
+  return as_written;
+}
+
+void SensorDriver::readRegisters(std::span<const uint8_t> addrs,
+                                 std::span<uint8_t> values,
+                                 std::chrono::milliseconds timeout) {
+  if (values.size() < addrs.size()) {
+    throw std::runtime_error("Not enough room for register values");
+  }
+  for (auto addr : addrs) {
+    if (!isReadable(addr)) {
+      throw std::runtime_error("Register not readable");
+    }
+  }
+
+  // the response comes back as if from the register itself
+  std::vector<ResponseRaw_t> responses(addrs.size());
+  auto deadline = deadlineAfter(timeout);
+  batchCommands(
+      addrs.size(),
+      [&](size_t i) {
+        return submitPending(REG_READ_REG, addrs[i], addrs[i], deadline);
+      },
+      responses.data(), deadline);
+
+  for (size_t i = 0; i < addrs.size(); i++) {
+    values[i] = responses[i].data;
+  }
+}
+
+template <typename Submit>
+void SensorDriver::batchCommands(size_t n, Submit submit, ResponseRaw_t *out,
+                                 Deadline deadline) {
+  std::array<CommandHandle, MAX_PENDING_COMMANDS> handles;
+
+  for (size_t start = 0; start < n; start += MAX_PENDING_COMMANDS) {
+    size_t batch = std::min(MAX_PENDING_COMMANDS, n - start);
+    size_t submitted = 0;
+    size_t waited = 0;
+
+    try {
+      // all queued up in `tx_`, to go out together on the first wait
+      for (; submitted < batch; submitted++) {
+        handles[submitted] = submit(start + submitted);
+      }
+
+      // the responses come back together too, so once the first is in the
+      // rest are usually already decoded and these don't touch the port
+      while (waited < batch) {
+        PendingCommand *cmd;
+        {
+          std::lock_guard<std::mutex> lock(rx_mutex_);
+          cmd = &pendingFor(handles[waited]);
+        }
+        // counted before waiting - if it throws, `waitPending` has already
+        // abandoned it
+        waited++;
+        waitPending(*cmd, deadline);
+        out[start + waited - 1] = cmd->response;
+      }
+    } catch (...) {
+      // `waitPending` abandoned the one it threw on - abandon the rest too,
+      // their responses are just as likely to still turn up
+      std::lock_guard<std::mutex> lock(rx_mutex_);
+      for (size_t i = waited; i < submitted; i++) {
+        abandon(pending_[handles[i] % MAX_PENDING_COMMANDS]);
+      }
+      throw;
+    }
+  }
+}
+
+CommandHandle
+SensorDriver::getVersionAsync(std::chrono::milliseconds timeout) {
+  return submitCommand(VERSION_GET_REG, 0, timeout);
+}
+
+CommandHandle SensorDriver::setModeAsync(uint8_t mode,
+                                         std::chrono::milliseconds timeout) {
+  return submitCommand(MODE_SET_REG, mode, timeout);
+}
+
+CommandHandle SensorDriver::getModeAsync(std::chrono::milliseconds timeout) {
+  return submitCommand(MODE_GET_REG, 0, timeout);
+}
+
+CommandHandle SensorDriver::setBurstAsync(uint8_t samples, bool temperature,
+                                          std::chrono::milliseconds timeout) {
+  return submitCommand(BURST_CTRL_REG,
+                       (samples & BURST_CTRL_SAMPLES_MASK) |
+                           (temperature ? BURST_CTRL_TEMPERATURE : 0),
+                       timeout);
+}
+
+CommandHandle SensorDriver::getRatesAsync(std::chrono::milliseconds timeout) {
+  return submitCommand(DATA_GET_REG, 0, timeout);
+}
+
+CommandHandle
+SensorDriver::writeRegisterAsync(uint8_t addr, uint8_t value,
+                                 std::chrono::milliseconds timeout) {
+  if (!isWritable(addr)) {
+    throw std::runtime_error("Register not writable");
+  }
+  return submitCommand(addr, value, timeout);
+}
+
+CommandHandle
+SensorDriver::readRegisterAsync(uint8_t addr,
+                                std::chrono::milliseconds timeout) {
+  if (!isReadable(addr)) {
+    throw std::runtime_error("Register not readable");
+  }
+  // the response comes back as if from the register itself
+  return submitPending(REG_READ_REG, addr, addr, deadlineAfter(timeout));
+}
+
+CommandHandle SensorDriver::submitCommand(uint8_t cmd, uint8_t data,
+                                          std::chrono::milliseconds timeout) {
+  return submitPending(cmd, data, cmd, deadlineAfter(timeout));
+}
+
+CommandHandle SensorDriver::submitPending(uint8_t cmd, uint8_t data,
+                                          uint8_t response_addr,
+                                          Deadline deadline) {
+  // `tx_mutex_` keeps commands going into `tx_` in handle order, and is the
+  // only thing that moves `next_handle_` on, so the slot can't be taken out
+  // from under us between checking it and claiming it
+  std::lock_guard<std::mutex> tx_lock(tx_mutex_);
+
+  // handles are handed out in order, so the slot we're about to reuse belongs
+  // to the oldest command - if nobody has waited on it yet we're out of room
+  auto &pending = pending_[next_handle_ % MAX_PENDING_COMMANDS];
+  {
+    std::lock_guard<std::mutex> lock(rx_mutex_);
+    if (pending.in_flight && !pending.abandoned) {
+      throw std::runtime_error("Too many commands in flight");
+    }
+  }
+
+  // may write out what's already queued, so it's done outside `rx_mutex_`
+  queueCommand(cmd, data, deadline);
+
+  std::lock_guard<std::mutex> lock(rx_mutex_);
+  if (pending.in_flight) {
+    // a whole round of handles later and still nothing - that response isn't
+    // coming
+    logger().text(LogLevel::Info, "Gave up on an abandoned command");
+  }
+  pending = PendingCommand{.handle = next_handle_,
+                           .addr = response_addr,
+                           .in_flight = true,
+                           .done = false,
+                           .abandoned = false,
+                           .submit_ns = monotonicNanos(),
+                           .response = {},
+                           .data_response = {}};
+
+  // samples from here on may come at a different rate (or not at all), so
+  // the clock model's fit is no good anymore
+  if (cmd == MODE_SET_REG) {
+    decoder_.resetClock();
+  }
+  return next_handle_++;
+}
+
+void SensorDriver::flushCommands(std::chrono::milliseconds timeout) {
+  flushTx(deadlineAfter(timeout));
+}
+
+void SensorDriver::flushTx(Deadline deadline) {
+  std::lock_guard<std::mutex> lock(tx_mutex_);
+  writeTx(deadline);
+}
+
+void SensorDriver::writeTx(Deadline deadline) {
+  if (tx_len_ == 0) {
+    return;
+  }
+
+  auto status = io_interface_.send(
+      std::span<const uint8_t>(tx_.data(), tx_len_), deadline);
+  tx_len_ = 0;
+
+  if (status == IOStatus::Timeout) {
+    throw TimeoutError("Timed out sending commands");
+  } else if (status == IOStatus::Closed) {
+    throw std::runtime_error("Failed to send commands");
+  }
+}
+
+bool SensorDriver::isComplete(CommandHandle handle) {
+  std::lock_guard<std::mutex> lock(rx_mutex_);
+  return pendingFor(handle).done;
+}
+
+ResponseRaw_t SensorDriver::waitResponse(CommandHandle handle,
+                                         std::chrono::milliseconds timeout) {
+  PendingCommand *cmd;
+  {
+    std::lock_guard<std::mutex> lock(rx_mutex_);
+    cmd = &pendingFor(handle);
+    if (cmd->addr == DATA_GET_REG) {
+      throw std::runtime_error("Data handles go to waitDataResponse");
+    }
+  }
+  waitPending(*cmd, deadlineAfter(timeout));
+  return cmd->response;
+}
+
+DataResponseRaw_t
+SensorDriver::waitDataResponse(CommandHandle handle,
+                               std::chrono::milliseconds timeout) {
+  PendingCommand *cmd;
+  {
+    std::lock_guard<std::mutex> lock(rx_mutex_);
+    cmd = &pendingFor(handle);
+    if (cmd->addr != DATA_GET_REG) {
+      throw std::runtime_error("Not a data handle - use waitResponse");
+    }
+  }
+  waitPending(*cmd, deadlineAfter(timeout));
+  return cmd->data_response;
+}
+
 void SensorDriver::sendCommand(uint8_t cmd) {
   sendCommand(cmd, 0);
   return;
 }
 
-void SensorDriver::sendCommand(uint8_t cmd, uint8_t data) {
-  auto cmdRaw = CommandRaw_t{.addr = cmd, .data = data, .delim = DELIM};
-  io_interface_.send(command_message_coder_.frame(cmdRaw));
+void SensorDriver::sendCommand(uint8_t cmd, uint8_t data,
+                               std::chrono::milliseconds timeout) {
+  // goes out behind anything already queued, to keep responses in order
+  auto deadline = deadlineAfter(timeout);
+  std::lock_guard<std::mutex> lock(tx_mutex_);
+  queueCommand(cmd, data, deadline);
+  writeTx(deadline);
 };
 
-ResponseRaw_t SensorDriver::receiveResponse(uint8_t reg) {
-  // this function and the next are hacked together in such a way as to handle
-  // the issue mentioned above (having an automated data messages sneak in
-  // before the desired response).
-  //
-  // The mitigation for this is to look for the response type we're interested
-  // in (ResponseRaw_t here, and DataResponseRaw_t in the following fcn) - then
-  // deframe that, and discard everything else in the input buffer. There are
-  // better ways that don't drop data, but I was thinking they'd be more error
-  // prone.
-  //
-  // There is also a hard-coded retry limit, as a very crude response timeout
+void SensorDriver::queueCommand(uint8_t cmd, uint8_t data, Deadline deadline) {
+  if (tx_len_ + sizeof(CommandRaw_t) > tx_.size()) {
+    writeTx(deadline);
+  }
+  auto cmdRaw = CommandRaw_t{.addr = cmd, .data = data, .delim = DELIM};
+  logger().frame(LogLevel::Debug, cmdRaw);
+  tx_len_ += command_message_coder_.frame(
+      cmdRaw, std::span<uint8_t>(tx_).subspan(tx_len_));
+  commands_sent_.add();
+}
+
+PendingCommand &SensorDriver::pendingFor(CommandHandle handle) {
+  auto &cmd = pending_[handle % MAX_PENDING_COMMANDS];
+  if (!cmd.in_flight || cmd.abandoned || cmd.handle != handle) {
+    throw std::runtime_error("Unknown command handle");
+  }
+  return cmd;
+}
+
+PendingCommand *SensorDriver::oldestPending(uint8_t addr) {
+  // walk the slots oldest handle first, so repeated commands to the same
+  // register get their responses in the order they were sent
+  for (CommandHandle handle = next_handle_ - MAX_PENDING_COMMANDS;
+       handle != next_handle_; handle++) {
+    auto &cmd = pending_[handle % MAX_PENDING_COMMANDS];
+    if (cmd.in_flight && !cmd.done && cmd.handle == handle &&
+        cmd.addr == addr) {
+      return &cmd;
+    }
+  }
+  return nullptr;
+}
+
+void SensorDriver::settle() {
+  // only read the clock if something actually completes
+  uint64_t now_ns = 0;
+  auto complete = [this, &now_ns](PendingCommand &cmd) {
+    cmd.done = true;
+    if (cmd.abandoned) {
+      // nobody's waiting on it anymore, it was only holding the slot so this
+      // response didn't go to the wrong command
+      cmd.in_flight = false;
+      cmd.abandoned = false;
+      return;
+    }
+    if (now_ns == 0) {
+      now_ns = monotonicNanos();
+    }
+    round_trip_ns_.record(now_ns - cmd.submit_ns);
+  };
 
-  size_t bytes_avail;
-  std::vector<ResponseRaw_t> resps;
-  size_t count = 0;
+  ResponseRaw_t resp;
+  while (decoder_.responses().pop(resp)) {
+    auto cmd = oldestPending(resp.addr);
+    if (cmd) {
+      cmd->response = resp;
+      complete(*cmd);
+    } else {
+      unclaimed_count_.add();
+      unclaimed_responses_.pushOverwrite(resp);
+    }
+  }
 
-  while (resps.empty() && count < RESPONSE_RECEIVE_RETRY_LIMIT) {
-    // Set the number of bytes to attempt retrieving to the larger of a.) how
-    // many are in the buffer, or b.) the minimum frame size for this message
-    // type
-    //
-    // If b.), then the call to `retrieve` will block.
-    bytes_avail = std::max((size_t)io_interface_.availableBytes(),
-                           response_message_coder_.getFrameLength());
+  // data frames go to anyone waiting on a DATA_GET_REG first, the rest are
+  // left on the data queue as samples
+  PendingCommand *cmd;
+  TimedSample_t sample;
+  while (!decoder_.dataResponses().empty() &&
+         (cmd = oldestPending(DATA_GET_REG))) {
+    decoder_.dataResponses().pop(sample);
+    cmd->data_response = sample.data;
+    complete(*cmd);
+  }
+}
 
-    auto data = io_interface_.receive(bytes_avail);
+void SensorDriver::waitPending(PendingCommand &cmd, Deadline deadline) {
+  bool done = false;
 
-    // append received bytes to an internal buffer, which is used in case we get
-    // a partial message
-    rx_.insert(rx_.end(), data.begin(), data.end());
+  try {
+    flushTx(deadline);
 
-    // Parse stream of bytes into a set of de-framed messages.
-    // Note: `deFrame` consumes `rx_` in the process.
-    resps = response_message_coder_.deFrame(rx_);
+    if (isStreaming()) {
+      // the reader thread is the one pulling bytes, so just wait on it
+      std::unique_lock<std::mutex> lock(rx_mutex_);
+      rx_cv_.wait_until(lock, deadline, [this, &cmd] {
+        return cmd.done || !isStreaming();
+      });
+      done = cmd.done;
+    }
+    if (!done && !isStreaming()) {
+      // including if the reader stopped (or the port closed) while we were
+      // waiting on it - pumping is where a closed port gets reported
+      while (!cmd.done && std::chrono::steady_clock::now() < deadline) {
+        pump(deadline);
+      }
+      done = cmd.done;
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(rx_mutex_);
+    abandon(cmd);
+    throw;
+  }
 
-    count++;
+  std::lock_guard<std::mutex> lock(rx_mutex_);
+  if (!done) {
+    abandon(cmd);
+    timeouts_.add();
+    throw TimeoutError("Timed out waiting for response");
   }
+  cmd.in_flight = false;
+}
 
-  // Crude hack here: even if we got multiple valid responses, just return the
-  // first one. In the real world we'd have better message ids, and we'd look
-  // for the one that matches the command we sent.
-  for (auto &resp : resps) {
-    if (resp.addr == reg) {
-      return resp;
+void SensorDriver::abandon(PendingCommand &cmd) {
+  if (cmd.done) {
+    cmd.in_flight = false;
+  } else {
+    cmd.abandoned = true;
+  }
+}
+
+ResponseRaw_t SensorDriver::receiveResponse(uint8_t reg,
+                                            std::chrono::milliseconds timeout) {
+  // Responses and data share the one input stream - `decoder_` sorts them
+  // onto separate queues, so here we only ever look at the response queue and
+  // any data that arrives in the meantime is left for `receiveDataResponse`.
+  // Responses that a pending command is waiting on never make it here.
+
+  ResponseRaw_t resp;
+  auto deadline = deadlineAfter(timeout);
+
+  if (isStreaming()) {
+    // the reader thread is the one pulling bytes, so just wait on it - until
+    // it stops, and leaves the port to the loop below
+    std::unique_lock<std::mutex> lock(rx_mutex_);
+    while (isStreaming()) {
+      while (unclaimed_responses_.pop(resp)) {
+        if (resp.addr == reg) {
+          return resp;
+        }
+      }
+      receive_retries_.add();
+      if (rx_cv_.wait_until(lock, deadline) == std::cv_status::timeout) {
+        timeouts_.add();
+        throw TimeoutError("Could not find message for reg in responses.");
+      }
     }
   }
 
-  throw std::runtime_error("Could not find message for reg in responses.");
+  while (true) {
+    // In the real world we'd have better message ids - for now the first
+    // response for the register we asked about is the one we want. Responses
+    // for other registers are stale (nobody is waiting on them) and dropped.
+    while (unclaimed_responses_.pop(resp)) {
+      if (resp.addr == reg) {
+        return resp;
+      }
+    }
+
+    if (std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
+
+    receive_retries_.add();
+    pump(deadline);
+  }
+
+  timeouts_.add();
+  throw TimeoutError("Could not find message for reg in responses.");
 };
 
-std::vector<DataResponseRaw_t> SensorDriver::receiveDataResponse() {
+std::vector<DataResponseRaw_t>
+SensorDriver::receiveDataResponse(std::chrono::milliseconds timeout) {
+  DataResponseRaw_t resps[DATA_RESPONSE_QUEUE_SIZE];
+  size_t n_resps =
+      receiveDataResponse(resps, DATA_RESPONSE_QUEUE_SIZE, timeout);
+  return std::vector<DataResponseRaw_t>(resps, resps + n_resps);
+};
+
+size_t SensorDriver::receiveDataResponse(DataResponseRaw_t *out,
+                                         size_t max_responses,
+                                         std::chrono::milliseconds timeout) {
   // Similar function as above, but instead for DataResponseRaw_t's
   // This is used for both a request-response in `getRates()` as well as the
   // primary method to get multiple rates when the sensor is in auto mode.
+  // Any responses that arrive in the meantime stay on the response queue.
+
+  auto deadline = deadlineAfter(timeout);
 
-  size_t bytes_avail;
-  std::vector<DataResponseRaw_t> resps;
-  size_t count = 0;
+  if (isStreaming()) {
+    // samples are coming in through the reader thread, wait for some (or for
+    // it to stop, and leave the port to us)
+    std::unique_lock<std::mutex> lock(rx_mutex_);
+    rx_cv_.wait_until(lock, deadline, [this] {
+      return !samples_.empty() || !isStreaming();
+    });
+  }
+  if (!isStreaming()) {
+    while (samples_.empty() && decoder_.dataResponses().empty() &&
+           std::chrono::steady_clock::now() < deadline) {
+      pump(deadline);
+    }
+  }
 
-  while (resps.empty() && count < RESPONSE_RECEIVE_RETRY_LIMIT) {
-    bytes_avail = std::max((size_t)io_interface_.availableBytes(),
-                           data_response_message_coder_.getFrameLength());
+  size_t n_resps = popSamples(out, max_responses);
+  if (n_resps < 1) {
+    timeouts_.add();
+    throw TimeoutError("Didn't receive any data responses!");
+  }
+
+  return n_resps;
+};
+
+void SensorDriver::startStreaming(OverflowPolicy policy) {
+  launchReader(policy, nullptr);
+}
 
-    auto data = io_interface_.receive(bytes_avail);
+void SensorDriver::startStreaming(SampleCallback callback) {
+  launchReader(OverflowPolicy::DropOldest,
+               [callback](const TimedSample_t &sample) {
+                 callback(sample.data);
+               });
+}
 
-    rx_.insert(rx_.end(), data.begin(), data.end());
+void SensorDriver::startStreaming(TimedSampleCallback callback) {
+  launchReader(OverflowPolicy::DropOldest, callback);
+}
 
-    resps = data_response_message_coder_.deFrame(rx_);
+void SensorDriver::startPublishing(SampleBusWriter &bus) {
+  if (reader_.joinable()) {
+    throw std::runtime_error("Already streaming");
+  }
+  bus_ = &bus;
+  launchReader(OverflowPolicy::DropOldest, nullptr);
+}
 
-    count++;
+void SensorDriver::launchReader(OverflowPolicy policy,
+                                TimedSampleCallback callback) {
+  if (reader_.joinable()) {
+    throw std::runtime_error("Already streaming");
   }
 
-  if (resps.size() < 1) {
-    throw std::runtime_error("Didn't receive any data responses!");
+  samples_.setPolicy(policy);
+  sample_callback_ = callback;
+
+  // anything decoded before we started is still the consumer's
+  TimedSample_t sample;
+  while (decoder_.dataResponses().pop(sample)) {
+    if (bus_) {
+      bus_->publish(sample);
+    } else {
+      samples_.push(sample);
+    }
   }
 
-  return resps;
-};
+  stop_reader_.store(false, std::memory_order_release);
+  streaming_.store(true, std::memory_order_release);
+  reader_ = std::thread(&SensorDriver::readerLoop, this);
+}
+
+void SensorDriver::stopStreaming() {
+  // the reader may have already stopped itself if the port closed
+  if (!reader_.joinable()) {
+    return;
+  }
+  stop_reader_.store(true, std::memory_order_release);
+  reader_.join();
+  sample_callback_ = nullptr;
+  bus_ = nullptr;
+}
+
+size_t SensorDriver::popSamples(DataResponseRaw_t *out, size_t max_samples) {
+  return popSamplesAs(out, max_samples);
+}
+
+size_t SensorDriver::popSamples(TimedSample_t *out, size_t max_samples) {
+  return popSamplesAs(out, max_samples);
+}
+
+static void assignSample(DataResponseRaw_t &out, const TimedSample_t &sample) {
+  out = sample.data;
+}
+static void assignSample(TimedSample_t &out, const TimedSample_t &sample) {
+  out = sample;
+}
+
+template <typename T>
+size_t SensorDriver::popSamplesAs(T *out, size_t max_samples) {
+  TimedSample_t sample;
+  size_t n_samples = 0;
+
+  // whatever the reader queued came in before anything still in the decoder,
+  // and is still the consumer's once streaming stops
+  while (n_samples < max_samples && samples_.pop(sample)) {
+    assignSample(out[n_samples++], sample);
+  }
+  if (isStreaming()) {
+    return n_samples;
+  }
+
+  std::lock_guard<std::mutex> lock(rx_mutex_);
+  while (n_samples < max_samples && decoder_.dataResponses().pop(sample)) {
+    assignSample(out[n_samples++], sample);
+  }
+  return n_samples;
+}
+
+size_t SensorDriver::serviceInput() {
+  if (isStreaming()) {
+    throw std::runtime_error("Port is owned by the streaming reader");
+  }
+  // a deadline of now only takes what's already there
+  return pump(std::chrono::steady_clock::now());
+}
+
+void SensorDriver::readerLoop() {
+  // this thread is the only thing reading the port (and touching `rx_`)
+  // until `stopStreaming()` - it wakes up periodically so it notices that
+  TimedSample_t sample;
+
+  while (!stop_reader_.load(std::memory_order_acquire)) {
+    if (!io_interface_.waitReadable(READER_POLL_INTERVAL_MS)) {
+      continue;
+    }
+    if (fillRx(std::chrono::steady_clock::now()) == IOStatus::Closed) {
+      // nothing more is coming - bail, and let anyone waiting fall back to
+      // reading the port themselves (where they'll get the error)
+      break;
+    }
+
+    size_t n_frames;
+    {
+      std::lock_guard<std::mutex> lock(rx_mutex_);
+      n_frames = decodeRx();
+    }
+
+    // the data queue is only ever touched by this thread while streaming, so
+    // it can be drained outside the lock
+    while (decoder_.dataResponses().pop(sample)) {
+      if (bus_) {
+        bus_->publish(sample);
+      } else if (sample_callback_) {
+        sample_callback_(sample);
+      } else {
+        samples_.push(sample);
+      }
+    }
+
+    if (n_frames > 0) {
+      // bounce off the lock so a waiter that just checked its queue is
+      // guaranteed to be waiting by the time we notify
+      { std::lock_guard<std::mutex> lock(rx_mutex_); }
+      rx_cv_.notify_all();
+    }
+  }
+
+  // hand the port back - under the lock, so anyone waiting on us either sees
+  // it before they wait or is woken by the notify
+  {
+    std::lock_guard<std::mutex> lock(rx_mutex_);
+    streaming_.store(false, std::memory_order_release);
+  }
+  rx_cv_.notify_all();
+}
+
+size_t SensorDriver::pump(Deadline deadline) {
+  if (fillRx(deadline) == IOStatus::Closed) {
+    throw std::runtime_error("Port closed");
+  }
+
+  std::lock_guard<std::mutex> lock(rx_mutex_);
+  return decodeRx();
+}
+
+size_t SensorDriver::decodeRx() {
+  // anything completed in `rx_` was completed by the last read
+  size_t n_frames = decoder_.decode(rx_, rx_ns_);
+  settle();
+  return n_frames;
+}
+
+IOStatus SensorDriver::fillRx(Deadline deadline) {
+  // read straight into the ring's free space - if that wraps we only fill up
+  // to the end of the storage this time around, the rest comes next pass
+  auto result = io_interface_.receiveInto(rx_.writableSpan(), deadline);
+  if (result.bytes > 0) {
+    // stamped as close to the read as we can get, for the sample clock
+    rx_ns_ = io_interface_.receiveClockNs();
+    rx_.commit(result.bytes);
+  }
+  return result.status;
+}
+
+DriverMetrics_t SensorDriver::metrics() const {
+  return DriverMetrics_t{.commands_sent = commands_sent_.value(),
+                         .timeouts = timeouts_.value(),
+                         .receive_retries = receive_retries_.value(),
+                         .unclaimed_responses = unclaimed_count_.value(),
+                         .sample_overflows = samples_.overflows(),
+                         .round_trip_ns = round_trip_ns_.snapshot(),
+                         .decoder = decoder_.metrics(),
+                         .io = io_interface_.metrics()};
+}
+
+void writeJson(std::ostream &os, const DriverMetrics_t &metrics) {
+  os << "{\"commands_sent\": " << metrics.commands_sent
+     << ", \"timeouts\": " << metrics.timeouts
+     << ", \"receive_retries\": " << metrics.receive_retries
+     << ", \"unclaimed_responses\": " << metrics.unclaimed_responses
+     << ", \"sample_overflows\": " << metrics.sample_overflows
+     << ", \"round_trip_ns\": ";
+  writeJson(os, metrics.round_trip_ns);
+  os << ", \"decoder\": ";
+  writeJson(os, metrics.decoder);
+  os << ", \"io\": ";
+  writeJson(os, metrics.io);
+  os << "}";
+}
@@ -1,12 +1,89 @@
 #pragma once
+#include "byte_ring.h"
+#include "frame_decoder.h"
 #include "io_interface.h"
 #include "message_coder.h"
+#include "metrics.h"
+#include "sample_bus.h"
+#include "sample_clock.h"
+#include "spsc_queue.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <deque>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <ostream>
 #include <string>
+#include <thread>
 #include <vector>
 
-const size_t RESPONSE_RECEIVE_RETRY_LIMIT = 5;
+// how long a driver call waits for its response unless told otherwise
+const std::chrono::milliseconds DEFAULT_RESPONSE_TIMEOUT(500);
+
+// number of samples the streaming reader can buffer ahead of the consumer
+const size_t SAMPLE_QUEUE_SIZE = 1024;
+
+// how often the streaming reader wakes up to check whether it should stop
+const int READER_POLL_INTERVAL_MS = 50;
+
+// most commands that can be in flight (issued but not yet waited on) at once
+const size_t MAX_PENDING_COMMANDS = 32;
+static_assert(RESPONSE_QUEUE_SIZE >= MAX_PENDING_COMMANDS,
+              "responses to a full batch of commands have to fit the decoder");
+
+// identifies an issued command, returned by the `...Async` calls
+typedef uint32_t CommandHandle;
+
+// bookkeeping for an issued command - filled in when its response arrives
+struct PendingCommand {
+  CommandHandle handle;
+  uint8_t addr;
+  bool in_flight;
+  bool done;
+  // given up on by the caller, but its response may still be on the way - the
+  // slot stays in flight to soak it up, so it isn't handed to the next
+  // command on the same register
+  bool abandoned;
+  uint64_t submit_ns; // monotonicNanos() when it was submitted
+  ResponseRaw_t response;
+  DataResponseRaw_t data_response;
+};
+
+// one write for `SensorDriver::writeRegisters`
+struct RegisterWrite {
+  uint8_t addr;
+  uint8_t value;
+} typedef RegisterWrite_t;
+
+// see `SensorDriver::metrics()`
+struct DriverMetrics {
+  uint64_t commands_sent;
+  uint64_t timeouts;            // calls that gave up waiting on the device
+  // times `receiveResponse` looked, didn't find its response yet, and went
+  // back to the port (or the reader) for more
+  uint64_t receive_retries;
+  uint64_t unclaimed_responses; // responses no pending command was after
+  uint64_t sample_overflows;    // samples the consumer fell too far behind on
+  // submit to response, for commands waited on through a handle
+  HistogramSnapshot_t round_trip_ns;
+  DecoderMetrics_t decoder;
+  IOMetrics_t io;
+} typedef DriverMetrics_t;
+
+// Writes `metrics` as a JSON object
+void writeJson(std::ostream &os, const DriverMetrics_t &metrics);
+
+// called on the reader thread for each sample, in place of queuing it
+// the reader can't service responses while this runs, so it shouldn't block
+// (or issue commands)
+typedef std::function<void(const DataResponseRaw_t &)> SampleCallback;
+
+// same, with the sample's receive time, estimated sample time and sequence
+typedef std::function<void(const TimedSample_t &)> TimedSampleCallback;
 
 // top-level driver class
 class SensorDriver {
@@ -18,46 +95,287 @@ public:
                IOInterface &interface);
 
   ~SensorDriver() { shutdown(); };
+  SensorDriver(const SensorDriver &) = delete;
+  SensorDriver &operator=(const SensorDriver &) = delete;
   void init();
   void shutdown();
 
+  // Every call that talks to the device takes a `timeout` bounding how long it
+  // can take end to end, and throws TimeoutError if it runs out.
+
   // check whether the device is responsive
   // i.e. sends a NOOP
-  bool isAlive();
+  bool isAlive(std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
 
   // gets the device's version information
-  uint8_t getVersion();
+  uint8_t
+  getVersion(std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
 
-  // NOT IMPLEMENTED: generic register writing
-  bool writeRegister(uint8_t addr, uint8_t value);
+  // Generic register access, for any register in the map (register_map.h).
+  // Writes return whether the register took the value as written - ones with
+  // side effects may apply something else instead (e.g. BURST_CTRL_REG
+  // clamps). Throws std::runtime_error for a register that can't be written
+  // (or read) before sending anything.
+  bool
+  writeRegister(uint8_t addr, uint8_t value,
+                std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+  uint8_t
+  sendRegisterRead(uint8_t addr,
+                   std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
 
-  // NOT IMPLEMENTED: generic register reading
-  uint8_t sendRegisterRead(uint8_t addr);
+  // Batched versions of the above: every command goes out in one write, and
+  // the responses are collected in one pass as they come back - so
+  // configuring dozens of registers costs one round trip rather than dozens.
+  // (Batches of more than MAX_PENDING_COMMANDS take one round trip per that
+  // many.) `values` gets the value read from each of `addrs`, in order.
+  bool
+  writeRegisters(std::span<const RegisterWrite_t> writes,
+                 std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+  void
+  readRegisters(std::span<const uint8_t> addrs, std::span<uint8_t> values,
+                std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
 
   // sets the device to be in `mode`
-  uint8_t setMode(uint8_t mode);
+  uint8_t setMode(uint8_t mode,
+                  std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
 
   // gets the mode the device is currently in
-  uint8_t getMode();
+  uint8_t getMode(std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+
+  // configures the frames MODE_ARG_BURST sends: `samples` per frame, plus the
+  // temperature if `temperature`. Returns the BURST_CTRL_REG value the device
+  // actually applied. Burst samples come out of `popSamples` etc. one by one,
+  // same as in auto mode.
+  uint8_t setBurst(uint8_t samples, bool temperature,
+                   std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
 
   // get some number of rates
-  std::vector<DataResponseRaw_t> getRates();
+  std::vector<DataResponseRaw_t>
+  getRates(std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+
+  // Pipelined versions of the above: each queues its command and returns
+  // straight away. Queued commands all go out in one write the first time
+  // something is waited on (or on `flushCommands()`), and responses are
+  // matched back to commands by register address, oldest first - so e.g.
+  // getModeAsync + getVersionAsync + getRatesAsync costs one round trip.
+  // `timeout` only comes into it if the queue is already full, and has to be
+  // written out first to make room.
+  CommandHandle
+  getVersionAsync(std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+  CommandHandle
+  setModeAsync(uint8_t mode,
+               std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+  CommandHandle
+  getModeAsync(std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+  CommandHandle
+  setBurstAsync(uint8_t samples, bool temperature,
+                std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+  CommandHandle
+  getRatesAsync(std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+  CommandHandle writeRegisterAsync(
+      uint8_t addr, uint8_t value,
+      std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+  CommandHandle readRegisterAsync(
+      uint8_t addr,
+      std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+
+  // generalized pipelined command - `cmd`'s response is claimed by the handle
+  CommandHandle
+  submitCommand(uint8_t cmd, uint8_t data = 0,
+                std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+
+  // write out any queued commands
+  void
+  flushCommands(std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+
+  // whether the response for `handle` has arrived yet (doesn't read the port)
+  bool isComplete(CommandHandle handle);
+
+  // block until the response for `handle` arrives and return it. The handle
+  // is released either way, so each one can only be waited on once. Data
+  // handles (from `getRatesAsync`) go to `waitDataResponse`, and everything
+  // else to `waitResponse` - the wrong one throws, leaving the handle be.
+  ResponseRaw_t
+  waitResponse(CommandHandle handle,
+               std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+  DataResponseRaw_t
+  waitDataResponse(CommandHandle handle,
+                   std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
 
-  // generalized sending of commands
-  void sendCommand(uint8_t cmd, uint8_t data);
+  // generalized sending of commands - not tracked, so the response shows up on
+  // `receiveResponse` / `receiveDataResponse`
+  void sendCommand(uint8_t cmd, uint8_t data,
+                   std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
   void sendCommand(uint8_t cmd);
 
-  // generalized receiving of responses
-  ResponseRaw_t receiveResponse(uint8_t reg);
+  // generalized receiving of responses not claimed by a pending command
+  ResponseRaw_t
+  receiveResponse(uint8_t reg,
+                  std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
 
   // generalized receiving of data
-  std::vector<DataResponseRaw_t> receiveDataResponse();
+  std::vector<DataResponseRaw_t> receiveDataResponse(
+      std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+
+  // same as above, but decodes straight into `out` (up to `max_responses`)
+  // and returns how many were written
+  size_t receiveDataResponse(
+      DataResponseRaw_t *out, size_t max_responses,
+      std::chrono::milliseconds timeout = DEFAULT_RESPONSE_TIMEOUT);
+
+  // Streaming: start a reader thread that owns the port and decodes data as
+  // it arrives. Samples go onto a lock-free queue for `popSample`, or to
+  // `callback` if one is given. Commands/responses keep working meanwhile.
+  void startStreaming(OverflowPolicy policy = OverflowPolicy::DropOldest);
+  void startStreaming(SampleCallback callback);
+  void startStreaming(TimedSampleCallback callback);
+  void stopStreaming();
+
+  // Publisher mode: stream, but put every sample on `bus` (which has to be
+  // `init()`'d, and outlive the streaming) instead of the local queue - for
+  // sharing one port's samples with other processes, each reading the bus
+  // with a `SampleBusReader`. Stopped with `stopStreaming()`, and commands
+  // keep working meanwhile, same as any other streaming.
+  void startPublishing(SampleBusWriter &bus);
+
+  bool isStreaming() const {
+    return streaming_.load(std::memory_order_acquire);
+  };
+
+  // consumer side of the sample queue - never blocks
+  // when not streaming, these return whatever the reader left queued when it
+  // stopped, then whatever `serviceInput` (or any other call that read the
+  // port) has decoded so far
+  // every sample is timestamped on the way in (see `SampleClock`) - the
+  // `TimedSample_t` versions hand that out along with the data
+  bool popSample(DataResponseRaw_t &sample) {
+    return popSamples(&sample, 1) == 1;
+  };
+  bool popSample(TimedSample_t &sample) { return popSamples(&sample, 1) == 1; };
+  size_t popSamples(DataResponseRaw_t *out, size_t max_samples);
+  size_t popSamples(TimedSample_t *out, size_t max_samples);
+
+  // Non-blocking: read whatever is waiting on the port and decode it. Meant
+  // for driving the port from someone else's event loop (see SensorManager)
+  // rather than from the streaming reader. Returns the number of frames
+  // decoded.
+  size_t serviceInput();
+
+  // the underlying port, for readiness polling
+  int fd() const { return io_interface_.fd(); };
+
+  // samples dropped because the consumer fell behind
+  size_t sampleOverflows() const { return samples_.overflows(); };
+  OverflowPolicy overflowPolicy() const { return samples_.policy(); };
+
+  // Snapshot of the driver's counters and round-trip latencies (plus its
+  // decoder's and port's). Everything behind it is a relaxed atomic, so this
+  // is safe to call from any thread - e.g. a monitoring one - while the
+  // driver is busy, and costs the hot path nothing but the increments.
+  DriverMetrics_t metrics() const;
 
 private:
-  std::vector<uint8_t> rx_;
+  // pull whatever is available off the io into `rx_`, waiting until
+  // `deadline` for the first byte if there isn't anything yet
+  IOStatus fillRx(Deadline deadline);
+
+  // decode `rx_` and hand out responses - requires `rx_mutex_`
+  size_t decodeRx();
+
+  // pull bytes off the io and decode them onto `decoder_`'s queues, returns
+  // the number of frames decoded
+  size_t pump(Deadline deadline);
+
+  // write out `tx_`
+  void flushTx(Deadline deadline);
+
+  // `flushTx` - requires `tx_mutex_`
+  void writeTx(Deadline deadline);
+
+  // hand decoded responses out to pending commands - requires `rx_mutex_`
+  void settle();
+
+  // oldest pending command waiting on `addr`, if any - requires `rx_mutex_`
+  PendingCommand *oldestPending(uint8_t addr);
+
+  // the pending entry for `handle`, throws if it isn't in flight (or has been
+  // abandoned) - requires `rx_mutex_`
+  PendingCommand &pendingFor(CommandHandle handle);
+
+  // block until `cmd` is done - throws (and abandons it) on timeout
+  void waitPending(PendingCommand &cmd, Deadline deadline);
+
+  // release `cmd`, or if its response hasn't come yet, leave it to soak that
+  // up when it does - requires `rx_mutex_`
+  void abandon(PendingCommand &cmd);
+
+  // `submitCommand`, for a command whose response comes back from
+  // `response_addr` rather than `cmd`
+  CommandHandle submitPending(uint8_t cmd, uint8_t data, uint8_t response_addr,
+                              Deadline deadline);
+
+  // submit `n` commands - `submit(i)` issues the i'th and returns its handle
+  // - and wait on them all at once, up to MAX_PENDING_COMMANDS at a time,
+  // with the responses going to `out`. Nothing is left in flight if it
+  // throws.
+  template <typename Submit>
+  void batchCommands(size_t n, Submit submit, ResponseRaw_t *out,
+                     Deadline deadline);
+
+  // frame `cmd` onto the end of `tx_`, writing out what's already there
+  // first (by `deadline`) if it's full - requires `tx_mutex_`
+  void queueCommand(uint8_t cmd, uint8_t data, Deadline deadline);
+
+  // start the streaming reader thread
+  void launchReader(OverflowPolicy policy, TimedSampleCallback callback);
+
+  // both `popSamples` - `T` is either sample type
+  template <typename T> size_t popSamplesAs(T *out, size_t max_samples);
+
+  // body of the streaming reader thread
+  void readerLoop();
+
+  ByteRing rx_;
+  // CLOCK_MONOTONIC time of the last read that got anything
+  uint64_t rx_ns_;
+
+  // framed commands waiting to go out in the next write, under `tx_mutex_`.
+  // Taken before `rx_mutex_` when both are needed, and never held by the
+  // reader thread, so a slow write doesn't hold up decoding.
+  std::array<uint8_t, MAX_PENDING_COMMANDS * sizeof(CommandRaw_t)> tx_;
+  size_t tx_len_;
+  std::mutex tx_mutex_;
 
   MessageCoder<CommandRaw_t> command_message_coder_;
-  MessageCoder<ResponseRaw_t> response_message_coder_;
-  MessageCoder<DataResponseRaw_t> data_response_message_coder_;
+
+  // sorts incoming frames into responses and data
+  // while streaming, the reader thread decodes under `rx_mutex_` and signals
+  // `rx_cv_` whenever it has decoded something
+  FrameDecoder decoder_;
+  std::mutex rx_mutex_;
+  std::condition_variable rx_cv_;
+
+  // commands waiting on a response, indexed by handle % MAX_PENDING_COMMANDS,
+  // plus responses nobody was waiting on (for `receiveResponse`)
+  std::array<PendingCommand, MAX_PENDING_COMMANDS> pending_;
+  CommandHandle next_handle_;
+  FixedQueue<ResponseRaw_t, RESPONSE_QUEUE_SIZE> unclaimed_responses_;
+
+  // streaming state
+  std::thread reader_;
+  // `streaming_` is true from `startStreaming()` until the reader has let go
+  // of the port - when it's asked to stop, or the port closes on it
+  std::atomic<bool> streaming_;
+  std::atomic<bool> stop_reader_;
+  TimedSampleCallback sample_callback_;
+  SampleBusWriter *bus_;
+  SpscQueue<TimedSample_t, SAMPLE_QUEUE_SIZE> samples_;
   IOInterface &io_interface_;
+
+  // instrumentation
+  Counter commands_sent_;
+  Counter timeouts_;
+  Counter receive_retries_;
+  Counter unclaimed_count_;
+  LatencyHistogram round_trip_ns_;
 };
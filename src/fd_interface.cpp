@@ -0,0 +1,166 @@
+#include "fd_interface.h"
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Switch `fd` over to non-blocking
+static void setNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    throw std::runtime_error("Failed to make fd non-blocking");
+  }
+}
+
+FdInterface::~FdInterface() { shutdown(); }
+
+void FdInterface::init() {
+  if (read_fd_ < 0 || write_fd_ < 0) {
+    throw std::runtime_error("FdInterface has no fd");
+  }
+  setNonBlocking(read_fd_);
+  setNonBlocking(write_fd_);
+}
+
+void FdInterface::shutdown() {
+  if (write_fd_ >= 0 && write_fd_ != read_fd_) {
+    close(write_fd_);
+  }
+  if (read_fd_ >= 0) {
+    close(read_fd_);
+  }
+  read_fd_ = write_fd_ = -1;
+}
+
+SendResult FdInterface::writeFrom(const struct iovec *iov, int iovcnt,
+                                  Deadline deadline) {
+  // the port is non-blocking, so a write can come up short if the output
+  // buffer is full - wait for it to drain and carry on from where it stopped,
+  // which may be part way through one of the buffers
+  size_t index = 0;
+  size_t offset = 0;
+  size_t sent = 0;
+
+  while (index < (size_t)iovcnt) {
+    // skip over whatever's already gone (including empty buffers)
+    if (offset >= iov[index].iov_len) {
+      offset -= iov[index].iov_len;
+      index++;
+      continue;
+    }
+
+    ssize_t ret;
+    if (offset == 0) {
+      ret = writev(write_fd_, &iov[index], iovcnt - index);
+    } else {
+      // finish the partially sent buffer on its own first
+      ret = write(write_fd_, (const uint8_t *)iov[index].iov_base + offset,
+                  iov[index].iov_len - offset);
+    }
+
+    if (ret >= 0) {
+      offset += ret;
+      sent += ret;
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN) {
+      return SendResult{.bytes = sent, .status = IOStatus::Closed};
+    }
+    if (!waitFor(write_fd_, POLLOUT, deadline)) {
+      return SendResult{.bytes = sent, .status = IOStatus::Timeout};
+    }
+  }
+
+  return SendResult{.bytes = sent, .status = IOStatus::Ok};
+}
+
+ReceiveResult FdInterface::readInto(std::span<uint8_t> buffer,
+                                    Deadline deadline) {
+  if (buffer.empty()) {
+    return ReceiveResult{.bytes = 0, .status = IOStatus::Ok};
+  }
+
+  while (true) {
+    ssize_t ret = read(read_fd_, buffer.data(), buffer.size());
+    if (ret > 0) {
+      return ReceiveResult{.bytes = (size_t)ret, .status = IOStatus::Ok};
+    }
+
+    // a pty whose other side has gone reads as EIO rather than 0
+    if (ret == 0 || (errno != EAGAIN && errno != EINTR)) {
+      return ReceiveResult{.bytes = 0, .status = IOStatus::Closed};
+    }
+
+    if (errno == EAGAIN && !waitFor(read_fd_, POLLIN, deadline)) {
+      return ReceiveResult{.bytes = 0, .status = IOStatus::Timeout};
+    }
+  }
+}
+
+int FdInterface::availableBytes() {
+  int bytes_available = 0;
+  if (ioctl(read_fd_, FIONREAD, &bytes_available) < 0) {
+    throw std::runtime_error("Failed to get available bytes");
+  }
+  return bytes_available;
+}
+
+bool FdInterface::waitReadable(Deadline deadline) {
+  return waitFor(read_fd_, POLLIN, deadline);
+}
+
+void FdInterface::flush() {
+  uint8_t discard[256];
+  while (read(read_fd_, discard, sizeof(discard)) > 0) {
+  }
+}
+
+bool FdInterface::waitFor(int fd, short events, Deadline deadline) {
+  struct pollfd pfd = {.fd = fd, .events = events, .revents = 0};
+
+  while (true) {
+    // ppoll takes a relative timeout, so work it out from the deadline each
+    // time around (in case we got interrupted part way)
+    struct timespec timeout;
+    struct timespec *timeout_ptr = nullptr;
+    if (deadline != NO_DEADLINE) {
+      auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (remaining.count() < 0) {
+        remaining = std::chrono::nanoseconds(0);
+      }
+      timeout.tv_sec = remaining.count() / 1000000000;
+      timeout.tv_nsec = remaining.count() % 1000000000;
+      timeout_ptr = &timeout;
+    }
+
+    int ret = ppoll(&pfd, 1, timeout_ptr, nullptr);
+    if (ret > 0) {
+      // errors/hangups count as "ready" - the read/write will report them
+      return true;
+    }
+    if (ret == 0) {
+      return false;
+    }
+    if (errno != EINTR) {
+      throw std::runtime_error("Failed to poll fd");
+    }
+  }
+}
+
+void openSocketPair(int &a, int &b) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) !=
+      0) {
+    throw std::runtime_error("Failed to open socketpair");
+  }
+  a = fds[0];
+  b = fds[1];
+}
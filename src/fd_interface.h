@@ -0,0 +1,52 @@
+#pragma once
+#include "io_interface.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// an IOInterface over plain file descriptors - one to read from and one to
+// write to, which can be the same (a socket) or not (a pair of pipes)
+//
+// the fds are switched to O_NONBLOCK; any waiting is done in poll(). The
+// interface owns them from construction, and closes them in `shutdown()`.
+class FdInterface : public IOInterface {
+public:
+  FdInterface(int read_fd, int write_fd)
+      : read_fd_(read_fd), write_fd_(write_fd){};
+
+  // Destructor. Runs shutdown().
+  ~FdInterface();
+
+  void init() override;
+  void shutdown() override;
+
+  int availableBytes() override;
+
+  using IOInterface::waitReadable;
+  bool waitReadable(Deadline deadline) override;
+
+  // Read and throw away whatever input is pending
+  void flush() override;
+
+  int fd() const override { return read_fd_; };
+
+protected:
+  // for subclasses that open their fd in `init()`
+  FdInterface() : read_fd_(-1), write_fd_(-1){};
+
+  ReceiveResult readInto(std::span<uint8_t> buffer,
+                         Deadline deadline) override;
+  SendResult writeFrom(const struct iovec *iov, int iovcnt,
+                       Deadline deadline) override;
+
+  // poll() `fd` for `events` until `deadline`, true if they came up
+  bool waitFor(int fd, short events, Deadline deadline);
+
+  int read_fd_;
+  int write_fd_;
+};
+
+// Opens a connected, non-blocking AF_UNIX stream socketpair into `a` and `b`
+// - whatever is written to one is read from the other, so each can back an
+// `FdInterface(fd, fd)`
+void openSocketPair(int &a, int &b);
@@ -0,0 +1,54 @@
+#pragma once
+#include <array>
+#include <cstddef>
+
+// bounded fifo with inline storage - pushing/popping never allocates
+// not thread-safe, it's meant to be owned by whoever is decoding
+template <typename T, size_t N> class FixedQueue {
+public:
+  FixedQueue() : head_(0), tail_(0){};
+
+  size_t size() const { return tail_ - head_; }
+  bool empty() const { return head_ == tail_; }
+  bool full() const { return size() == N; }
+  static constexpr size_t capacity() { return N; }
+
+  // Add `item` to the back, returns false (and drops `item`) if full
+  bool push(const T &item) {
+    if (full()) {
+      return false;
+    }
+    buf_[tail_++ % N] = item;
+    return true;
+  }
+
+  // Add `item` to the back, making room by dropping the oldest item if full.
+  // Returns true if something was dropped.
+  bool pushOverwrite(const T &item) {
+    bool dropped = full();
+    if (dropped) {
+      head_++;
+    }
+    buf_[tail_++ % N] = item;
+    return dropped;
+  }
+
+  // Remove the front item into `item`, returns false if empty
+  bool pop(T &item) {
+    if (empty()) {
+      return false;
+    }
+    item = buf_[head_++ % N];
+    return true;
+  }
+
+  // front item - caller must check `empty()`
+  T &front() { return buf_[head_ % N]; }
+
+  void clear() { head_ = tail_ = 0; }
+
+private:
+  std::array<T, N> buf_;
+  size_t head_;
+  size_t tail_;
+};
@@ -0,0 +1,159 @@
+#include "frame_decoder.h"
+#include "gyro_xyz.h"
+#include "logger.h"
+#include <algorithm>
+#include <cmath>
+
+size_t FrameDecoder::decode(ByteRing &ring, uint64_t rx_ns) {
+  // tallied up locally and folded into the counters once at the end, rather
+  // than paying for an atomic add per frame
+  size_t n_responses = 0;
+  size_t n_data_responses = 0;
+  size_t n_dropped = 0;
+  size_t n_dropped_data = 0;
+  size_t n_bursts = 0;
+  size_t n_lost = 0;
+
+  // every sample, whichever kind of frame it came in, goes through here
+  auto queue_sample = [&](TimedSample_t &sample) {
+    sample.rx_ns = rx_ns;
+    sample_clock_.update(sample);
+    n_lost += sample.lost;
+    n_dropped_data += data_responses_.pushOverwrite(sample);
+  };
+
+  while (!ring.empty()) {
+    uint8_t addr = ring.peek(0);
+    if (addr == DATA_GET_REG) {
+      if (ring.size() < data_response_message_coder_.getFrameLength()) {
+        // wait for the rest of it
+        break;
+      }
+      if (data_response_message_coder_.frameAt(ring)) {
+        TimedSample_t sample;
+        data_response_message_coder_.decodeFrame(ring, sample.data);
+        logger().frame(LogLevel::Debug, sample.data);
+        sample.temperature_c = NAN;
+        queue_sample(sample);
+        n_data_responses++;
+        continue;
+      }
+    } else if (addr == BURST_DATA_REG) {
+      // the header says how long the frame is, so that has to come first -
+      // and if it's not a header we'd send, resync now rather than wait
+      if (ring.size() < BURST_HEADER_LENGTH) {
+        break;
+      }
+      size_t length = burst_coder_.frameLengthAt(ring);
+      if (length > 0 && ring.size() < length) {
+        break;
+      }
+      if (length > 0 && burst_coder_.frameAt(ring)) {
+        burst_coder_.decodeFrame(ring, burst_);
+        logger().frame(LogLevel::Debug, burst_.header);
+
+        // unpacked into one sample each, just like they'd come in one by one
+        float temperature_c =
+            burst_.header.flags & BURST_FLAG_TEMPERATURE
+                ? burst_.temperature / BURST_TEMPERATURE_SCALE
+                : NAN;
+        for (size_t i = 0; i < burst_.header.samples; i++) {
+          auto &rates = burst_.samples[i];
+          TimedSample_t sample;
+          sample.data = DataResponseRaw_t{
+              .addr = DATA_GET_REG,
+              .count = (uint16_t)(burst_.header.count + i),
+              .x_rate = rates.x_rate,
+              .y_rate = rates.y_rate,
+              .z_rate = rates.z_rate,
+              .delim = burst_coder_.getDelimiter()};
+          sample.temperature_c = temperature_c;
+          queue_sample(sample);
+        }
+        n_bursts++;
+        continue;
+      }
+    } else {
+      if (ring.size() < response_message_coder_.getFrameLength()) {
+        break;
+      }
+      if (response_message_coder_.frameAt(ring)) {
+        ResponseRaw_t resp;
+        response_message_coder_.decodeFrame(ring, resp);
+        logger().frame(LogLevel::Debug, resp);
+        n_dropped += responses_.pushOverwrite(resp);
+        n_responses++;
+        continue;
+      }
+    }
+
+    // the addr byte didn't start a valid frame of the type it claims to be -
+    // we're out of sync, so skip ahead to the next place either kind of frame
+    // could start and try again
+    size_t before = ring.size();
+    resync(ring);
+    resyncs_.add();
+    discarded_bytes_.add(before - ring.size());
+  }
+
+  if (n_responses > 0) {
+    responses_decoded_.add(n_responses);
+    dropped_responses_.add(n_dropped);
+  }
+  if (n_data_responses > 0 || n_bursts > 0) {
+    data_responses_decoded_.add(n_data_responses);
+    bursts_decoded_.add(n_bursts);
+    dropped_data_responses_.add(n_dropped_data);
+    lost_samples_.add(n_lost);
+  }
+  return n_responses + n_data_responses + n_bursts;
+}
+
+void FrameDecoder::resync(ByteRing &ring) const {
+  uint8_t delim = response_message_coder_.getDelimiter();
+  if (delim != data_response_message_coder_.getDelimiter()) {
+    // no single byte to look for, step through it the slow way
+    ring.consume(1);
+    return;
+  }
+
+  // the fixed length frames can be found going by the delimiter - but burst
+  // frames can be long enough that that would hardly ever skip anything, so
+  // those are looked for by their addr byte instead
+  size_t skip = resyncOffset(
+      ring, delim,
+      std::min(response_message_coder_.getFrameLength(),
+               data_response_message_coder_.getFrameLength()),
+      std::max(response_message_coder_.getFrameLength(),
+               data_response_message_coder_.getFrameLength()));
+  ring.consume(std::min(skip, ring.find(BURST_DATA_REG, 1)));
+}
+
+size_t FrameDecoder::maxFrameLength() const {
+  return std::max({response_message_coder_.getFrameLength(),
+                   data_response_message_coder_.getFrameLength(),
+                   BURST_MAX_FRAME_LENGTH});
+}
+
+DecoderMetrics_t FrameDecoder::metrics() const {
+  return DecoderMetrics_t{
+      .responses = responses_decoded_.value(),
+      .data_responses = data_responses_decoded_.value(),
+      .bursts = bursts_decoded_.value(),
+      .response_overflows = dropped_responses_.value(),
+      .data_response_overflows = dropped_data_responses_.value(),
+      .resyncs = resyncs_.value(),
+      .discarded_bytes = discarded_bytes_.value(),
+      .lost_samples = lost_samples_.value()};
+}
+
+void writeJson(std::ostream &os, const DecoderMetrics_t &metrics) {
+  os << "{\"responses\": " << metrics.responses
+     << ", \"data_responses\": " << metrics.data_responses
+     << ", \"bursts\": " << metrics.bursts
+     << ", \"response_overflows\": " << metrics.response_overflows
+     << ", \"data_response_overflows\": " << metrics.data_response_overflows
+     << ", \"resyncs\": " << metrics.resyncs
+     << ", \"discarded_bytes\": " << metrics.discarded_bytes
+     << ", \"lost_samples\": " << metrics.lost_samples << "}";
+}
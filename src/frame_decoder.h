@@ -0,0 +1,103 @@
+#pragma once
+#include "byte_ring.h"
+#include "fixed_queue.h"
+#include "message_coder.h"
+#include "metrics.h"
+#include "sample_clock.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// room for the responses to a whole batch of pipelined commands, which can
+// all come in on the one read
+const size_t RESPONSE_QUEUE_SIZE = 64;
+const size_t DATA_RESPONSE_QUEUE_SIZE = 256;
+
+// see `FrameDecoder::metrics()`
+struct DecoderMetrics {
+  uint64_t responses;      // register responses decoded
+  uint64_t data_responses; // data frames decoded
+  uint64_t bursts;         // burst frames decoded
+  // frames pushed off the front of a full queue
+  uint64_t response_overflows;
+  uint64_t data_response_overflows;
+  uint64_t resyncs;         // times the stream had to be resynced
+  uint64_t discarded_bytes; // junk skipped over doing so
+  uint64_t lost_samples;    // gaps in the data frames' sample counter
+} typedef DecoderMetrics_t;
+
+// de-multiplexes a single stream of device output that carries both register
+// responses (ResponseRaw_t) and data (DataResponseRaw_t)
+//
+// the frame type is picked off the `addr` byte - data frames always come back
+// as DATA_GET_REG, anything else is a register response - which also tells us
+// how long the frame should be. Each frame is routed onto its own queue, so
+// whoever is waiting on a response doesn't eat the data and vice versa.
+//
+// burst frames (BURST_DATA_REG) carry several samples, which are unpacked
+// onto the data queue one by one as if they'd come in their own frames. Every
+// sample is stamped with the time it came in and run through a `SampleClock`
+// on the way, so they come out as `TimedSample_t`s.
+class FrameDecoder {
+public:
+  FrameDecoder(MessageCoder<ResponseRaw_t> response_coder,
+               MessageCoder<DataResponseRaw_t> data_response_coder)
+      : response_message_coder_(response_coder),
+        data_response_message_coder_(data_response_coder),
+        burst_coder_(response_coder.getDelimiter()){};
+
+  // Decode every complete frame in `ring` onto the queues. Partial frames are
+  // left in `ring`. `rx_ns` is when the bytes finishing them off were read.
+  // Returns the number of frames decoded.
+  size_t decode(ByteRing &ring, uint64_t rx_ns);
+
+  FixedQueue<ResponseRaw_t, RESPONSE_QUEUE_SIZE> &responses() {
+    return responses_;
+  };
+  FixedQueue<TimedSample_t, DATA_RESPONSE_QUEUE_SIZE> &dataResponses() {
+    return data_responses_;
+  };
+
+  // number of frames pushed off the front of a full queue
+  size_t droppedResponses() const { return dropped_responses_.value(); };
+  size_t droppedDataResponses() const {
+    return dropped_data_responses_.value();
+  };
+
+  // counters for everything decoded so far - safe to call from any thread,
+  // unlike the rest of this class
+  DecoderMetrics_t metrics() const;
+
+  // start the sample clock over, e.g. when the device's output changes
+  void resetClock() { sample_clock_.reset(); };
+
+  // longest frame this decoder will wait on
+  size_t maxFrameLength() const;
+
+private:
+  // Skip past junk at the head of `ring` to the next possible frame start
+  void resync(ByteRing &ring) const;
+
+  MessageCoder<ResponseRaw_t> response_message_coder_;
+  MessageCoder<DataResponseRaw_t> data_response_message_coder_;
+  BurstCoder burst_coder_;
+
+  // scratch space for unpacking burst frames
+  BurstFrame_t burst_;
+
+  FixedQueue<ResponseRaw_t, RESPONSE_QUEUE_SIZE> responses_;
+  FixedQueue<TimedSample_t, DATA_RESPONSE_QUEUE_SIZE> data_responses_;
+  SampleClock sample_clock_;
+
+  Counter responses_decoded_;
+  Counter data_responses_decoded_;
+  Counter bursts_decoded_;
+  Counter dropped_responses_;
+  Counter dropped_data_responses_;
+  Counter resyncs_;
+  Counter discarded_bytes_;
+  Counter lost_samples_;
+};
+
+// Writes `metrics` as a JSON object
+void writeJson(std::ostream &os, const DecoderMetrics_t &metrics);
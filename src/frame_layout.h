@@ -0,0 +1,195 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+// compile-time description of how a frame struct goes on the wire
+//
+// a frame is declared as the list of its struct's fields, in wire order, e.g.
+//
+//   template <> struct WireLayout<CommandRaw_t>
+//       : FrameLayout<Field<&CommandRaw_t::addr>, Field<&CommandRaw_t::data>,
+//                     Field<&CommandRaw_t::delim>> {};
+//
+// and `encode`/`decode` then copy each field to/from its (constant) offset,
+// big-endian like the G370. Everything is resolved at compile time, so
+// these inline down to a handful of loads, byte swaps and stores - no
+// dependence on struct packing, padding or host byte order.
+//
+// 16 byte frames whose struct is laid out just like the wire (e.g. the packed
+// data frame) go one better where the cpu has a byte shuffle (SSSE3's pshufb,
+// or NEON's tbl): the whole frame is loaded, every field swapped at once by
+// one shuffle, and stored - as cheap as copying the struct as it is.
+
+#if defined(__SSSE3__) || defined(__aarch64__)
+#define FRAME_LAYOUT_SHUFFLE
+#endif
+
+// unsigned integer the same size as a field, for byte swapping
+template <size_t N> struct UIntOfSize;
+template <> struct UIntOfSize<1> { typedef uint8_t type; };
+template <> struct UIntOfSize<2> { typedef uint16_t type; };
+template <> struct UIntOfSize<4> { typedef uint32_t type; };
+template <> struct UIntOfSize<8> { typedef uint64_t type; };
+
+template <typename U> constexpr U byteSwap(U value) {
+  if constexpr (sizeof(U) == 1) {
+    return value;
+  } else if constexpr (sizeof(U) == 2) {
+    return __builtin_bswap16(value);
+  } else if constexpr (sizeof(U) == 4) {
+    return __builtin_bswap32(value);
+  } else {
+    return __builtin_bswap64(value);
+  }
+}
+
+// Writes `value` to `out` most significant byte first
+template <typename F> inline void storeBigEndian(F value, uint8_t *out) {
+  typedef typename UIntOfSize<sizeof(F)>::type U;
+  U bits = std::bit_cast<U>(value);
+  if constexpr (std::endian::native == std::endian::little) {
+    bits = byteSwap(bits);
+  }
+  std::memcpy(out, &bits, sizeof(bits));
+}
+
+// Reads a value stored most significant byte first from `in`
+template <typename F> inline F loadBigEndian(const uint8_t *in) {
+  typedef typename UIntOfSize<sizeof(F)>::type U;
+  U bits;
+  std::memcpy(&bits, in, sizeof(bits));
+  if constexpr (std::endian::native == std::endian::little) {
+    bits = byteSwap(bits);
+  }
+  return std::bit_cast<F>(bits);
+}
+
+// pulls the struct and field types out of a pointer to member
+template <typename M> struct MemberTraits;
+template <typename S, typename F> struct MemberTraits<F S::*> {
+  typedef S Struct;
+  typedef F Type;
+};
+
+// one field of a frame - `Member` is a pointer to the struct member
+template <auto Member> struct Field {
+  typedef typename MemberTraits<decltype(Member)>::Struct Struct;
+  typedef typename MemberTraits<decltype(Member)>::Type Type;
+  static_assert(std::is_arithmetic<Type>::value,
+                "frame fields must be integers or floats");
+
+  static constexpr size_t size = sizeof(Type);
+  static constexpr auto member = Member;
+
+  static void encode(const Struct &payload, uint8_t *out) {
+    storeBigEndian(payload.*Member, out);
+  };
+  static void decode(const uint8_t *in, Struct &payload) {
+    payload.*Member = loadBigEndian<Type>(in);
+  };
+};
+
+// Whether field `A` comes before field `B` in their struct
+template <typename A, typename B> constexpr bool fieldBefore() {
+  typename A::Struct payload{};
+  return (const void *)&(payload.*A::member) <
+         (const void *)&(payload.*B::member);
+}
+
+// Whether `Fields` are in the same order as in their struct
+template <typename First, typename... Rest> constexpr bool fieldsInOrder() {
+  if constexpr (sizeof...(Rest) == 0) {
+    return true;
+  } else {
+    typedef typename std::tuple_element<0, std::tuple<Rest...>>::type Next;
+    return fieldBefore<First, Next>() && fieldsInOrder<Rest...>();
+  }
+}
+
+// a frame's worth of bytes, for shuffling whole frames at once
+typedef uint8_t FrameBytes __attribute__((vector_size(16)));
+
+// a whole frame: `Fields` back to back, in order, with no padding
+template <typename... Fields> struct FrameLayout {
+  static_assert(sizeof...(Fields) > 0, "a frame needs at least one field");
+  typedef typename std::tuple_element<0, std::tuple<Fields...>>::type::Struct
+      Struct;
+  static_assert((std::is_same<Struct, typename Fields::Struct>::value && ...),
+                "all fields of a frame must belong to the same struct");
+
+  // bytes on the wire
+  static constexpr size_t size = (Fields::size + ...);
+  static_assert(size <= sizeof(Struct),
+                "frame has more field bytes than its struct");
+
+  // whether the struct holds exactly the wire bytes, byte order aside -
+  // every field listed, in declaration order, with no padding
+  static constexpr bool mirrors_struct =
+      size == sizeof(Struct) && std::is_trivially_copyable<Struct>::value &&
+      fieldsInOrder<Fields...>();
+
+#ifdef FRAME_LAYOUT_SHUFFLE
+  static constexpr bool shuffled = mirrors_struct && size == sizeof(FrameBytes);
+#else
+  static constexpr bool shuffled = false;
+#endif
+
+  // where each wire byte comes from in the struct, and vice versa - the
+  // same either way, as it only ever reverses bytes within a field
+  static constexpr std::array<uint8_t, size> byteOrder() {
+    std::array<uint8_t, size> order = {};
+    size_t offset = 0;
+    (
+        [&] {
+          for (size_t i = 0; i < Fields::size; i++) {
+            order[offset + i] =
+                std::endian::native == std::endian::little
+                    ? offset + Fields::size - 1 - i
+                    : offset + i;
+          }
+          offset += Fields::size;
+        }(),
+        ...);
+    return order;
+  };
+
+  // Writes `payload` to `out`, which must hold at least `size` bytes
+  static void encode(const Struct &payload, uint8_t *out) {
+    if constexpr (shuffled) {
+      shuffle(reinterpret_cast<const uint8_t *>(&payload), out);
+    } else {
+      size_t offset = 0;
+      ((Fields::encode(payload, out + offset), offset += Fields::size), ...);
+    }
+  };
+
+  // Reads `payload` back from `size` bytes at `in`
+  static void decode(const uint8_t *in, Struct &payload) {
+    if constexpr (shuffled) {
+      shuffle(in, reinterpret_cast<uint8_t *>(&payload));
+    } else {
+      size_t offset = 0;
+      ((Fields::decode(in + offset, payload), offset += Fields::size), ...);
+    }
+  };
+
+private:
+  // Copies a frame from `in` to `out`, reordering its bytes by `byteOrder`
+  static void shuffle(const uint8_t *in, uint8_t *out) {
+    static constexpr std::array<uint8_t, size> order = byteOrder();
+    FrameBytes mask;
+    FrameBytes bytes;
+    std::memcpy(&mask, order.data(), sizeof(mask));
+    std::memcpy(&bytes, in, sizeof(bytes));
+    bytes = __builtin_shuffle(bytes, mask);
+    std::memcpy(out, &bytes, sizeof(bytes));
+  };
+};
+
+// specialize with a `FrameLayout` for each frame type
+template <typename T> struct WireLayout;
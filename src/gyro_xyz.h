@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 
 const uint8_t DELIM = 0x0D;
@@ -11,6 +12,38 @@ const uint8_t MODE_GET_REG = 0x04;
 const uint8_t MODE_ARG_AUTO = 0x00;
 const uint8_t MODE_ARG_MANUAL = 0x01;
 const uint8_t MODE_ARG_CONFIG = 0x02;
-// there could also be another "burst"-like mode here
-// where the "response" format includes multiple
-// data fields - but skipping that to save time
+// like auto, but samples are sent several at a time in burst frames (see
+// BurstHeaderRaw_t) - less overhead per sample on the wire and to decode
+const uint8_t MODE_ARG_BURST = 0x03;
+
+// burst frames come back as this
+const uint8_t BURST_DATA_REG = 0x81;
+
+// configures burst frames - the low bits are the samples per frame (1 up to
+// BURST_MAX_SAMPLES), and BURST_CTRL_TEMPERATURE adds the temperature
+const uint8_t BURST_CTRL_REG = 0x05;
+const uint8_t BURST_CTRL_SAMPLES_MASK = 0x3F;
+const uint8_t BURST_CTRL_TEMPERATURE = 0x80;
+
+// samples per burst frame until BURST_CTRL_REG says otherwise
+const size_t DEFAULT_BURST_SAMPLES = 8;
+
+// The rest of the register map, after the G370's (see register_map.h for
+// widths, access and reset values). Multi-byte registers take up an address
+// per byte, low byte first, and are read and written a byte at a time.
+const uint8_t SIG_CTRL_REG = 0x00;
+const uint8_t FILTER_CTRL_REG = 0x06;
+const uint8_t UART_CTRL_REG = 0x08;
+const uint8_t POL_CTRL_REG = 0x10;
+const uint8_t PROD_ID_REG = 0x6A;
+const uint8_t SERIAL_NUM_REG = 0x74;
+
+// writing GLOB_CMD_SOFT_RESET here puts every register back to its reset
+// value (and the mode back to manual) - the bit clears itself once done
+const uint8_t GLOB_CMD_REG = 0x0A;
+const uint8_t GLOB_CMD_SOFT_RESET = 0x80;
+
+// a command here reads back the register whose address is its data, for
+// registers that a plain command would write instead. The response comes
+// back as if from that register: {addr, value}.
+const uint8_t REG_READ_REG = 0x7F;
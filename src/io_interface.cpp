@@ -1,114 +1,111 @@
 #include "io_interface.h"
+#include "clock.h"
+#include "stream_recorder.h"
 #include <cstdint>
-#include <fcntl.h>
 #include <stdexcept>
-#include <string>
-#include <sys/ioctl.h>
-#include <sys/types.h>
-#include <termios.h>
-#include <unistd.h>
 #include <vector>
 
-IOInterface::IOInterface(const std::string &port, int baud_rate)
-    : IOInterface::IOInterface(port, baud_rate, O_RDWR | O_NOCTTY | O_SYNC){};
-
-IOInterface::IOInterface(const std::string &port, int baud_rate, int flags)
-    : port_(port), baud_rate_(baud_rate), flags_(flags){};
-
-void IOInterface::init() {
-  fd_ = open(port_.c_str(), flags_);
-
-  if (fd_ < 0) {
-    throw std::runtime_error("Failed to open port " + port_);
+void IOInterface::send(const std::vector<uint8_t> &message) {
+  auto deadline = deadlineAfter(DEFAULT_SEND_TIMEOUT);
+  switch (send(std::span<const uint8_t>(message), deadline)) {
+  case IOStatus::Ok:
+    return;
+  case IOStatus::Timeout:
+    throw TimeoutError("Timed out sending message");
+  case IOStatus::Closed:
+    break;
   }
-
-  configurePort(baud_rate_);
-  flush();
+  throw std::runtime_error("Failed to send message");
 }
 
-void IOInterface::shutdown() { close(fd_); }
-
-IOInterface::~IOInterface() { shutdown(); }
-
-void IOInterface::send(const std::vector<uint8_t> &message) {
-  // make sure it's actually an ssize_t
-  ssize_t message_size = message.size();
-
-  // write everything, if it didn't work throw
-  if (write(fd_, message.data(), message.size()) != message_size) {
-    throw std::runtime_error("Failed to send message");
-  }
+IOStatus IOInterface::send(std::span<const uint8_t> data, Deadline deadline) {
+  struct iovec iov = {.iov_base = const_cast<uint8_t *>(data.data()),
+                      .iov_len = data.size()};
+  return sendv(&iov, 1, deadline);
 }
 
 std::vector<uint8_t> IOInterface::receive(size_t size) {
-  ssize_t bytes_read;
-
   // create a buffer to hold our bytes
   std::vector<uint8_t> buffer(size);
 
   // read up to `size`, if it didn't work throw
-  if ((bytes_read = read(fd_, buffer.data(), size)) < 0) {
+  auto result = receiveInto(std::span<uint8_t>(buffer), NO_DEADLINE);
+  if (result.status == IOStatus::Closed) {
     throw std::runtime_error("Failed to receive message");
   }
 
   // don't forget to resize to what was actually read
-  buffer.resize(bytes_read);
+  buffer.resize(result.bytes);
   return buffer;
 }
 
-int IOInterface::availableBytes() {
-  int bytes_available = 0;
-  if (ioctl(fd_, FIONREAD, &bytes_available) < 0) {
-    throw std::runtime_error("Failed to get available bytes");
-  }
-  return bytes_available;
+IOStatus IOInterface::sendv(const struct iovec *iov, int iovcnt,
+                            Deadline deadline) {
+  return sendvSome(iov, iovcnt, deadline).status;
 }
 
-void IOInterface::flush() {
-  if (tcflush(fd_, TCIFLUSH) != 0) {
-    throw std::runtime_error("Failed to clear input buffer");
-  }
+SendResult IOInterface::sendSome(std::span<const uint8_t> data,
+                                 Deadline deadline) {
+  struct iovec iov = {.iov_base = const_cast<uint8_t *>(data.data()),
+                      .iov_len = data.size()};
+  return sendvSome(&iov, 1, deadline);
 }
 
-void IOInterface::configurePort(int baud_rate) {
-  // I'll be honest that I hacked these settings together here.
-  // I consider myself fairly familar with messaging standards (like UART), so I
-  // understand the fundamentals of control bits, stop bits, baud rate, etc. But
-  // I just haven't had much experience interfacing with uarts from unix c. If I
-  // had more time I'd spend it coming up to speed on how unix general terminal
-  // interfaces are described, and how termios settings work.
-
-  struct termios tty;
+SendResult IOInterface::sendvSome(const struct iovec *iov, int iovcnt,
+                                  Deadline deadline) {
+  auto result = writeFrom(iov, iovcnt, deadline);
+  if (result.bytes > 0) {
+    bytes_out_.add(result.bytes);
+  }
+  if (result.status == IOStatus::Timeout) {
+    send_timeouts_.add();
+  }
+  return result;
+}
 
-  // read in state of fd into a `termios` struct
-  if (tcgetattr(fd_, &tty) != 0) {
-    throw std::runtime_error("Failed to get UART attributes");
+ReceiveResult IOInterface::receiveInto(std::span<uint8_t> buffer,
+                                       Deadline deadline) {
+  auto result = readInto(buffer, deadline);
+  if (result.bytes > 0) {
+    bytes_in_.add(result.bytes);
+    if (recorder_) {
+      recorder_->record(buffer.data(), result.bytes, receiveClockNs());
+    }
+  } else if (result.status == IOStatus::Timeout) {
+    receive_timeouts_.add();
   }
+  return result;
+}
 
-  // set input and output baud rate the same
-  cfsetospeed(&tty, baud_rate);
-  cfsetispeed(&tty, baud_rate);
+ReceiveResult IOInterface::receiveUntil(std::span<uint8_t> buffer,
+                                        Deadline deadline) {
+  size_t received = 0;
 
-  // set all the flags
-  tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;
-  tty.c_iflag &= ~IGNBRK;
-  tty.c_lflag = 0;
-  tty.c_oflag = 0;
+  while (received < buffer.size()) {
+    auto result = receiveInto(buffer.subspan(received), deadline);
+    received += result.bytes;
+    if (result.status != IOStatus::Ok) {
+      return ReceiveResult{.bytes = received, .status = result.status};
+    }
+  }
 
-  // control characters
-  tty.c_cc[VMIN] = 1;
-  tty.c_cc[VTIME] = 5;
+  return ReceiveResult{.bytes = received, .status = IOStatus::Ok};
+}
 
-  // input modes
-  tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+IOMetrics_t IOInterface::metrics() const {
+  return IOMetrics_t{.bytes_in = bytes_in_.value(),
+                     .bytes_out = bytes_out_.value(),
+                     .receive_timeouts = receive_timeouts_.value(),
+                     .send_timeouts = send_timeouts_.value()};
+}
 
-  // control modes
-  tty.c_cflag |= (CLOCAL | CREAD);
-  tty.c_cflag &= ~(PARENB | PARODD);
-  tty.c_cflag &= ~CSTOPB;
-  tty.c_cflag &= ~CRTSCTS;
+void writeJson(std::ostream &os, const IOMetrics_t &metrics) {
+  os << "{\"bytes_in\": " << metrics.bytes_in
+     << ", \"bytes_out\": " << metrics.bytes_out
+     << ", \"receive_timeouts\": " << metrics.receive_timeouts
+     << ", \"send_timeouts\": " << metrics.send_timeouts << "}";
+}
 
-  if (tcsetattr(fd_, TCSANOW, &tty) != 0) {
-    throw std::runtime_error("Failed to set UART attributes");
-  }
+bool IOInterface::waitReadable(int timeout_ms) {
+  return waitReadable(deadlineAfter(std::chrono::milliseconds(timeout_ms)));
 }
@@ -1,48 +1,163 @@
 #pragma once
+#include "clock.h"
+#include "metrics.h"
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <ostream>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <sys/uio.h>
 #include <vector>
 
+class StreamRecorder;
+
 // should probably namespace all of this, but not doing that for simplicity
 
-// handles instantiating and sending data to hardware-level interface
-// in this case it's a UART - but there might be another one for SPI, etc.
-class IOInterface {
+// point in time by which an io call has to give up
+typedef std::chrono::steady_clock::time_point Deadline;
+
+// a deadline that never arrives, for blocking calls
+const Deadline NO_DEADLINE = Deadline::max();
+
+// `timeout` from now
+inline Deadline deadlineAfter(std::chrono::milliseconds timeout) {
+  return std::chrono::steady_clock::now() + timeout;
+}
+
+// how long a send without its own deadline will wait for the port to drain
+const std::chrono::milliseconds DEFAULT_SEND_TIMEOUT(1000);
+
+// thrown when a call runs out of time - a runtime_error so existing handlers
+// still catch it
+class TimeoutError : public std::runtime_error {
 public:
-  // Dumb initializers - separate from `init()`
-  // so we can chose when to call `init()` if needed
-  IOInterface(const std::string &port, int baud_rate);
-  IOInterface(const std::string &port, int baud_rate, int flags);
+  using std::runtime_error::runtime_error;
+};
+
+// how a deadline-bounded io call finished
+enum class IOStatus {
+  Ok,      // got everything we asked for (or at least something, for reads)
+  Timeout, // deadline passed first
+  Closed,  // the other end went away
+};
+
+struct ReceiveResult {
+  size_t bytes;
+  IOStatus status;
+};
+
+// how far a send got - all of it, unless it timed out or the port closed
+struct SendResult {
+  size_t bytes;
+  IOStatus status;
+};
+
+// see `IOInterface::metrics()`
+struct IOMetrics {
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t receive_timeouts; // reads that gave up with nothing to show
+  uint64_t send_timeouts;    // writes that couldn't all go out in time
+} typedef IOMetrics_t;
 
-  // Destructor. Runs shutdown().
-  ~IOInterface();
+// a byte stream to a device - the transport `SensorDriver` and `SensorSim`
+// talk over
+//
+// backends:
+// - `UartInterface`: a real (or pseudo) serial port, through termios
+// - `FdInterface`: any pair of already open fds - a socketpair, pipes, ...
+// - `LoopbackInterface`: an in-memory link within one process
+// - `ReplayInterface`: plays back a stream recording
+// - `VirtualInterface`: wraps one of the above, stepping an in-process
+//   `SensorSim` in virtual time whenever input is waited for
+//
+// every call is bounded by a deadline. The leaf backends are `final`, so
+// calls made through them (rather than through an `IOInterface &`) don't need
+// to go through the vtable.
+class IOInterface {
+public:
+  virtual ~IOInterface(){};
 
-  // Attempt to initialize the port
-  void init();
+  // Attempt to initialize the transport
+  virtual void init() = 0;
 
-  // Attempt to shutdown the port
-  void shutdown();
+  // Attempt to shutdown the transport
+  virtual void shutdown() = 0;
 
-  // Send `message`
+  // Send `message`, waiting at most DEFAULT_SEND_TIMEOUT for room
   void send(const std::vector<uint8_t> &message);
 
-  // Read `size` bytes
+  // Send all of `data`, giving up at `deadline`
+  IOStatus send(std::span<const uint8_t> data, Deadline deadline);
+
+  // Scatter-gather send of `iovcnt` buffers in (ideally) a single write
+  IOStatus sendv(const struct iovec *iov, int iovcnt, Deadline deadline);
+
+  // same as the two above, but also say how many bytes went out - for
+  // callers that need to know where a send that gave up stopped
+  SendResult sendSome(std::span<const uint8_t> data, Deadline deadline);
+  SendResult sendvSome(const struct iovec *iov, int iovcnt, Deadline deadline);
+
+  // Read up to `size` bytes, blocking until at least one arrives
   std::vector<uint8_t> receive(size_t size);
 
-  // Get number of bytes available on buffer
-  int availableBytes();
+  // Read up to `buffer.size()` bytes straight into `buffer` - waits until at
+  // least one byte is available or `deadline` passes, then takes whatever is
+  // there
+  ReceiveResult receiveInto(std::span<uint8_t> buffer, Deadline deadline);
+
+  // Fill all of `buffer`, or as much as arrives before `deadline`
+  ReceiveResult receiveUntil(std::span<uint8_t> buffer, Deadline deadline);
+
+  // Get number of bytes available to read
+  virtual int availableBytes() = 0;
+
+  // Wait up to `timeout_ms` for bytes to arrive, true if there are some
+  bool waitReadable(int timeout_ms);
+
+  // Wait until `deadline` for bytes to arrive, true if there are some
+  virtual bool waitReadable(Deadline deadline) = 0;
 
   // Flush the input
-  void flush();
+  virtual void flush() = 0;
 
-private:
-  std::string port_;
-  int baud_rate_;
-  int flags_;
+  // a file descriptor that polls readable when there's input, e.g. for
+  // epoll - -1 if the backend doesn't have one
+  virtual int fd() const = 0;
 
-  int fd_;
+  // the time input read through this transport is stamped with -
+  // CLOCK_MONOTONIC, unless the transport keeps time of its own
+  virtual uint64_t receiveClockNs() const { return monotonicNanos(); };
 
-  // Configure the port
-  void configurePort(int baud_rate);
+  // Append everything read from now on to `recorder` (nullptr to stop) -
+  // the recorder has to be initialized, and outlive the recording
+  void setRecorder(StreamRecorder *recorder) { recorder_ = recorder; };
+
+  // counters for everything that has gone through so far - safe to call from
+  // any thread
+  IOMetrics_t metrics() const;
+
+protected:
+  IOInterface() : recorder_(nullptr){};
+
+  // the backend's half of `receiveInto`
+  virtual ReceiveResult readInto(std::span<uint8_t> buffer,
+                                 Deadline deadline) = 0;
+
+  // the backend's half of `sendv`
+  virtual SendResult writeFrom(const struct iovec *iov, int iovcnt,
+                               Deadline deadline) = 0;
+
+private:
+  StreamRecorder *recorder_;
+
+  Counter bytes_in_;
+  Counter bytes_out_;
+  Counter receive_timeouts_;
+  Counter send_timeouts_;
 };
+
+// Writes `metrics` as a JSON object
+void writeJson(std::ostream &os, const IOMetrics_t &metrics);
@@ -0,0 +1,183 @@
+#include "logger.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+void Logger::start(LogLevel level, const std::string &path,
+                   LogFormat format) {
+  stop();
+
+  format_ = format;
+  if (path.empty()) {
+    out_ = &std::cout;
+  } else {
+    auto mode = std::ios::out | std::ios::trunc;
+    if (format == LogFormat::Binary) {
+      mode |= std::ios::binary;
+    }
+    file_.open(path, mode);
+    if (!file_.is_open()) {
+      throw std::runtime_error("Failed to open log file " + path);
+    }
+    out_ = &file_;
+  }
+
+  start_ns_ = monotonicNanos();
+  dropped_.store(0, std::memory_order_relaxed);
+  running_.store(true, std::memory_order_release);
+  writer_ = std::thread(&Logger::writerLoop, this);
+  setLevel(level);
+}
+
+void Logger::startFromEnvironment(LogLevel default_level) {
+  const char *level = std::getenv("SENSOR_LOG_LEVEL");
+  const char *path = std::getenv("SENSOR_LOG_FILE");
+  const char *format = std::getenv("SENSOR_LOG_FORMAT");
+
+  start(level ? parseLogLevel(level, default_level) : default_level,
+        path ? path : "",
+        (format && std::string(format) == "binary") ? LogFormat::Binary
+                                                    : LogFormat::Text);
+}
+
+void Logger::stop() {
+  if (!writer_.joinable()) {
+    return;
+  }
+
+  // anything logged after this point is discarded, anything before it gets
+  // written by the writer thread's final drain
+  setLevel(LogLevel::Off);
+  running_.store(false, std::memory_order_release);
+  wake();
+  writer_.join();
+
+  if (format_ == LogFormat::Text && dropped() > 0) {
+    *out_ << "log: " << dropped() << " records dropped" << std::endl;
+  }
+  out_->flush();
+  if (file_.is_open()) {
+    file_.close();
+  }
+  out_ = nullptr;
+}
+
+void Logger::text(LogLevel level, const char *msg) {
+  if (!enabled(level)) {
+    return;
+  }
+  LogRecord_t record = {};
+  record.time_ns = monotonicNanos();
+  record.type = LogRecordType::Text;
+  record.level = level;
+  record.length = std::min(std::strlen(msg), LOG_RECORD_PAYLOAD_SIZE);
+  std::memcpy(record.payload, msg, record.length);
+  push(record);
+}
+
+void Logger::writerLoop() {
+  LogRecord_t record;
+
+  while (true) {
+    // read the flag before draining, so a record pushed just before `stop()`
+    // is always picked up by one last pass
+    bool running = running_.load(std::memory_order_acquire);
+
+    bool wrote = false;
+    while (queue_.pop(record)) {
+      write(record);
+      wrote = true;
+    }
+
+    if (!running) {
+      return;
+    }
+    if (wrote) {
+      // only flush once the queue's been emptied, so a burst of records
+      // turns into a few big writes
+      out_->flush();
+    } else {
+      // nothing to do - sleep until there is. `idle_` goes up before the
+      // last look at the queue, see `push`.
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      idle_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      wake_cv_.wait(lock, [this] {
+        return !queue_.empty() || !running_.load(std::memory_order_acquire);
+      });
+      idle_.store(false, std::memory_order_relaxed);
+    }
+  }
+}
+
+void Logger::wake() {
+  // taking the lock means the writer is either yet to check for records, or
+  // already waiting - it can't be in between and miss the notify
+  { std::lock_guard<std::mutex> lock(wake_mutex_); }
+  wake_cv_.notify_one();
+}
+
+void Logger::write(const LogRecord_t &record) {
+  if (format_ == LogFormat::Binary) {
+    out_->write(reinterpret_cast<const char *>(&record), sizeof(record));
+    return;
+  }
+
+  auto &os = *out_;
+  double elapsed = (double)(record.time_ns - start_ns_) / 1e9;
+  os << "[" << std::fixed << std::setprecision(6) << elapsed
+     << std::defaultfloat << "] ";
+
+  switch (record.type) {
+  case LogRecordType::Text:
+    os.write(reinterpret_cast<const char *>(record.payload), record.length);
+    break;
+  case LogRecordType::Command: {
+    CommandRaw_t msg;
+    std::memcpy(&msg, record.payload, sizeof(msg));
+    formatMessage(os, msg);
+    break;
+  }
+  case LogRecordType::Response: {
+    ResponseRaw_t msg;
+    std::memcpy(&msg, record.payload, sizeof(msg));
+    formatMessage(os, msg);
+    break;
+  }
+  case LogRecordType::DataResponse: {
+    DataResponseRaw_t msg;
+    std::memcpy(&msg, record.payload, sizeof(msg));
+    formatMessage(os, msg);
+    break;
+  }
+  case LogRecordType::BurstHeader: {
+    BurstHeaderRaw_t msg;
+    std::memcpy(&msg, record.payload, sizeof(msg));
+    formatMessage(os, msg);
+    break;
+  }
+  }
+  os << '\n';
+}
+
+LogLevel parseLogLevel(const std::string &name, LogLevel fallback) {
+  if (name == "off") {
+    return LogLevel::Off;
+  } else if (name == "error") {
+    return LogLevel::Error;
+  } else if (name == "info") {
+    return LogLevel::Info;
+  } else if (name == "debug") {
+    return LogLevel::Debug;
+  } else if (name == "trace") {
+    return LogLevel::Trace;
+  }
+  return fallback;
+}
+
+Logger &logger() {
+  static Logger instance;
+  return instance;
+}
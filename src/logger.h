@@ -0,0 +1,179 @@
+#pragma once
+#include "clock.h"
+#include "message_coder.h"
+#include "mpsc_queue.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// how chatty to be - a record is kept if its level is at or below the
+// logger's. Individual frames are logged at Debug.
+enum class LogLevel : uint8_t {
+  Off,
+  Error,
+  Info,
+  Debug,
+  Trace,
+};
+
+// what's in a record's payload
+enum class LogRecordType : uint8_t {
+  Text,
+  Command,
+  Response,
+  DataResponse,
+  BurstHeader,
+};
+
+// how records get written out - Binary dumps the raw records, which is
+// cheapest of all and can be decoded offline
+enum class LogFormat {
+  Text,
+  Binary,
+};
+
+// big enough for any frame struct, longer text is truncated
+const size_t LOG_RECORD_PAYLOAD_SIZE = 48;
+
+// must be a power of two
+const size_t LOG_QUEUE_SIZE = 4096;
+
+// what actually goes through the queue - fixed size, so logging a frame is
+// just a timestamp and a memcpy
+struct LogRecord {
+  uint64_t time_ns;
+  LogRecordType type;
+  LogLevel level;
+  uint8_t length;
+  uint8_t payload[LOG_RECORD_PAYLOAD_SIZE];
+} typedef LogRecord_t;
+
+template <typename T> constexpr LogRecordType logRecordType();
+template <> constexpr LogRecordType logRecordType<CommandRaw_t>() {
+  return LogRecordType::Command;
+}
+template <> constexpr LogRecordType logRecordType<ResponseRaw_t>() {
+  return LogRecordType::Response;
+}
+template <> constexpr LogRecordType logRecordType<DataResponseRaw_t>() {
+  return LogRecordType::DataResponse;
+}
+template <> constexpr LogRecordType logRecordType<BurstHeaderRaw_t>() {
+  return LogRecordType::BurstHeader;
+}
+
+// asynchronous logger
+//
+// producers (any thread) copy a compact record into a lock-free queue and
+// move on; a background thread does the formatting and the actual IO. If the
+// writer falls behind, records are dropped (and counted) rather than
+// blocking the caller. When there's nothing to write the writer sleeps until
+// a producer wakes it, which only costs the producer anything if it's the one
+// that finds the writer asleep. Until `start()` is called everything is
+// discarded at the cost of one relaxed load.
+class Logger {
+public:
+  Logger()
+      : level_(LogLevel::Off), dropped_(0), running_(false), idle_(false),
+        format_(LogFormat::Text), out_(nullptr), start_ns_(0){};
+  ~Logger() { stop(); };
+
+  Logger(const Logger &) = delete;
+  Logger &operator=(const Logger &) = delete;
+
+  // Start the writer thread, logging to `path` (stdout if empty)
+  void start(LogLevel level, const std::string &path = "",
+             LogFormat format = LogFormat::Text);
+
+  // Start using the SENSOR_LOG_LEVEL (off/error/info/debug/trace),
+  // SENSOR_LOG_FILE and SENSOR_LOG_FORMAT (text/binary) environment
+  // variables, falling back to `default_level` and stdout
+  void startFromEnvironment(LogLevel default_level);
+
+  // Write out whatever is still queued and stop the writer thread
+  void stop();
+
+  void setLevel(LogLevel level) {
+    level_.store(level, std::memory_order_relaxed);
+  };
+  LogLevel level() const { return level_.load(std::memory_order_relaxed); };
+
+  bool enabled(LogLevel level) const {
+    return level != LogLevel::Off &&
+           level <= level_.load(std::memory_order_relaxed);
+  };
+
+  // Log one decoded frame
+  template <typename T> void frame(LogLevel level, const T &msg) {
+    static_assert(sizeof(T) <= LOG_RECORD_PAYLOAD_SIZE,
+                  "frame doesn't fit in a log record");
+    if (!enabled(level)) {
+      return;
+    }
+    // zeroed, so binary logs don't pick up whatever was in the padding
+    LogRecord_t record = {};
+    record.time_ns = monotonicNanos();
+    record.type = logRecordType<T>();
+    record.level = level;
+    record.length = sizeof(T);
+    std::memcpy(record.payload, &msg, sizeof(T));
+    push(record);
+  };
+
+  // Log a short message - anything past LOG_RECORD_PAYLOAD_SIZE is cut off
+  void text(LogLevel level, const char *msg);
+
+  // records thrown away because the queue was full
+  size_t dropped() const { return dropped_.load(std::memory_order_relaxed); };
+
+private:
+  void push(const LogRecord_t &record) {
+    if (!queue_.push(record)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    // pairs with the fence in `writerLoop` - either it sees this record
+    // before going to sleep, or we see it's asleep and wake it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_.load(std::memory_order_relaxed)) {
+      wake();
+    }
+  };
+
+  // get the writer thread out of its idle wait
+  void wake();
+
+  void writerLoop();
+  void write(const LogRecord_t &record);
+
+  MpscQueue<LogRecord_t, LOG_QUEUE_SIZE> queue_;
+  std::atomic<LogLevel> level_;
+  std::atomic<size_t> dropped_;
+  std::atomic<bool> running_;
+  std::thread writer_;
+
+  // the writer thread waits on `wake_cv_` when there's nothing to write,
+  // with `idle_` set so producers know to signal it
+  std::atomic<bool> idle_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+
+  // only touched by the writer thread while it's running
+  LogFormat format_;
+  std::ofstream file_;
+  std::ostream *out_;
+  uint64_t start_ns_;
+};
+
+// Parses off/error/info/debug/trace, returns `fallback` for anything else
+LogLevel parseLogLevel(const std::string &name, LogLevel fallback);
+
+// the process-wide logger the sim and driver log through
+Logger &logger();
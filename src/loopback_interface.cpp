@@ -0,0 +1,216 @@
+#include "loopback_interface.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+LoopbackChannel::LoopbackChannel()
+    : head_(0), tail_(0), writer_closed_(false), reader_closed_(false),
+      wakeups_(true) {
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_fd_ < 0) {
+    throw std::runtime_error("Failed to create loopback eventfd");
+  }
+  space_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (space_fd_ < 0) {
+    close(event_fd_);
+    throw std::runtime_error("Failed to create loopback eventfd");
+  }
+}
+
+LoopbackChannel::~LoopbackChannel() {
+  close(event_fd_);
+  close(space_fd_);
+}
+
+size_t LoopbackChannel::write(const uint8_t *data, size_t len) {
+  size_t tail = tail_.load(std::memory_order_relaxed);
+  size_t head = head_.load(std::memory_order_acquire);
+  len = std::min(len, LOOPBACK_BUFFER_SIZE - (tail - head));
+  if (len == 0) {
+    return 0;
+  }
+
+  size_t start = tail & MASK;
+  size_t first = std::min(len, LOOPBACK_BUFFER_SIZE - start);
+  std::memcpy(&buf_[start], data, first);
+  std::memcpy(&buf_[0], data + first, len - first);
+  tail_.store(tail + len, std::memory_order_release);
+
+  // if the reader had caught up with everything before this write, it may be
+  // waiting (or about to) - pairs with the fence in `waitReadable`, so either
+  // we see it caught up, or it sees this write
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (head_.load(std::memory_order_relaxed) == tail &&
+      wakeups_.load(std::memory_order_relaxed)) {
+    signal(event_fd_);
+  }
+  return len;
+}
+
+size_t LoopbackChannel::read(uint8_t *dst, size_t len) {
+  size_t head = head_.load(std::memory_order_relaxed);
+  size_t tail = tail_.load(std::memory_order_acquire);
+  len = std::min(len, tail - head);
+  if (len == 0) {
+    return 0;
+  }
+
+  size_t start = head & MASK;
+  size_t first = std::min(len, LOOPBACK_BUFFER_SIZE - start);
+  std::memcpy(dst, &buf_[start], first);
+  std::memcpy(dst + first, &buf_[0], len - first);
+  head_.store(head + len, std::memory_order_release);
+
+  // the same the other way round - if the ring was full before this read,
+  // the writer may be waiting for room
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (tail_.load(std::memory_order_relaxed) - head == LOOPBACK_BUFFER_SIZE) {
+    signal(space_fd_);
+  }
+  return len;
+}
+
+bool LoopbackChannel::waitReadable(Deadline deadline) {
+  return waitFor(event_fd_, deadline,
+                 [this] { return size() > 0 || writerClosed(); });
+}
+
+bool LoopbackChannel::waitWritable(Deadline deadline) {
+  return waitFor(space_fd_, deadline, [this] {
+    return size() < LOOPBACK_BUFFER_SIZE || readerClosed();
+  });
+}
+
+template <typename Ready>
+bool LoopbackChannel::waitFor(int fd, Deadline deadline, Ready ready) {
+  while (true) {
+    if (ready()) {
+      return true;
+    }
+
+    // clear any stale wakeup, then look again - a write (or read) landing in
+    // between signals afresh, so it can't be missed
+    uint64_t count;
+    ssize_t ret = ::read(fd, &count, sizeof(count));
+    (void)ret;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ready()) {
+      return true;
+    }
+
+    int timeout_ms = -1;
+    if (deadline != NO_DEADLINE) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (remaining.count() < 0) {
+        return false;
+      }
+      // round up, so we don't spin on a sub-millisecond remainder
+      timeout_ms = remaining.count() + 1;
+    }
+
+    struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+    int polled = poll(&pfd, 1, timeout_ms);
+    if (polled < 0 && errno != EINTR) {
+      throw std::runtime_error("Failed to poll loopback");
+    }
+    if (polled == 0 && std::chrono::steady_clock::now() >= deadline) {
+      return ready();
+    }
+  }
+}
+
+void LoopbackChannel::setWriterClosed(bool closed) {
+  writer_closed_.store(closed, std::memory_order_release);
+  if (closed) {
+    signal(event_fd_);
+  }
+}
+
+void LoopbackChannel::setReaderClosed(bool closed) {
+  reader_closed_.store(closed, std::memory_order_release);
+  if (closed) {
+    signal(space_fd_);
+  }
+}
+
+void LoopbackChannel::signal(int fd) {
+  uint64_t one = 1;
+  ssize_t ret = ::write(fd, &one, sizeof(one));
+  // EAGAIN means the counter's already maxed out - signalled all the same
+  (void)ret;
+}
+
+LoopbackInterface::~LoopbackInterface() { shutdown(); }
+
+void LoopbackInterface::init() {
+  rx_.setReaderClosed(false);
+  tx_.setWriterClosed(false);
+}
+
+void LoopbackInterface::shutdown() {
+  rx_.setReaderClosed(true);
+  tx_.setWriterClosed(true);
+}
+
+SendResult LoopbackInterface::writeFrom(const struct iovec *iov, int iovcnt,
+                                        Deadline deadline) {
+  size_t sent = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    auto result = sendAll(static_cast<const uint8_t *>(iov[i].iov_base),
+                          iov[i].iov_len, deadline);
+    sent += result.bytes;
+    if (result.status != IOStatus::Ok) {
+      return SendResult{.bytes = sent, .status = result.status};
+    }
+  }
+  return SendResult{.bytes = sent, .status = IOStatus::Ok};
+}
+
+SendResult LoopbackInterface::sendAll(const uint8_t *data, size_t len,
+                                      Deadline deadline) {
+  size_t sent = 0;
+  while (true) {
+    if (tx_.readerClosed()) {
+      return SendResult{.bytes = sent, .status = IOStatus::Closed};
+    }
+    size_t n = tx_.write(data + sent, len - sent);
+    sent += n;
+    if (sent == len) {
+      return SendResult{.bytes = sent, .status = IOStatus::Ok};
+    }
+
+    // the other end isn't keeping up - wait for it to make room (if there's
+    // any time to)
+    if (std::chrono::steady_clock::now() >= deadline ||
+        !tx_.waitWritable(deadline)) {
+      return SendResult{.bytes = sent, .status = IOStatus::Timeout};
+    }
+  }
+}
+
+ReceiveResult LoopbackInterface::readInto(std::span<uint8_t> buffer,
+                                          Deadline deadline) {
+  if (buffer.empty()) {
+    return ReceiveResult{.bytes = 0, .status = IOStatus::Ok};
+  }
+
+  while (true) {
+    size_t len = rx_.read(buffer.data(), buffer.size());
+    if (len > 0) {
+      return ReceiveResult{.bytes = len, .status = IOStatus::Ok};
+    }
+    // check for data once more after seeing the close, in case it was sent
+    // just before
+    if (rx_.writerClosed() && rx_.size() == 0) {
+      return ReceiveResult{.bytes = 0, .status = IOStatus::Closed};
+    }
+    if (!rx_.waitReadable(deadline)) {
+      return ReceiveResult{.bytes = 0, .status = IOStatus::Timeout};
+    }
+  }
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include "io_interface.h"
+#include "spsc_queue.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// bytes buffered in each direction of a loopback link - must be a power of
+// two
+const size_t LOOPBACK_BUFFER_SIZE = 1 << 16;
+
+// one direction of a loopback link: a lock-free single-producer/single-
+// consumer byte ring, plus an eventfd the writer signals so the reader can
+// poll (or epoll) for input like it would a port, and another the reader
+// signals so a writer that filled the ring can wait for room
+//
+// the writer only signals when the ring may have been empty - i.e. when the
+// reader may be about to wait - and the reader only when it may have been
+// full, so a steady stream costs no syscalls
+class LoopbackChannel {
+public:
+  LoopbackChannel();
+  ~LoopbackChannel();
+
+  LoopbackChannel(const LoopbackChannel &) = delete;
+  LoopbackChannel &operator=(const LoopbackChannel &) = delete;
+
+  // writer: append as much of `data` as fits, returns how much did
+  size_t write(const uint8_t *data, size_t len);
+
+  // reader: take up to `len` bytes into `dst`, returns how many
+  size_t read(uint8_t *dst, size_t len);
+
+  // reader: drop everything buffered
+  void discard() {
+    head_.store(tail_.load(std::memory_order_acquire),
+                std::memory_order_release);
+  };
+
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  };
+
+  // reader: wait until there's something to read (or the writer has gone),
+  // false if `deadline` passed first
+  bool waitReadable(Deadline deadline);
+
+  // writer: wait until there's room to write (or the reader has gone), false
+  // if `deadline` passed first
+  bool waitWritable(Deadline deadline);
+
+  // either end going away - the reader sees Closed once it has drained what
+  // was sent, the writer as soon as the reader has gone
+  void setWriterClosed(bool closed);
+  void setReaderClosed(bool closed);
+  bool writerClosed() const {
+    return writer_closed_.load(std::memory_order_acquire);
+  };
+  bool readerClosed() const {
+    return reader_closed_.load(std::memory_order_acquire);
+  };
+
+  // polls readable when the reader should look at the ring
+  int fd() const { return event_fd_; };
+
+  // whether writes signal `fd()` - a reader that never waits on it can turn
+  // that off and save the writer a syscall per burst of data
+  void setWakeups(bool enabled) {
+    wakeups_.store(enabled, std::memory_order_relaxed);
+  };
+
+private:
+  static const size_t MASK = LOOPBACK_BUFFER_SIZE - 1;
+  static_assert((LOOPBACK_BUFFER_SIZE & MASK) == 0,
+                "LOOPBACK_BUFFER_SIZE must be a power of two");
+
+  // Wake the reader (or writer) up through `fd`
+  static void signal(int fd);
+
+  // Wait on `fd` until `ready()`, or `deadline` - both ends' waits
+  template <typename Ready>
+  static bool waitFor(int fd, Deadline deadline, Ready ready);
+
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_;
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_;
+  alignas(CACHE_LINE_SIZE) std::atomic<bool> writer_closed_;
+  std::atomic<bool> reader_closed_;
+  std::atomic<bool> wakeups_;
+  int event_fd_;
+  int space_fd_;
+  alignas(CACHE_LINE_SIZE) std::array<uint8_t, LOOPBACK_BUFFER_SIZE> buf_;
+};
+
+// one end of an in-memory link - reads from `rx`, writes to `tx`
+//
+// no kernel in the data path (apart from the odd wakeup), so a `SensorSim`
+// and `SensorDriver` connected through a `LoopbackLink` measure the cost of
+// the code itself rather than the tty layer
+class LoopbackInterface final : public IOInterface {
+public:
+  LoopbackInterface(LoopbackChannel &rx, LoopbackChannel &tx)
+      : rx_(rx), tx_(tx){};
+
+  // Destructor. Runs shutdown().
+  ~LoopbackInterface();
+
+  void init() override;
+  void shutdown() override;
+
+  int availableBytes() override { return rx_.size(); };
+
+  using IOInterface::waitReadable;
+  bool waitReadable(Deadline deadline) override {
+    return rx_.waitReadable(deadline);
+  };
+
+  void flush() override { rx_.discard(); };
+
+  int fd() const override { return rx_.fd(); };
+
+  // Whether input arriving wakes up `fd()`/`waitReadable()` - only for a
+  // reader that never waits for input, see `LoopbackChannel::setWakeups`
+  void setWakeups(bool enabled) { rx_.setWakeups(enabled); };
+
+protected:
+  ReceiveResult readInto(std::span<uint8_t> buffer,
+                         Deadline deadline) override;
+  SendResult writeFrom(const struct iovec *iov, int iovcnt,
+                       Deadline deadline) override;
+
+private:
+  // Send all of `data`, waiting for room as needed
+  SendResult sendAll(const uint8_t *data, size_t len, Deadline deadline);
+
+  LoopbackChannel &rx_;
+  LoopbackChannel &tx_;
+};
+
+// two `LoopbackInterface`s wired back to back - whatever is sent on one is
+// received on the other
+class LoopbackLink {
+public:
+  LoopbackLink()
+      : first_(second_to_first_, first_to_second_),
+        second_(first_to_second_, second_to_first_){};
+
+  LoopbackInterface &first() { return first_; };
+  LoopbackInterface &second() { return second_; };
+
+private:
+  LoopbackChannel first_to_second_;
+  LoopbackChannel second_to_first_;
+  LoopbackInterface first_;
+  LoopbackInterface second_;
+};
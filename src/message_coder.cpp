@@ -1,103 +1,210 @@
 #include "message_coder.h"
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
-#include <stdexcept>
 #include <vector>
 
-template <>
-std::vector<uint8_t> MessageCoder<CommandRaw_t>::frame(CommandRaw_t &payload) {
-  std::vector<uint8_t> output = {payload.addr, payload.data, payload.delim};
+template <typename T>
+std::vector<uint8_t> MessageCoder<T>::frame(T &payload) {
+  std::vector<uint8_t> output(WireLayout<T>::size);
+  WireLayout<T>::encode(payload, output.data());
   return output;
 }
 
-template <>
-std::vector<uint8_t>
-MessageCoder<ResponseRaw_t>::frame(ResponseRaw_t &payload) {
-  std::vector<uint8_t> output = {payload.addr, payload.data, payload.delim};
-  return output;
+template <typename T>
+size_t MessageCoder<T>::frame(const T &payload, std::span<uint8_t> out) {
+  if (out.size() < WireLayout<T>::size) {
+    return 0;
+  }
+  WireLayout<T>::encode(payload, out.data());
+  return WireLayout<T>::size;
 }
 
-template <>
-std::vector<uint8_t>
-MessageCoder<DataResponseRaw_t>::frame(DataResponseRaw_t &payload) {
-  // I don't know that this works if structs are unpacked - alternative to be
-  // safe is just manually casting struct elements
-  auto ptr = reinterpret_cast<uint8_t *>(&payload);
-  std::vector<uint8_t> output(ptr, ptr + sizeof(payload));
-  return output;
+size_t resyncOffset(const ByteRing &ring, uint8_t delim, size_t min_length,
+                    size_t max_length) {
+  // any frame starting at offset >= 1 has its delimiter at offset >=
+  // `min_length`, so the first delimiter from there on bounds how far we can
+  // skip: no frame can start more than `max_length - 1` before it. No
+  // delimiter at all means only a frame still arriving could be in there.
+  size_t delim_at = ring.find(delim, min_length);
+  size_t skip = delim_at >= max_length - 1 ? delim_at - (max_length - 1) : 0;
+  return std::max<size_t>(skip, 1);
+}
+
+void resyncTo(ByteRing &ring, uint8_t delim, size_t min_length,
+              size_t max_length) {
+  ring.consume(resyncOffset(ring, delim, min_length, max_length));
 }
 
 template <typename T>
-std::vector<T> MessageCoder<T>::deFrame(std::vector<uint8_t> &data) {
-  if (data.size() < frame_length_) {
-    throw std::runtime_error("not enough data");
+size_t MessageCoder<T>::deFrame(ByteRing &ring, T *out, size_t max_payloads) {
+  size_t count = 0;
+
+  while (count < max_payloads && ring.size() >= frame_length_) {
+    // a frame is `frame_length_` bytes ending in the delimiter - if the byte
+    // where the delimiter should be isn't one, we're out of sync, so skip
+    // ahead to the next place one could start and try again
+    if (!frameAt(ring)) {
+      resync(ring);
+      continue;
+    }
+
+    decodeFrame(ring, out[count]);
+    count++;
   }
 
-  std::vector<T> resps;
-  std::vector<uint8_t> buffer;
+  return count;
+}
 
-  // for each byte in input buffer...
-  for (auto &item : data) {
+// where the header's flags and sample count sit on the wire
+const size_t BURST_FLAGS_OFFSET = 1;
+const size_t BURST_SAMPLES_OFFSET = 2;
 
-    // add it to a sub-buffer...
-    buffer.push_back(item);
+size_t BurstCoder::frame(const BurstHeaderRaw_t &header, int16_t temperature,
+                         std::span<const BurstSampleRaw_t> samples,
+                         std::span<uint8_t> out) const {
+  size_t length = burstFrameLength(header.flags, samples.size());
+  if (out.size() < length) {
+    return 0;
+  }
 
-    // if this byte happens to be the delimiter *and*
-    // the sub-buffer is at the right size for our message type...
-    if ((item == delim_) && (buffer.size() == frame_length_)) {
-      // parse the sub-buffer into a struct, add it to the stack, and go again
-      auto data_resp = reinterpret_cast<T *>(&buffer[0]);
-      resps.push_back(data_resp[0]);
-      buffer.clear();
-    }
+  uint8_t *at = out.data();
+  WireLayout<BurstHeaderRaw_t>::encode(header, at);
+  at += WireLayout<BurstHeaderRaw_t>::size;
+  *at++ = delim_;
+  if (header.flags & BURST_FLAG_TEMPERATURE) {
+    storeBigEndian(temperature, at);
+    at += sizeof(temperature);
+  }
+  for (auto &sample : samples) {
+    WireLayout<BurstSampleRaw_t>::encode(sample, at);
+    at += WireLayout<BurstSampleRaw_t>::size;
   }
+  *at = delim_;
+  return length;
+}
+
+size_t BurstCoder::frameLengthAt(const ByteRing &ring) const {
+  if (ring.size() < BURST_HEADER_LENGTH) {
+    return 0;
+  }
+  // only the flags, sample count and the header's delimiter matter here -
+  // anything off is junk, and shouldn't have us waiting on a frame that's
+  // never coming
+  uint8_t flags = ring.peek(BURST_FLAGS_OFFSET);
+  uint8_t samples = ring.peek(BURST_SAMPLES_OFFSET);
+  if (ring.peek(BURST_HEADER_LENGTH - 1) != delim_ ||
+      (flags & ~BURST_FLAG_TEMPERATURE) != 0 || samples == 0 ||
+      samples > BURST_MAX_SAMPLES) {
+    return 0;
+  }
+  return burstFrameLength(flags, samples);
+}
 
-  // clear the input buffer, even if there are remaining bytes
-  // This is probably catastrophically not correct, but I'd need more time to
-  // come up with the right behavior here.
-  data.clear();
+void BurstCoder::decodeFrame(ByteRing &ring, BurstFrame_t &out) const {
+  size_t length = frameLengthAt(ring);
 
-  return resps;
+  // same as MessageCoder - straight out of the ring unless it wraps
+  uint8_t gathered[BURST_MAX_FRAME_LENGTH];
+  const uint8_t *at = ring.contiguous(0, length);
+  if (!at) {
+    ring.copyOut(0, gathered, length);
+    at = gathered;
+  }
+
+  WireLayout<BurstHeaderRaw_t>::decode(at, out.header);
+  at += BURST_HEADER_LENGTH;
+  out.temperature = 0;
+  if (out.header.flags & BURST_FLAG_TEMPERATURE) {
+    out.temperature = loadBigEndian<int16_t>(at);
+    at += sizeof(out.temperature);
+  }
+  for (size_t i = 0; i < out.header.samples; i++) {
+    WireLayout<BurstSampleRaw_t>::decode(at, out.samples[i]);
+    at += WireLayout<BurstSampleRaw_t>::size;
+  }
+  ring.consume(length);
 }
 
-// Specialize templates for `deFrame`
-template std::vector<ResponseRaw_t>
-MessageCoder<ResponseRaw_t>::deFrame(std::vector<uint8_t> &data);
-template std::vector<DataResponseRaw_t>
-MessageCoder<DataResponseRaw_t>::deFrame(std::vector<uint8_t> &data);
-template std::vector<CommandRaw_t>
-MessageCoder<CommandRaw_t>::deFrame(std::vector<uint8_t> &data);
+// Specialize templates for `frame`...
+template std::vector<uint8_t>
+MessageCoder<CommandRaw_t>::frame(CommandRaw_t &payload);
+template std::vector<uint8_t>
+MessageCoder<ResponseRaw_t>::frame(ResponseRaw_t &payload);
+template std::vector<uint8_t>
+MessageCoder<DataResponseRaw_t>::frame(DataResponseRaw_t &payload);
+template size_t MessageCoder<CommandRaw_t>::frame(const CommandRaw_t &payload,
+                                                  std::span<uint8_t> out);
+template size_t MessageCoder<ResponseRaw_t>::frame(const ResponseRaw_t &payload,
+                                                   std::span<uint8_t> out);
+template size_t
+MessageCoder<DataResponseRaw_t>::frame(const DataResponseRaw_t &payload,
+                                       std::span<uint8_t> out);
+
+// ... and `deFrame`
+template size_t MessageCoder<ResponseRaw_t>::deFrame(ByteRing &ring,
+                                                     ResponseRaw_t *out,
+                                                     size_t max_payloads);
+template size_t MessageCoder<DataResponseRaw_t>::deFrame(ByteRing &ring,
+                                                         DataResponseRaw_t *out,
+                                                         size_t max_payloads);
+template size_t MessageCoder<CommandRaw_t>::deFrame(ByteRing &ring,
+                                                    CommandRaw_t *out,
+                                                    size_t max_payloads);
 
 // helper functions to print structs
-template <> void printMessage(CommandRaw_t &data) {
-  std::cout << "command: addr: ";
-  std::cout << std::hex << (int)data.addr << std::dec;
-  std::cout << ", data: ";
-  std::cout << std::hex << (int)data.data << std::dec;
-  std::cout << ", delim: ";
-  std::cout << std::hex << (int)data.delim << std::dec << std::endl;
+template <> void formatMessage(std::ostream &os, const CommandRaw_t &data) {
+  os << "command: addr: ";
+  os << std::hex << (int)data.addr << std::dec;
+  os << ", data: ";
+  os << std::hex << (int)data.data << std::dec;
+  os << ", delim: ";
+  os << std::hex << (int)data.delim << std::dec;
+}
+
+template <> void formatMessage(std::ostream &os, const ResponseRaw_t &data) {
+  os << "response: addr: ";
+  os << std::hex << (int)data.addr << std::dec;
+  os << ", data: ";
+  os << std::hex << (int)data.data << std::dec;
+  os << ", delim: ";
+  os << std::hex << (int)data.delim << std::dec;
+}
+
+template <>
+void formatMessage(std::ostream &os, const DataResponseRaw_t &data) {
+  os << "data: addr: ";
+  os << std::hex << (int)data.addr << std::dec;
+  os << ", count: ";
+  os << data.count;
+  os << ", x_rate: ";
+  os << data.x_rate;
+  os << ", y_rate: ";
+  os << data.y_rate;
+  os << ", z_rate: ";
+  os << data.z_rate;
+  os << ", delim: ";
+  os << std::hex << (int)data.delim << std::dec;
 }
 
-template <> void printMessage(ResponseRaw_t &data) {
-  std::cout << "response: addr: ";
-  std::cout << std::hex << (int)data.addr << std::dec;
-  std::cout << ", data: ";
-  std::cout << std::hex << (int)data.data << std::dec;
-  std::cout << ", delim: ";
-  std::cout << std::hex << (int)data.delim << std::dec << std::endl;
+template <>
+void formatMessage(std::ostream &os, const BurstHeaderRaw_t &data) {
+  os << "burst: addr: ";
+  os << std::hex << (int)data.addr << std::dec;
+  os << ", flags: ";
+  os << std::hex << (int)data.flags << std::dec;
+  os << ", samples: ";
+  os << (int)data.samples;
+  os << ", count: ";
+  os << data.count;
 }
 
-template <> void printMessage(DataResponseRaw_t &data) {
-  std::cout << "data: addr: ";
-  std::cout << std::hex << (int)data.addr << std::dec;
-  std::cout << ", count: ";
-  std::cout << data.count << std::dec;
-  std::cout << ", x_rate: ";
-  std::cout << data.x_rate << std::dec;
-  std::cout << ", y_rate: ";
-  std::cout << data.y_rate << std::dec;
-  std::cout << ", z_rate: ";
-  std::cout << data.z_rate << std::dec;
-  std::cout << ", delim: ";
-  std::cout << std::hex << (int)data.delim << std::dec << std::endl;
+template <typename T> void printMessage(T &data) {
+  formatMessage(std::cout, data);
+  std::cout << std::endl;
 }
+
+template void printMessage(CommandRaw_t &data);
+template void printMessage(ResponseRaw_t &data);
+template void printMessage(DataResponseRaw_t &data);
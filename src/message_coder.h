@@ -1,18 +1,34 @@
 #pragma once
+#include "byte_ring.h"
+#include "frame_layout.h"
 #include "io_interface.h"
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <deque>
+#include <ostream>
+#include <span>
 #include <string>
 #include <vector>
 
+// The earliest offset (at least 1) from the head of `ring` that a frame
+// between `min_length` and `max_length` long, ending in `delim`, could start
+// at. Only the delimiter is checked - the caller re-validates there.
+size_t resyncOffset(const ByteRing &ring, uint8_t delim, size_t min_length,
+                    size_t max_length);
+
+// Drops bytes off the head of `ring` up to `resyncOffset`
+void resyncTo(ByteRing &ring, uint8_t delim, size_t min_length,
+              size_t max_length);
+
 // handles any special data formatting / framing / de-framing
 // e.g. SLIP or something more specialized
-// in this case it just serializes structs into byte vectors
-// with a constant delimiter
+// in this case it serializes structs field by field, as described by their
+// `WireLayout`, with a constant delimiter
 template <typename T> class MessageCoder {
 public:
   MessageCoder(uint8_t delimiter)
-      : delim_(delimiter), frame_length_(sizeof(T)){};
+      : delim_(delimiter), frame_length_(WireLayout<T>::size){};
 
   MessageCoder(uint8_t delimiter, uint8_t frame_length)
       : delim_(delimiter), frame_length_(frame_length){};
@@ -20,10 +36,50 @@ public:
   // Returns a frame created from `payload`
   std::vector<uint8_t> frame(T &payload);
 
-  // Returns a vector of payloads extracted from `data`
-  std::vector<T> deFrame(std::vector<uint8_t> &data);
+  // Writes the frame for `payload` into `out` without allocating, returns the
+  // number of bytes written (0 if `out` is too small)
+  size_t frame(const T &payload, std::span<uint8_t> out);
+
+  // Decodes up to `max_payloads` payloads out of `ring` into `out`, returning
+  // how many were written. Decoded frames (and any garbage skipped while
+  // looking for them) are consumed; a trailing partial frame is left in `ring`
+  // so the next call can finish it.
+  size_t deFrame(ByteRing &ring, T *out, size_t max_payloads);
+
+  // Whether `ring` starts with a complete, delimited frame of this type
+  bool frameAt(const ByteRing &ring) const {
+    return ring.size() >= frame_length_ &&
+           ring.peek(frame_length_ - 1) == delim_;
+  };
+
+  // Drops bytes off the head of `ring` up to the next place a frame could
+  // start, given the head doesn't. Finds the next delimiter with a vectorized
+  // scan, so clearing a backlog of junk doesn't go a byte at a time.
+  void resync(ByteRing &ring) const {
+    resyncTo(ring, delim_, frame_length_, frame_length_);
+  };
 
-  auto getFrameLength() { return frame_length_; };
+  // Decodes the frame at the head of `ring` into `out` and consumes it.
+  // Only valid if `frameAt(ring)`. Inline, as it's the per-frame hot path.
+  void decodeFrame(ByteRing &ring, T &out) {
+    // decode straight out of the ring storage, unless the frame wraps around
+    // its end (or is short), in which case gather it into one piece first
+    const uint8_t *bytes = nullptr;
+    if (frame_length_ >= WireLayout<T>::size) {
+      bytes = ring.contiguous(0, WireLayout<T>::size);
+    }
+    if (!bytes) {
+      uint8_t gathered[WireLayout<T>::size] = {};
+      ring.copyOut(0, gathered, std::min(frame_length_, WireLayout<T>::size));
+      WireLayout<T>::decode(gathered, out);
+    } else {
+      WireLayout<T>::decode(bytes, out);
+    }
+    ring.consume(frame_length_);
+  };
+
+  auto getFrameLength() const { return frame_length_; };
+  auto getDelimiter() const { return delim_; };
 
 private:
   uint8_t delim_;
@@ -42,6 +98,8 @@ struct ResponseRaw {
   uint8_t delim;
 } typedef ResponseRaw_t;
 
+// packed so it can be logged/copied as one block - the wire format comes from
+// its `WireLayout` either way
 #pragma pack(push, 1)
 struct DataResponseRaw {
   uint8_t addr;
@@ -53,4 +111,142 @@ struct DataResponseRaw {
 } typedef DataResponseRaw_t;
 #pragma pack(pop)
 
+// wire formats - every field big-endian, in this order
+template <>
+struct WireLayout<CommandRaw_t>
+    : FrameLayout<Field<&CommandRaw_t::addr>, Field<&CommandRaw_t::data>,
+                  Field<&CommandRaw_t::delim>> {};
+
+template <>
+struct WireLayout<ResponseRaw_t>
+    : FrameLayout<Field<&ResponseRaw_t::addr>, Field<&ResponseRaw_t::data>,
+                  Field<&ResponseRaw_t::delim>> {};
+
+template <>
+struct WireLayout<DataResponseRaw_t>
+    : FrameLayout<
+          Field<&DataResponseRaw_t::addr>, Field<&DataResponseRaw_t::count>,
+          Field<&DataResponseRaw_t::x_rate>, Field<&DataResponseRaw_t::y_rate>,
+          Field<&DataResponseRaw_t::z_rate>, Field<&DataResponseRaw_t::delim>> {
+};
+
+// burst frames carry several samples at once, like the G370's burst mode:
+//
+//   header | delim | temperature (if BURST_FLAG_TEMPERATURE) | samples... |
+//   delim
+//
+// the header says how many samples follow (each just the three rates - their
+// counts run on from the header's) and which optional fields are present, so
+// the frame describes its own length. It gets a delimiter of its own, so a
+// stray BURST_DATA_REG byte is caught as soon as the header is in, rather
+// than once we've waited on a frame's worth of bytes that never comes.
+struct BurstHeaderRaw {
+  uint8_t addr; // BURST_DATA_REG
+  uint8_t flags;
+  uint8_t samples;
+  uint16_t count; // of the first sample
+} typedef BurstHeaderRaw_t;
+
+struct BurstSampleRaw {
+  float x_rate;
+  float y_rate;
+  float z_rate;
+} typedef BurstSampleRaw_t;
+
+// most samples one burst frame can carry
+const size_t BURST_MAX_SAMPLES = 32;
+
+// burst header flags
+const uint8_t BURST_FLAG_TEMPERATURE = 0x01; // a temperature field follows
+
+// temperatures are sent as signed 8.8 fixed point degrees C
+const double BURST_TEMPERATURE_SCALE = 256.0;
+
+// big-endian, in this order, same as the other frames
+template <>
+struct WireLayout<BurstHeaderRaw_t>
+    : FrameLayout<Field<&BurstHeaderRaw_t::addr>,
+                  Field<&BurstHeaderRaw_t::flags>,
+                  Field<&BurstHeaderRaw_t::samples>,
+                  Field<&BurstHeaderRaw_t::count>> {};
+
+template <>
+struct WireLayout<BurstSampleRaw_t>
+    : FrameLayout<Field<&BurstSampleRaw_t::x_rate>,
+                  Field<&BurstSampleRaw_t::y_rate>,
+                  Field<&BurstSampleRaw_t::z_rate>> {};
+
+// bytes up to and including the header's delimiter
+const size_t BURST_HEADER_LENGTH = WireLayout<BurstHeaderRaw_t>::size + 1;
+
+// Length of a burst frame with `flags` and `samples`
+constexpr size_t burstFrameLength(uint8_t flags, size_t samples) {
+  return BURST_HEADER_LENGTH +
+         (flags & BURST_FLAG_TEMPERATURE ? sizeof(int16_t) : 0) +
+         samples * WireLayout<BurstSampleRaw_t>::size + 1;
+}
+
+const size_t BURST_MIN_FRAME_LENGTH = burstFrameLength(0, 1);
+const size_t BURST_MAX_FRAME_LENGTH =
+    burstFrameLength(BURST_FLAG_TEMPERATURE, BURST_MAX_SAMPLES);
+
+// a decoded burst frame
+struct BurstFrame {
+  BurstHeaderRaw_t header;
+  int16_t temperature; // 8.8 fixed point, only if the header's flags say so
+  std::array<BurstSampleRaw_t, BURST_MAX_SAMPLES> samples;
+} typedef BurstFrame_t;
+
+// MessageCoder's counterpart for burst frames, which vary in length
+class BurstCoder {
+public:
+  BurstCoder(uint8_t delimiter) : delim_(delimiter){};
+
+  // Writes a frame of `header` (whose `samples` must match `samples`),
+  // `temperature` if `header` flags it, and `samples` into `out`. Returns the
+  // number of bytes written (0 if `out` is too small).
+  size_t frame(const BurstHeaderRaw_t &header, int16_t temperature,
+               std::span<const BurstSampleRaw_t> samples,
+               std::span<uint8_t> out) const;
+
+  // Length of the frame at the head of `ring`, going by its header - 0 if
+  // the header (and its delimiter) isn't all there yet, or isn't one we'd
+  // ever send
+  size_t frameLengthAt(const ByteRing &ring) const;
+
+  // Whether `ring` starts with a complete, delimited burst frame
+  bool frameAt(const ByteRing &ring) const {
+    size_t length = frameLengthAt(ring);
+    return length > 0 && ring.size() >= length &&
+           ring.peek(length - 1) == delim_;
+  };
+
+  // Decodes the frame at the head of `ring` into `out` and consumes it.
+  // Only valid if `frameAt(ring)`.
+  void decodeFrame(ByteRing &ring, BurstFrame_t &out) const;
+
+  auto getDelimiter() const { return delim_; };
+
+private:
+  uint8_t delim_;
+};
+
+static_assert(WireLayout<CommandRaw_t>::size == 3, "command frames are 3 bytes");
+static_assert(WireLayout<ResponseRaw_t>::size == 3,
+              "response frames are 3 bytes");
+static_assert(WireLayout<DataResponseRaw_t>::size == 16,
+              "data frames are 16 bytes");
+#ifdef FRAME_LAYOUT_SHUFFLE
+static_assert(WireLayout<DataResponseRaw_t>::shuffled,
+              "data frames should be swapped whole - keep DataResponseRaw_t "
+              "packed, in wire order");
+#endif
+static_assert(WireLayout<BurstSampleRaw_t>::size == 12,
+              "burst samples are 12 bytes");
+
+// Writes a one-line description of `data` to `os` (no trailing newline)
+template <typename T> void formatMessage(std::ostream &os, const T &data);
+
+// Prints `data` to stdout - fine for the odd message, but anything on a hot
+// path should go through the async `Logger` instead
 template <typename T> void printMessage(T &data);
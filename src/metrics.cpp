@@ -0,0 +1,82 @@
+#include "metrics.h"
+#include <algorithm>
+
+size_t LatencyHistogram::bucketFor(uint64_t value) {
+  // the first power of two's worth of values get a bucket each, after that
+  // the top HISTOGRAM_SUB_BUCKET_BITS below the leading one pick the
+  // sub-bucket
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  unsigned exponent = 63 - __builtin_clzll(value);
+  unsigned shift = exponent - HISTOGRAM_SUB_BUCKET_BITS;
+  size_t sub_bucket = (value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+  return (shift + 1) * HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucketStart(size_t bucket) {
+  if (bucket < HISTOGRAM_SUB_BUCKETS) {
+    return bucket;
+  }
+  unsigned shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+  uint64_t sub_bucket = bucket % HISTOGRAM_SUB_BUCKETS;
+  return (HISTOGRAM_SUB_BUCKETS + sub_bucket) << shift;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+  buckets_[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+
+  // only loops if another thread moved the bound at the same moment
+  uint64_t min = min_.load(std::memory_order_relaxed);
+  while (value < min &&
+         !min_.compare_exchange_weak(min, value, std::memory_order_relaxed)) {
+  }
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (value > max &&
+         !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+HistogramSnapshot_t LatencyHistogram::snapshot() const {
+  HistogramSnapshot_t snapshot;
+  // the count is taken from the buckets themselves, so percentiles add up
+  // even if values are recorded while we copy
+  snapshot.count = 0;
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    snapshot.counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    snapshot.count += snapshot.counts[i];
+  }
+  snapshot.sum = sum_.load(std::memory_order_relaxed);
+  snapshot.min = snapshot.count ? min_.load(std::memory_order_relaxed) : 0;
+  snapshot.max = max_.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+uint64_t HistogramSnapshot::percentile(double quantile) const {
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = std::max<uint64_t>(1, (uint64_t)(quantile * count + 0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      // report the top of the bucket, clamped to what was actually seen
+      uint64_t top = i + 1 < HISTOGRAM_BUCKETS
+                         ? LatencyHistogram::bucketStart(i + 1) - 1
+                         : UINT64_MAX;
+      return std::min(std::max(top, min), max);
+    }
+  }
+  return max;
+}
+
+void writeJson(std::ostream &os, const HistogramSnapshot_t &histogram) {
+  os << "{\"count\": " << histogram.count << ", \"mean\": " << histogram.mean()
+     << ", \"min\": " << histogram.min << ", \"max\": " << histogram.max
+     << ", \"p50\": " << histogram.percentile(0.5)
+     << ", \"p90\": " << histogram.percentile(0.9)
+     << ", \"p99\": " << histogram.percentile(0.99)
+     << ", \"p99_9\": " << histogram.percentile(0.999) << "}";
+}
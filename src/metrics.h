@@ -0,0 +1,83 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// lock-free instrumentation - counters and latency histograms that the hot
+// path bumps with relaxed atomics, and anyone (e.g. a monitoring thread) can
+// snapshot at any time without stopping it
+//
+// each instrumented class keeps its live counters privately and hands out a
+// plain struct copy from `metrics()`; `writeJson` turns those into one JSON
+// object for scraping.
+
+// a monotonically increasing count
+class Counter {
+public:
+  Counter() : value_(0){};
+
+  void add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); };
+  uint64_t value() const { return value_.load(std::memory_order_relaxed); };
+
+private:
+  std::atomic<uint64_t> value_;
+};
+
+// 16 sub-buckets per power of two, so each bucket is within ~6% of the values
+// recorded in it
+const unsigned HISTOGRAM_SUB_BUCKET_BITS = 4;
+const size_t HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+
+// enough buckets to cover the whole of uint64_t
+const size_t HISTOGRAM_BUCKETS =
+    (64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+// a point in time copy of a `LatencyHistogram`
+struct HistogramSnapshot {
+  std::array<uint64_t, HISTOGRAM_BUCKETS> counts;
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+
+  // value at or below which `quantile` (0-1) of the recorded values fall, to
+  // within a bucket - 0 if nothing was recorded
+  uint64_t percentile(double quantile) const;
+
+  double mean() const { return count ? (double)sum / count : 0; };
+} typedef HistogramSnapshot_t;
+
+// HDR-style log-linear histogram: buckets are linear within each power of
+// two and double in width from one power to the next, so small and large
+// values both keep their relative precision. Recording is a few bit
+// operations and an atomic increment - nothing is ever allocated or locked.
+class LatencyHistogram {
+public:
+  LatencyHistogram() : sum_(0), min_(UINT64_MAX), max_(0) {
+    for (auto &bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  };
+
+  // Add one `value` (e.g. nanoseconds)
+  void record(uint64_t value);
+
+  HistogramSnapshot_t snapshot() const;
+
+  // which bucket `value` falls in, and the smallest value in a bucket
+  static size_t bucketFor(uint64_t value);
+  static uint64_t bucketStart(size_t bucket);
+
+private:
+  // the count is their sum, see `snapshot()`
+  std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> buckets_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> min_;
+  std::atomic<uint64_t> max_;
+};
+
+// Writes `histogram` as a JSON object of its count, mean, min, max and
+// p50/p90/p99/p99.9
+void writeJson(std::ostream &os, const HistogramSnapshot_t &histogram);
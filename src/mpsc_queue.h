@@ -0,0 +1,93 @@
+#pragma once
+#include "spsc_queue.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// bounded, lock-free, multi-producer/single-consumer queue
+//
+// each cell carries a sequence number saying whose turn it is: producers
+// claim a position with a CAS on `enqueue_pos_`, fill the cell, then publish
+// it by bumping its sequence; the consumer waits for that before reading.
+// When full, `push` fails rather than overwrite - the caller decides.
+template <typename T, size_t N> class MpscQueue {
+  static_assert((N & (N - 1)) == 0, "MpscQueue size must be a power of two");
+  static_assert(std::is_trivially_copyable<T>::value,
+                "MpscQueue items are copied in and out by value");
+
+public:
+  MpscQueue() : enqueue_pos_(0), dequeue_pos_(0) {
+    for (size_t i = 0; i < N; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  };
+
+  // any thread: add `item`, false if the queue is full
+  bool push(const T &item) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell *cell;
+
+    while (true) {
+      cell = &cells_[pos & MASK];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+      if (diff == 0) {
+        // cell is free for this position - try to claim it
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // consumer hasn't freed this cell from the last lap yet
+        return false;
+      } else {
+        // another producer got here first
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->item = item;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer thread only: remove the oldest item into `item`, false if empty
+  bool pop(T &item) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell &cell = cells_[pos & MASK];
+
+    if (cell.sequence.load(std::memory_order_acquire) != pos + 1) {
+      return false;
+    }
+
+    item = cell.item;
+    cell.sequence.store(pos + N, std::memory_order_release);
+    dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // consumer thread only: whether there's nothing for `pop` - a push still in
+  // progress doesn't count until it's finished
+  bool empty() const {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    return cells_[pos & MASK].sequence.load(std::memory_order_acquire) !=
+           pos + 1;
+  }
+
+  static constexpr size_t capacity() { return N; }
+
+private:
+  static const size_t MASK = N - 1;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  std::array<Cell, N> cells_;
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueue_pos_;
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeue_pos_;
+};
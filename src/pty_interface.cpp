@@ -0,0 +1,68 @@
+#include "pty_interface.h"
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <stdexcept>
+#include <termios.h>
+#include <unistd.h>
+
+PtyInterface::~PtyInterface() { shutdown(); }
+
+void PtyInterface::init() {
+  int master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (master_fd < 0) {
+    throw std::runtime_error("Failed to open a pty for " + link_);
+  }
+
+  char name[PATH_MAX];
+  if (grantpt(master_fd) != 0 || unlockpt(master_fd) != 0 ||
+      ptsname_r(master_fd, name, sizeof(name)) != 0) {
+    close(master_fd);
+    throw std::runtime_error("Failed to set up the pty for " + link_);
+  }
+  slave_path_ = name;
+
+  slave_fd_ = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+  struct termios tty;
+  if (slave_fd_ < 0 || tcgetattr(slave_fd_, &tty) != 0) {
+    close(master_fd);
+    shutdown();
+    throw std::runtime_error("Failed to open the pty slave " + slave_path_);
+  }
+  cfmakeraw(&tty);
+  if (tcsetattr(slave_fd_, TCSANOW, &tty) != 0) {
+    close(master_fd);
+    shutdown();
+    throw std::runtime_error("Failed to configure the pty slave " +
+                             slave_path_);
+  }
+
+  // a link left behind by a sim that didn't shut down cleanly is replaced
+  if ((unlink(link_.c_str()) != 0 && errno != ENOENT) ||
+      symlink(name, link_.c_str()) != 0) {
+    close(master_fd);
+    shutdown();
+    throw std::runtime_error("Failed to link " + link_ + " to " + slave_path_);
+  }
+
+  read_fd_ = write_fd_ = master_fd;
+  FdInterface::init();
+}
+
+void PtyInterface::shutdown() {
+  if (!slave_path_.empty()) {
+    // only remove the link if it's still ours
+    char target[PATH_MAX];
+    ssize_t len = readlink(link_.c_str(), target, sizeof(target) - 1);
+    if (len > 0 && std::string(target, len) == slave_path_) {
+      unlink(link_.c_str());
+    }
+    slave_path_.clear();
+  }
+  if (slave_fd_ >= 0) {
+    close(slave_fd_);
+    slave_fd_ = -1;
+  }
+  FdInterface::shutdown();
+}
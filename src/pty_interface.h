@@ -0,0 +1,36 @@
+#pragma once
+#include "fd_interface.h"
+#include <string>
+
+// the device end of a pseudo terminal the interface opens itself - the
+// master side, with a symlink to the slave at `link` for a driver to open
+// like any other port (the same as socat's PTY,link=...), so a sim can make
+// its own ports
+//
+// the slave is held open too, and put in raw mode up front - without that,
+// the master sees a hangup until a driver first opens it (and again between
+// drivers), and would mangle binary data on the way through. Output with no
+// driver to read it just fills up the pty and is dropped.
+class PtyInterface final : public FdInterface {
+public:
+  PtyInterface(const std::string &link) : link_(link), slave_fd_(-1){};
+
+  // Destructor. Runs shutdown().
+  ~PtyInterface();
+
+  // Open the pty and create the link, replacing whatever was there
+  void init() override;
+
+  // Remove the link and close both sides
+  void shutdown() override;
+
+  const std::string &link() const { return link_; };
+
+  // the slave's actual path, e.g. /dev/pts/3
+  const std::string &slavePath() const { return slave_path_; };
+
+private:
+  std::string link_;
+  std::string slave_path_;
+  int slave_fd_;
+};
@@ -0,0 +1,133 @@
+#pragma once
+#include "gyro_xyz.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// who can do what with a register
+enum class RegAccess : uint8_t {
+  Read,      // read-only - a command to it just reads it back
+  ReadWrite, // a command to it writes its data, and reads back what stuck
+  // not a stored value - a command to it does something else entirely
+  // (DATA_GET_REG answers with a sample, REG_READ_REG with another register)
+  Command,
+};
+
+// what else happens when a register is commanded - picks the sim's handler
+// for it, so every register with the same behaviour shares one
+enum class RegEffect : uint8_t {
+  None,         // plain storage
+  Data,         // answer with a data frame
+  Mode,         // change modes
+  BurstControl, // reconfigure burst frames
+  SoftReset,    // GLOB_CMD
+  ReadBack,     // REG_READ_REG
+  Count,
+};
+
+// one entry in the register map
+struct RegisterDef {
+  const char *name;
+  uint8_t addr;
+  uint8_t width; // in bytes - and addresses, one per byte
+  RegAccess access;
+  // value after a reset, little-endian across `width` bytes
+  uint64_t reset;
+  RegEffect effect;
+} typedef RegisterDef_t;
+
+// `chars` (up to 8 of them) as a reset value, first character at the lowest
+// address
+constexpr uint64_t registerChars(const char *chars) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < 8 && chars[i] != '\0'; i++) {
+    value |= uint64_t(uint8_t(chars[i])) << (8 * i);
+  }
+  return value;
+}
+
+// every register the device has
+constexpr RegisterDef_t REGISTER_MAP[] = {
+    {"SIG_CTRL", SIG_CTRL_REG, 2, RegAccess::ReadWrite, 0x0E00,
+     RegEffect::None},
+    {"MODE_SET", MODE_SET_REG, 1, RegAccess::ReadWrite, MODE_ARG_MANUAL,
+     RegEffect::Mode},
+    {"MODE_GET", MODE_GET_REG, 1, RegAccess::Read, MODE_ARG_MANUAL,
+     RegEffect::None},
+    {"BURST_CTRL", BURST_CTRL_REG, 1, RegAccess::ReadWrite,
+     DEFAULT_BURST_SAMPLES, RegEffect::BurstControl},
+    {"FILTER_CTRL", FILTER_CTRL_REG, 1, RegAccess::ReadWrite, 0x01,
+     RegEffect::None},
+    {"UART_CTRL", UART_CTRL_REG, 2, RegAccess::ReadWrite, 0x0100,
+     RegEffect::None},
+    {"GLOB_CMD", GLOB_CMD_REG, 1, RegAccess::ReadWrite, 0x00,
+     RegEffect::SoftReset},
+    {"POL_CTRL", POL_CTRL_REG, 1, RegAccess::ReadWrite, 0x00,
+     RegEffect::None},
+    {"PROD_ID", PROD_ID_REG, 8, RegAccess::Read, registerChars("G370PDF1"),
+     RegEffect::None},
+    {"VERSION", VERSION_GET_REG, 1, RegAccess::Read, 0x23, RegEffect::None},
+    {"SERIAL_NUM", SERIAL_NUM_REG, 8, RegAccess::Read,
+     registerChars("SIM00001"), RegEffect::None},
+    {"REG_READ", REG_READ_REG, 1, RegAccess::Command, 0, RegEffect::ReadBack},
+    {"DATA_GET", DATA_GET_REG, 1, RegAccess::Command, 0, RegEffect::Data},
+};
+
+const size_t REGISTER_COUNT = sizeof(REGISTER_MAP) / sizeof(REGISTER_MAP[0]);
+
+// marks an address no register covers in `REGISTER_INDEX`
+const uint8_t NO_REGISTER = 0xFF;
+
+// address -> index into REGISTER_MAP, for every address of every register.
+// Built at compile time, and fails to compile if two registers overlap.
+constexpr std::array<uint8_t, 256> buildRegisterIndex() {
+  std::array<uint8_t, 256> index = {};
+  index.fill(NO_REGISTER);
+  for (size_t i = 0; i < REGISTER_COUNT; i++) {
+    auto &reg = REGISTER_MAP[i];
+    if (reg.width == 0 || reg.width > 8 || reg.addr + reg.width > 256) {
+      throw std::logic_error("register doesn't fit the address space");
+    }
+    for (size_t offset = 0; offset < reg.width; offset++) {
+      if (index[reg.addr + offset] != NO_REGISTER) {
+        throw std::logic_error("registers overlap");
+      }
+      index[reg.addr + offset] = i;
+    }
+  }
+  return index;
+}
+
+constexpr std::array<uint8_t, 256> REGISTER_INDEX = buildRegisterIndex();
+
+static_assert(REGISTER_COUNT < NO_REGISTER, "too many registers to index");
+
+// responses are told apart from data frames by their addr byte, so nothing
+// stored can live where data frames do
+static_assert(REGISTER_INDEX[BURST_DATA_REG] == NO_REGISTER,
+              "burst frames can't share an address with a register");
+
+// the register covering `addr`, or nullptr if there isn't one
+constexpr const RegisterDef_t *findRegister(uint8_t addr) {
+  uint8_t index = REGISTER_INDEX[addr];
+  return index == NO_REGISTER ? nullptr : &REGISTER_MAP[index];
+}
+
+// whether `addr` holds a value that can be read back (with REG_READ_REG)
+constexpr bool isReadable(uint8_t addr) {
+  auto reg = findRegister(addr);
+  return reg && reg->access != RegAccess::Command;
+}
+
+// whether a command to `addr` writes it
+constexpr bool isWritable(uint8_t addr) {
+  auto reg = findRegister(addr);
+  return reg && reg->access == RegAccess::ReadWrite;
+}
+
+// reset value of the byte at `addr`, which must be readable
+constexpr uint8_t resetValue(uint8_t addr) {
+  auto reg = findRegister(addr);
+  return uint8_t(reg->reset >> (8 * (addr - reg->addr)));
+}
@@ -0,0 +1,94 @@
+#include "replay_interface.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+void ReplayInterface::init() {
+  recording_.init();
+  chunk_ = StreamChunk_t{.time_ns = 0, .data = {}};
+  chunk_offset_ = 0;
+  started_ = false;
+}
+
+void ReplayInterface::shutdown() { recording_.shutdown(); }
+
+SendResult ReplayInterface::writeFrom(const struct iovec *iov, int iovcnt,
+                                      Deadline) {
+  // commands go nowhere, but as far as the caller knows they all went out
+  size_t len = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    len += iov[i].iov_len;
+  }
+  return SendResult{.bytes = len, .status = IOStatus::Ok};
+}
+
+ReceiveResult ReplayInterface::readInto(std::span<uint8_t> buffer,
+                                        Deadline deadline) {
+  if (buffer.empty()) {
+    return ReceiveResult{.bytes = 0, .status = IOStatus::Ok};
+  }
+  if (!waitReadable(deadline)) {
+    return ReceiveResult{.bytes = 0, .status = IOStatus::Timeout};
+  }
+  if (!loadChunk()) {
+    return ReceiveResult{.bytes = 0, .status = IOStatus::Closed};
+  }
+
+  size_t len = std::min(buffer.size(), chunk_.data.size() - chunk_offset_);
+  std::memcpy(buffer.data(), chunk_.data.data() + chunk_offset_, len);
+  chunk_offset_ += len;
+  return ReceiveResult{.bytes = len, .status = IOStatus::Ok};
+}
+
+int ReplayInterface::availableBytes() {
+  if (!loadChunk() || std::chrono::steady_clock::now() < dueTime()) {
+    return 0;
+  }
+  return chunk_.data.size() - chunk_offset_;
+}
+
+bool ReplayInterface::waitReadable(Deadline deadline) {
+  // the end of the recording counts as readable, like a hangup on a port -
+  // the read is what reports it
+  if (!loadChunk() || pacing_ == ReplayPacing::AsFastAsPossible) {
+    return true;
+  }
+
+  auto due = dueTime();
+  if (due > deadline) {
+    std::this_thread::sleep_until(deadline);
+    return false;
+  }
+  std::this_thread::sleep_until(due);
+  return true;
+}
+
+void ReplayInterface::flush() {
+  while (loadChunk() && std::chrono::steady_clock::now() >= dueTime()) {
+    chunk_offset_ = chunk_.data.size();
+  }
+}
+
+bool ReplayInterface::loadChunk() {
+  if (chunk_offset_ < chunk_.data.size()) {
+    return true;
+  }
+  if (!recording_.next(chunk_)) {
+    return false;
+  }
+  chunk_offset_ = 0;
+
+  if (!started_) {
+    first_time_ns_ = chunk_.time_ns;
+    start_ = std::chrono::steady_clock::now();
+    started_ = true;
+  }
+  return true;
+}
+
+Deadline ReplayInterface::dueTime() const {
+  if (pacing_ == ReplayPacing::AsFastAsPossible) {
+    return Deadline::min();
+  }
+  return start_ + std::chrono::nanoseconds(chunk_.time_ns - first_time_ns_);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "io_interface.h"
+#include "stream_recorder.h"
+#include <cstdint>
+#include <span>
+#include <string>
+
+// how fast a recording is fed back in
+enum class ReplayPacing {
+  Original,         // each chunk arrives when it did when it was recorded
+  AsFastAsPossible, // everything is available straight away
+};
+
+// plays a `StreamRecording` back in place of a port
+//
+// reads hand out the recorded chunks in order (split up if the caller's
+// buffer is smaller), and once the recording runs out the "port" reports
+// Closed. Anything sent is accepted and thrown away - the recording already
+// has whatever the device said back.
+//
+// there's no file descriptor behind it, so it can't go into a
+// `SensorManager`; drive it through the `SensorDriver` calls instead
+class ReplayInterface final : public IOInterface {
+public:
+  ReplayInterface(const std::string &path,
+                  ReplayPacing pacing = ReplayPacing::Original)
+      : recording_(path), pacing_(pacing),
+        chunk_offset_(0), first_time_ns_(0), started_(false){};
+
+  // Map the recording and start from its beginning
+  void init() override;
+  void shutdown() override;
+
+  // bytes left of the current chunk, if it's due
+  int availableBytes() override;
+
+  using IOInterface::waitReadable;
+
+  // Wait until the next chunk is due (or the recording is over), or
+  // `deadline` passes first
+  bool waitReadable(Deadline deadline) override;
+
+  // Skip whatever is due right now
+  void flush() override;
+
+  int fd() const override { return -1; };
+
+  // when the chunk last read from was recorded, so a replay decodes to the
+  // same sample times every time, however it's paced
+  uint64_t receiveClockNs() const override { return chunk_.time_ns; };
+
+protected:
+  ReceiveResult readInto(std::span<uint8_t> buffer,
+                         Deadline deadline) override;
+  SendResult writeFrom(const struct iovec *iov, int iovcnt,
+                       Deadline deadline) override;
+
+private:
+  // Make sure `chunk_` has bytes left in it, false at the end of the
+  // recording
+  bool loadChunk();
+
+  // when the current chunk should come out
+  Deadline dueTime() const;
+
+  StreamRecording recording_;
+  ReplayPacing pacing_;
+
+  StreamChunk_t chunk_;
+  size_t chunk_offset_;
+
+  // the recording's clock is mapped onto ours by lining its first chunk up
+  // with the first time the replay is read from
+  uint64_t first_time_ns_;
+  Deadline start_;
+  bool started_;
+};
@@ -1,18 +1,40 @@
 #include "driver.h"
 #include "gyro_xyz.h"
 #include "io_interface.h"
+#include "logger.h"
 #include "message_coder.h"
+#include "sample_bus.h"
+#include "stream_recorder.h"
+#include "uart_interface.h"
+#include <csignal>
+#include <cstdlib>
 #include <ios>
 #include <iostream>
 #include <ostream>
 #include <string>
 #include <unistd.h>
 
+// set by ctrl+c while publishing
+static volatile std::sig_atomic_t stop_publishing = 0;
+static void handleSignal(int) { stop_publishing = 1; }
+
 int main() {
   std::string myport("/tmp/ttyDRIVER");
-  IOInterface myio = IOInterface(myport, 38400);
+  UartInterface myio = UartInterface(myport, 38400);
   SensorDriver mydriver = SensorDriver(myio);
 
+  // SENSOR_RECORD_FILE=path records everything read off the port, for
+  // replaying later through a `ReplayInterface`
+  const char *record_path = std::getenv("SENSOR_RECORD_FILE");
+  StreamRecorder recorder(record_path ? record_path : "");
+  if (record_path) {
+    recorder.init();
+    myio.setRecorder(&recorder);
+  }
+
+  // SENSOR_LOG_LEVEL=debug logs every frame sent and received
+  logger().startFromEnvironment(LogLevel::Info);
+
   mydriver.init();
 
   std::cout << "getMode: " << (int)mydriver.getMode() << std::endl;
@@ -25,6 +47,18 @@ int main() {
     printMessage(data);
   }
 
+  // the same queries pipelined - all three go out in one write
+  auto mode_handle = mydriver.getModeAsync();
+  auto version_handle = mydriver.getVersionAsync();
+  auto rates_handle = mydriver.getRatesAsync();
+  std::cout << "getModeAsync: " << (int)mydriver.waitResponse(mode_handle).data
+            << std::endl;
+  std::cout << "getVersionAsync: " << std::hex
+            << (int)mydriver.waitResponse(version_handle).data << std::dec
+            << std::endl;
+  auto rate = mydriver.waitDataResponse(rates_handle);
+  printMessage(rate);
+
   mydriver.setMode(MODE_ARG_CONFIG);
   std::cout << "getMode: " << (int)mydriver.getMode() << std::endl;
 
@@ -41,9 +75,49 @@ int main() {
     }
   }
 
+  // same again, but with the reader thread pulling samples in the background
+  // while we keep issuing commands
+  mydriver.startStreaming();
+  usleep(200 * 1000);
+  std::cout << "getMode (streaming): " << (int)mydriver.getMode() << std::endl;
+  usleep(200 * 1000);
+
+  DataResponseRaw_t sample;
+  size_t n_samples = 0;
+  while (mydriver.popSample(sample)) {
+    n_samples++;
+  }
+  std::cout << "streamed samples: " << n_samples
+            << ", last count: " << sample.count
+            << ", overflows: " << mydriver.sampleOverflows() << std::endl;
+  mydriver.stopStreaming();
+
+  // SENSOR_SAMPLE_BUS=/name keeps going as a publisher: every sample goes on
+  // a shared memory bus of that name for other processes to read (see
+  // `SampleBusReader`), until ctrl+c
+  if (const char *bus_name = std::getenv("SENSOR_SAMPLE_BUS")) {
+    SampleBusWriter bus(bus_name);
+    bus.init();
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
+
+    mydriver.startPublishing(bus);
+    std::cout << "publishing samples on " << bus_name << std::endl;
+    while (!stop_publishing) {
+      usleep(100 * 1000);
+    }
+    mydriver.stopStreaming();
+    std::cout << "published samples: " << bus.published() << std::endl;
+  }
+
   mydriver.setMode(MODE_ARG_MANUAL);
   std::cout << "getMode: " << (int)mydriver.getMode() << std::endl;
 
+  std::cout << "metrics: ";
+  writeJson(std::cout, mydriver.metrics());
+  std::cout << std::endl;
+
   mydriver.shutdown();
+  logger().stop();
   return 0;
 }
@@ -0,0 +1,202 @@
+#include "sample_bus.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bytes of shared memory for a bus of `slots`
+static size_t busSize(size_t slots) {
+  return sizeof(SampleBusHeader_t) + slots * sizeof(SampleBusSlot_t);
+}
+
+SampleBusWriter::SampleBusWriter(const std::string &name, size_t slots)
+    : name_(name), slots_(slots), map_size_(0), header_(nullptr),
+      ring_(nullptr), published_(0) {
+  if (slots == 0 || (slots & (slots - 1)) != 0) {
+    throw std::runtime_error("Sample bus slots must be a power of two");
+  }
+};
+
+void SampleBusWriter::init() {
+  // a fresh object rather than reusing an old one, so readers still on a
+  // previous writer's bus can't get confused by this one starting over
+  shm_unlink(name_.c_str());
+  int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to create sample bus " + name_);
+  }
+
+  // fresh pages are zeroed, which leaves every slot's seq at "empty"
+  map_size_ = busSize(slots_);
+  if (ftruncate(fd, map_size_) != 0) {
+    close(fd);
+    shm_unlink(name_.c_str());
+    throw std::runtime_error("Failed to size sample bus " + name_);
+  }
+  void *map =
+      mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(name_.c_str());
+    throw std::runtime_error("Failed to map sample bus " + name_);
+  }
+
+  header_ = static_cast<SampleBusHeader_t *>(map);
+  ring_ = reinterpret_cast<SampleBusSlot_t *>(static_cast<uint8_t *>(map) +
+                                              sizeof(SampleBusHeader_t));
+  published_ = 0;
+  header_->slots = slots_;
+  header_->slot_size = sizeof(SampleBusSlot_t);
+  header_->published.store(0, std::memory_order_relaxed);
+
+  // the magic goes in last - readers won't take the bus until it's there
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header_->magic, SAMPLE_BUS_MAGIC, sizeof(SAMPLE_BUS_MAGIC));
+}
+
+void SampleBusWriter::shutdown() {
+  if (!header_) {
+    return;
+  }
+  munmap(header_, map_size_);
+  header_ = nullptr;
+  ring_ = nullptr;
+  shm_unlink(name_.c_str());
+}
+
+void SampleBusWriter::publish(const TimedSample_t &sample) {
+  std::array<uint64_t, SAMPLE_BUS_WORDS> words = {};
+  std::memcpy(words.data(), &sample, sizeof(sample));
+
+  // odd while we're in the middle of it - the fence keeps the words from
+  // being written before readers can see that
+  auto &slot = ring_[published_ & (slots_ - 1)];
+  slot.seq.store(2 * published_ + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < SAMPLE_BUS_WORDS; i++) {
+    slot.words[i].store(words[i], std::memory_order_relaxed);
+  }
+  slot.seq.store(2 * published_ + 2, std::memory_order_release);
+
+  published_++;
+  header_->published.store(published_, std::memory_order_release);
+}
+
+SampleBusReader::SampleBusReader(const std::string &name)
+    : name_(name), map_size_(0), header_(nullptr), ring_(nullptr), mask_(0),
+      cursor_(0), lost_(0){};
+
+void SampleBusReader::init() {
+  int fd = shm_open(name_.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open sample bus " + name_);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SampleBusHeader_t)) {
+    close(fd);
+    throw std::runtime_error("Not a sample bus: " + name_);
+  }
+  map_size_ = st.st_size;
+
+  // read-only - nothing a reader does can touch the writer or other readers
+  void *map = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Failed to map sample bus " + name_);
+  }
+  header_ = static_cast<const SampleBusHeader_t *>(map);
+  ring_ = reinterpret_cast<const SampleBusSlot_t *>(
+      static_cast<const uint8_t *>(map) + sizeof(SampleBusHeader_t));
+
+  bool valid =
+      std::memcmp(header_->magic, SAMPLE_BUS_MAGIC, sizeof(SAMPLE_BUS_MAGIC)) ==
+      0;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  valid = valid && header_->slot_size == sizeof(SampleBusSlot_t) &&
+          header_->slots > 0 && (header_->slots & (header_->slots - 1)) == 0 &&
+          busSize(header_->slots) <= map_size_;
+  if (!valid) {
+    shutdown();
+    throw std::runtime_error("Not a sample bus (or not ready yet): " + name_);
+  }
+
+  mask_ = header_->slots - 1;
+  cursor_ = header_->published.load(std::memory_order_acquire);
+  lost_ = 0;
+}
+
+void SampleBusReader::shutdown() {
+  if (!header_) {
+    return;
+  }
+  munmap(const_cast<SampleBusHeader_t *>(header_), map_size_);
+  header_ = nullptr;
+  ring_ = nullptr;
+}
+
+bool SampleBusReader::copySlot(uint64_t n, TimedSample_t &out) const {
+  auto &slot = ring_[n & mask_];
+  uint64_t seq = slot.seq.load(std::memory_order_acquire);
+  if (seq != 2 * n + 2) {
+    return false;
+  }
+
+  std::array<uint64_t, SAMPLE_BUS_WORDS> words;
+  for (size_t i = 0; i < SAMPLE_BUS_WORDS; i++) {
+    words[i] = slot.words[i].load(std::memory_order_relaxed);
+  }
+
+  // and if seq is still the same, the writer didn't touch it while we copied
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot.seq.load(std::memory_order_relaxed) != seq) {
+    return false;
+  }
+  std::memcpy(&out, words.data(), sizeof(out));
+  return true;
+}
+
+size_t SampleBusReader::read(TimedSample_t *out, size_t max_samples) {
+  uint64_t published = header_->published.load(std::memory_order_acquire);
+  uint64_t slots = mask_ + 1;
+  size_t n_samples = 0;
+
+  while (n_samples < max_samples && cursor_ < published) {
+    if (published - cursor_ > slots || !copySlot(cursor_, out[n_samples])) {
+      // lapped - the writer is (or was) past this one. Skip to half a ring
+      // behind it, which leaves room to catch up before it comes round again.
+      published = header_->published.load(std::memory_order_acquire);
+      uint64_t resume = published - std::min(published, slots / 2);
+      if (resume <= cursor_) {
+        break;
+      }
+      lost_ += resume - cursor_;
+      cursor_ = resume;
+      continue;
+    }
+    cursor_++;
+    n_samples++;
+  }
+  return n_samples;
+}
+
+bool SampleBusReader::readLatest(TimedSample_t &out) const {
+  // only fails if the writer is lapping us, in which case there's something
+  // newer to try
+  while (true) {
+    uint64_t published = header_->published.load(std::memory_order_acquire);
+    if (published == 0) {
+      return false;
+    }
+    if (copySlot(published - 1, out)) {
+      return true;
+    }
+  }
+}
+
+uint64_t SampleBusReader::available() const {
+  return header_->published.load(std::memory_order_acquire) - cursor_;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include "sample_clock.h"
+#include "spsc_queue.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// a POSIX shared memory ring of samples, for sharing one driver's stream with
+// any number of other processes (control, logging, health monitoring, ...) -
+// only one process can own the port, so it publishes what it decodes here
+//
+// shared memory layout (host byte order, same machine only):
+//   a `SampleBusHeader_t`, then `slots` back to back `SampleBusSlot_t`s
+//
+// There's one writer and it never waits on readers - it just goes round the
+// ring, so a reader that falls a whole ring behind loses samples (and is told
+// how many). Each slot is guarded by its own seqlock: its `seq` is odd while
+// the writer is in the middle of it, and 2 * (n + 1) once it holds sample n.
+// Readers copy a slot out and check `seq` didn't change under them, so they
+// never write to the shared memory at all (it's mapped read-only), never
+// block the writer or each other, and make no syscalls to read.
+
+const char SAMPLE_BUS_MAGIC[8] = {'S', 'D', 'B', 'U', 'S', '0', '0', '1'};
+
+// slots in a bus unless told otherwise - a couple of seconds at 2 kHz
+const size_t SAMPLE_BUS_DEFAULT_SLOTS = 4096;
+
+// a sample is carried as this many words, each its own atomic, so the copies
+// on either side of the seqlock aren't data races
+const size_t SAMPLE_BUS_WORDS = (sizeof(TimedSample_t) + 7) / 8;
+
+static_assert(std::is_trivially_copyable<TimedSample_t>::value,
+              "samples are copied through the bus as raw words");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the bus's atomics have to work across processes");
+
+struct SampleBusHeader {
+  char magic[8];
+  uint32_t slots;     // a power of two
+  uint32_t slot_size; // sizeof(SampleBusSlot_t), as a layout check
+  // samples published so far - the next one goes in slot `published % slots`
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> published;
+} typedef SampleBusHeader_t;
+
+// a slot per cache line, so a reader copying one out doesn't share a line
+// with the writer filling in the next
+struct alignas(CACHE_LINE_SIZE) SampleBusSlot {
+  std::atomic<uint64_t> seq;
+  std::array<std::atomic<uint64_t>, SAMPLE_BUS_WORDS> words;
+} typedef SampleBusSlot_t;
+
+// the publishing side - see `SensorDriver::startPublishing`
+//
+// not thread-safe - there's one writer per bus
+class SampleBusWriter {
+public:
+  // `name` is a shm_open name, e.g. "/sensor0"
+  SampleBusWriter(const std::string &name,
+                  size_t slots = SAMPLE_BUS_DEFAULT_SLOTS);
+
+  // Destructor. Runs shutdown().
+  ~SampleBusWriter() { shutdown(); };
+
+  SampleBusWriter(const SampleBusWriter &) = delete;
+  SampleBusWriter &operator=(const SampleBusWriter &) = delete;
+
+  // Create the bus, replacing any left over by a previous writer (readers
+  // still attached to that one keep it, but see nothing new)
+  void init();
+
+  // Unmap the bus and remove its name - readers already attached keep it
+  // until they let go
+  void shutdown();
+
+  // Add `sample`, overwriting the oldest - wait-free
+  void publish(const TimedSample_t &sample);
+
+  uint64_t published() const { return published_; };
+
+  const std::string &name() const { return name_; };
+
+private:
+  std::string name_;
+  size_t slots_;
+  size_t map_size_;
+  SampleBusHeader_t *header_;
+  SampleBusSlot_t *ring_;
+  // our own copy of `header_->published`, which only we write
+  uint64_t published_;
+};
+
+// the consuming side - one per reader, in any number of processes
+//
+// each reader keeps its own place in the ring, and starts out at whatever is
+// published next. Not thread-safe - give each thread its own.
+class SampleBusReader {
+public:
+  SampleBusReader(const std::string &name);
+
+  // Destructor. Runs shutdown().
+  ~SampleBusReader() { shutdown(); };
+
+  SampleBusReader(const SampleBusReader &) = delete;
+  SampleBusReader &operator=(const SampleBusReader &) = delete;
+
+  // Attach to the bus, which has to exist already - throws if it doesn't
+  void init();
+
+  void shutdown();
+
+  // Copy out up to `max_samples` of the samples published since the last
+  // call, oldest first, and return how many. Never blocks, and no syscalls -
+  // if nothing's new it returns 0, so callers pick how to wait (spin, yield,
+  // sleep, or poll on something else).
+  size_t read(TimedSample_t *out, size_t max_samples);
+
+  // Copy out the newest sample, skipping anything older - for consumers that
+  // only care about the latest (e.g. a control loop). False if nothing has
+  // been published yet. Doesn't move this reader's place for `read()`.
+  bool readLatest(TimedSample_t &out) const;
+
+  // samples published that `read()` hasn't got to yet
+  uint64_t available() const;
+
+  // samples skipped because the writer lapped this reader
+  uint64_t lost() const { return lost_; };
+
+private:
+  // Copy sample `n` out of its slot - false if the writer has since
+  // overwritten it (or is in the middle of doing so)
+  bool copySlot(uint64_t n, TimedSample_t &out) const;
+
+  std::string name_;
+  size_t map_size_;
+  const SampleBusHeader_t *header_;
+  const SampleBusSlot_t *ring_;
+  uint64_t mask_;
+  // next sample `read()` hands out
+  uint64_t cursor_;
+  uint64_t lost_;
+};
@@ -0,0 +1,160 @@
+#include "sample_clock.h"
+#include <cmath>
+
+// the window's points are moved down to a new base once they get this far
+// from it - with a full window that keeps sum_xy_ under 2^62. Y is in ns, so
+// that's about 4.5 minutes: the window has to span less than that, which
+// holds down to the sim's slowest rate (1 Hz).
+const int64_t SAMPLE_CLOCK_REBASE_X = int64_t(1) << 16;
+const int64_t SAMPLE_CLOCK_REBASE_Y = int64_t(1) << 38;
+static_assert(SAMPLE_CLOCK_WINDOW <= 256, "sum_xy_ could overflow");
+
+void SampleClock::reset() {
+  n_points_ = 0;
+  next_point_ = 0;
+  base_sequence_ = 0;
+  base_ns_ = 0;
+  sum_x_ = sum_y_ = sum_xx_ = sum_xy_ = 0;
+  fitted_ = false;
+  slope_ = mean_x_ = mean_y_ = 0;
+  started_ = false;
+  last_count_ = 0;
+  last_sequence_ = 0;
+  last_rx_ns_ = 0;
+}
+
+void SampleClock::update(TimedSample_t &sample) {
+  uint64_t sequence = sample.data.count;
+  uint32_t lost = 0;
+
+  if (started_) {
+    // unsigned 16-bit subtraction takes care of the counter wrapping
+    uint16_t delta = sample.data.count - last_count_;
+
+    // a counter that didn't move, or jumped a lot further than the time
+    // since the last sample allows for, means the device restarted - the
+    // old fit doesn't apply anymore
+    bool restarted = delta == 0;
+    if (fitted_ && sample.rx_ns > last_rx_ns_) {
+      double elapsed = (sample.rx_ns - last_rx_ns_) / slope_;
+      restarted |= delta > elapsed + SAMPLE_CLOCK_MAX_SKEW;
+    }
+
+    if (restarted) {
+      uint64_t next_sequence = last_sequence_ + 1;
+      reset();
+      sequence = next_sequence;
+    } else {
+      sequence = last_sequence_ + delta;
+      lost = delta - 1;
+    }
+  }
+
+  if (!started_) {
+    started_ = true;
+    base_sequence_ = sequence;
+    base_ns_ = sample.rx_ns;
+  }
+  last_count_ = sample.data.count;
+  last_sequence_ = sequence;
+  last_rx_ns_ = sample.rx_ns;
+
+  int64_t x = sequence - base_sequence_;
+  int64_t y = sample.rx_ns - base_ns_;
+  if (x >= SAMPLE_CLOCK_REBASE_X || y >= SAMPLE_CLOCK_REBASE_Y) {
+    if (!rebase()) {
+      // the window reaches back too far (there was a long pause), so start
+      // over from this sample
+      reset();
+      started_ = true;
+      base_sequence_ = last_sequence_ = sequence;
+      base_ns_ = last_rx_ns_ = sample.rx_ns;
+      last_count_ = sample.data.count;
+    }
+    x = sequence - base_sequence_;
+    y = sample.rx_ns - base_ns_;
+  }
+
+  // the window is a ring - once it's full, the new point replaces the oldest
+  auto &slot = window_[next_point_];
+  if (n_points_ == SAMPLE_CLOCK_WINDOW) {
+    removePoint(slot.x, slot.y);
+  } else {
+    n_points_++;
+  }
+  slot = Point{.x = x, .y = y};
+  addPoint(x, y);
+  next_point_ = (next_point_ + 1) % SAMPLE_CLOCK_WINDOW;
+
+  fit();
+
+  sample.sequence = sequence;
+  sample.lost = lost;
+  uint64_t time_ns =
+      fitted_ ? base_ns_ + std::llround(mean_y_ + slope_ * (x - mean_x_))
+              : sample.rx_ns;
+
+  // switching from rx_ns to the fit, and each refit, can move the estimate
+  // back past the last one - sample times only ever go forwards
+  if (has_time_ && time_ns <= last_time_ns_) {
+    time_ns = last_time_ns_ + 1;
+  }
+  has_time_ = true;
+  last_time_ns_ = time_ns;
+  sample.time_ns = time_ns;
+}
+
+void SampleClock::addPoint(int64_t x, int64_t y) {
+  sum_x_ += x;
+  sum_y_ += y;
+  sum_xx_ += x * x;
+  sum_xy_ += x * y;
+}
+
+void SampleClock::removePoint(int64_t x, int64_t y) {
+  sum_x_ -= x;
+  sum_y_ -= y;
+  sum_xx_ -= x * x;
+  sum_xy_ -= x * y;
+}
+
+bool SampleClock::rebase() {
+  // O(window), but only every SAMPLE_CLOCK_REBASE_X samples or so
+  size_t oldest = n_points_ == SAMPLE_CLOCK_WINDOW ? next_point_ : 0;
+  Point origin = n_points_ > 0 ? window_[oldest] : Point{.x = 0, .y = 0};
+  if (last_sequence_ - (base_sequence_ + origin.x) >=
+          (uint64_t)SAMPLE_CLOCK_REBASE_X ||
+      last_rx_ns_ - (base_ns_ + origin.y) >= (uint64_t)SAMPLE_CLOCK_REBASE_Y) {
+    return false;
+  }
+
+  base_sequence_ += origin.x;
+  base_ns_ += origin.y;
+  sum_x_ = sum_y_ = sum_xx_ = sum_xy_ = 0;
+  for (size_t i = 0; i < n_points_; i++) {
+    window_[i].x -= origin.x;
+    window_[i].y -= origin.y;
+    addPoint(window_[i].x, window_[i].y);
+  }
+  return true;
+}
+
+void SampleClock::fit() {
+  fitted_ = false;
+  if (n_points_ < SAMPLE_CLOCK_MIN_FIT) {
+    return;
+  }
+
+  // the usual least squares slope, from the sums about the means - the sums
+  // are exact, so there's only the rounding in this last step
+  mean_x_ = (double)sum_x_ / n_points_;
+  mean_y_ = (double)sum_y_ / n_points_;
+  double sxx = sum_xx_ - sum_x_ * mean_x_;
+  double sxy = sum_xy_ - sum_x_ * mean_y_;
+  if (sxx <= 0 || sxy <= 0) {
+    return;
+  }
+
+  slope_ = sxy / sxx;
+  fitted_ = true;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "message_coder.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// number of recent samples the clock model fits over - at 2 kHz that's about
+// an eighth of a second, long enough to average out read batching and short
+// enough to follow drift
+const size_t SAMPLE_CLOCK_WINDOW = 256;
+
+// fewest samples the model needs before it trusts its own fit
+const size_t SAMPLE_CLOCK_MIN_FIT = 8;
+
+// how many periods further the counter can jump than the host clock says
+// have gone by before it's taken as the device restarting, rather than lost
+// samples
+const uint64_t SAMPLE_CLOCK_MAX_SKEW = 256;
+
+// a decoded data frame, tagged with when it arrived and when the clock model
+// reckons it was sampled
+struct TimedSample {
+  DataResponseRaw_t data;
+  uint64_t rx_ns;      // CLOCK_MONOTONIC, taken right after the read
+  uint64_t time_ns;    // estimated CLOCK_MONOTONIC sample time, see SampleClock
+  uint64_t sequence;   // `data.count`, unwrapped past 16 bits
+  uint32_t lost;       // samples missing from the counter right before this
+  float temperature_c; // NaN unless it came in a burst frame with one
+} typedef TimedSample_t;
+
+// online model of the device's sample clock against the host's
+//
+// the device only tells us a 16-bit sample count, and host receive times
+// jitter with however reads happen to get batched up. So the count is
+// unwrapped into a 64-bit sequence number (which also shows up gaps), and
+// receive time is fitted against it with a least squares line over the last
+// SAMPLE_CLOCK_WINDOW samples - reading the line back at a sample's sequence
+// number gives a sample time with the jitter smoothed out, and its slope is
+// the device's actual sample period.
+//
+// the fit is kept as running sums over the window - each sample adds one
+// point and drops the oldest, so it's O(1) per sample. The sums are exact
+// integers (points are relative to a base that is moved up every so often, to
+// keep them in range), so dropping points never accumulates rounding error.
+class SampleClock {
+public:
+  SampleClock() : has_time_(false), last_time_ns_(0) { reset(); };
+
+  // Fold in `sample` (its `data.count` and `rx_ns`), and fill in its
+  // `sequence`, `lost` and `time_ns`
+  void update(TimedSample_t &sample);
+
+  // Forget everything, e.g. after the device is reconfigured - except the
+  // last sample time handed out, which later ones still come after
+  void reset();
+
+  // current estimate of the device's sample period, 0 until there's a fit
+  double periodNs() const { return fitted_ ? slope_ : 0; };
+
+private:
+  // Add/remove a point from the sums
+  void addPoint(int64_t x, int64_t y);
+  void removePoint(int64_t x, int64_t y);
+
+  // Move the base up to the oldest point in the window, so the sums stay
+  // inside their range - returns false if even that isn't enough
+  bool rebase();
+
+  // Refit the line from the sums
+  void fit();
+
+  struct Point {
+    int64_t x; // sequence - base_sequence_
+    int64_t y; // rx_ns - base_ns_
+  };
+  std::array<Point, SAMPLE_CLOCK_WINDOW> window_;
+  size_t n_points_;
+  size_t next_point_;
+
+  // what the window's points are relative to
+  uint64_t base_sequence_;
+  uint64_t base_ns_;
+
+  int64_t sum_x_;
+  int64_t sum_y_;
+  int64_t sum_xx_;
+  int64_t sum_xy_;
+
+  // the fitted line, y = mean_y_ + slope_ * (x - mean_x_)
+  bool fitted_;
+  double slope_;
+  double mean_x_;
+  double mean_y_;
+
+  bool started_;
+  uint16_t last_count_;
+  uint64_t last_sequence_;
+  uint64_t last_rx_ns_;
+
+  // the last `time_ns` handed out, which survives reset()
+  bool has_time_;
+  uint64_t last_time_ns_;
+};
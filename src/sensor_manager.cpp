@@ -0,0 +1,100 @@
+#include "sensor_manager.h"
+#include "logger.h"
+#include <cerrno>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+// how often `run()` wakes up to check whether it should stop
+const int SENSOR_MANAGER_POLL_INTERVAL_MS = 50;
+
+SensorManager::SensorManager() : running_(true), failed_(0) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    throw std::runtime_error("Failed to create epoll instance");
+  }
+}
+
+SensorManager::~SensorManager() { close(epoll_fd_); }
+
+size_t SensorManager::addSensor(SensorDriver &driver) {
+  if (driver.isStreaming()) {
+    throw std::runtime_error("Can't manage a driver that is streaming");
+  }
+
+  size_t index = sensors_.size();
+
+  // the event carries the sensor's index, so there's no lookup on wakeup
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = index;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, driver.fd(), &event) != 0) {
+    throw std::runtime_error("Failed to add sensor to epoll set");
+  }
+
+  sensors_.push_back(&driver);
+  failed_sensors_.push_back(false);
+  return index;
+}
+
+void SensorManager::dropSensor(size_t index) {
+  logger().text(LogLevel::Error, "sensor port failed, dropping it");
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, sensors_[index]->fd(), nullptr);
+  failed_sensors_[index] = true;
+  failed_++;
+}
+
+size_t SensorManager::poll(int timeout_ms) {
+  struct epoll_event events[SENSOR_MANAGER_MAX_EVENTS];
+  TimedSample_t batch[SENSOR_MANAGER_SAMPLE_BATCH];
+  size_t n_delivered = 0;
+
+  int n_events =
+      epoll_wait(epoll_fd_, events, SENSOR_MANAGER_MAX_EVENTS, timeout_ms);
+  if (n_events < 0) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    throw std::runtime_error("Failed to wait on sensors");
+  }
+
+  for (int i = 0; i < n_events; i++) {
+    size_t index = events[i].data.u64;
+    auto &driver = *sensors_[index];
+
+    // one sensor's port going away is no reason to stop serving the others
+    try {
+      driver.serviceInput();
+    } catch (const std::runtime_error &) {
+      // whatever it decoded before that still goes out below
+      dropSensor(index);
+    }
+
+    size_t n_samples;
+    while ((n_samples = driver.popSamples(batch, SENSOR_MANAGER_SAMPLE_BATCH)) >
+           0) {
+      if (sample_callback_) {
+        for (size_t j = 0; j < n_samples; j++) {
+          auto &sample = batch[j];
+          sample_callback_(SensorSample{.sensor = index,
+                                        .rx_time_ns = sample.rx_ns,
+                                        .data = sample.data,
+                                        .time_ns = sample.time_ns,
+                                        .sequence = sample.sequence,
+                                        .lost = sample.lost});
+        }
+      }
+      n_delivered += n_samples;
+    }
+  }
+
+  return n_delivered;
+}
+
+void SensorManager::run() {
+  // `running_` starts out true and only `stop()` touches it, so a stop from
+  // a signal handler that beats us here isn't lost
+  while (running_.load(std::memory_order_acquire)) {
+    poll(SENSOR_MANAGER_POLL_INTERVAL_MS);
+  }
+}
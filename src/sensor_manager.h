@@ -0,0 +1,81 @@
+#pragma once
+#include "driver.h"
+#include "message_coder.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// most epoll events handled per `poll()` pass
+const size_t SENSOR_MANAGER_MAX_EVENTS = 64;
+
+// most samples pulled off one sensor at a time before handing them out
+const size_t SENSOR_MANAGER_SAMPLE_BATCH = 64;
+
+// a sample, tagged with which sensor it came from and when it was read
+struct SensorSample {
+  size_t sensor;
+  uint64_t rx_time_ns; // CLOCK_MONOTONIC, taken right after the read
+  DataResponseRaw_t data;
+  uint64_t time_ns;  // estimated sample time, from the driver's SampleClock
+  uint64_t sequence; // `data.count` unwrapped past 16 bits
+  uint32_t lost;     // samples missing right before this one
+};
+
+typedef std::function<void(const SensorSample &)> SensorSampleCallback;
+
+// drives any number of SensorDriver's from a single thread
+//
+// every driver's port is registered with one epoll set - when one becomes
+// readable, that driver reads and decodes whatever is waiting (without
+// blocking) and its samples are handed to the callback. Each driver keeps its
+// own receive buffer and decoder, so the streams never mix. Drivers can still
+// be sent commands from the thread calling `poll()`/`run()`.
+//
+// A sensor whose port closes or fails is dropped from the epoll set (and
+// counted in `failedCount()`) - the rest carry on without it.
+class SensorManager {
+public:
+  SensorManager();
+  ~SensorManager();
+  SensorManager(const SensorManager &) = delete;
+  SensorManager &operator=(const SensorManager &) = delete;
+
+  // Start watching `driver` (which must already be `init()`'d, and not
+  // streaming). Returns the index its samples will be tagged with.
+  size_t addSensor(SensorDriver &driver);
+
+  // Called (on the polling thread) with every sample from every sensor
+  void setSampleCallback(SensorSampleCallback callback) {
+    sample_callback_ = callback;
+  };
+
+  // Wait up to `timeout_ms` (-1 for forever) for input, service every sensor
+  // that has some, and return the number of samples delivered
+  size_t poll(int timeout_ms);
+
+  // `poll()` until `stop()` is called (from any thread). A `stop()` that
+  // comes before `run()` still counts - it returns straight away.
+  void run();
+  void stop() { running_.store(false, std::memory_order_release); };
+
+  size_t sensorCount() const { return sensors_.size(); };
+
+  // sensors dropped because their port closed or failed
+  size_t failedCount() const { return failed_; };
+
+  // whether sensor `index` has been dropped
+  bool hasFailed(size_t index) const { return failed_sensors_[index]; };
+
+private:
+  // stop watching sensor `index`, after its port closed or failed
+  void dropSensor(size_t index);
+
+  int epoll_fd_;
+  std::atomic<bool> running_;
+  std::vector<SensorDriver *> sensors_;
+  std::vector<bool> failed_sensors_;
+  size_t failed_;
+  SensorSampleCallback sample_callback_;
+};
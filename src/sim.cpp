@@ -1,77 +1,129 @@
 #include "sim.h"
+#include "clock.h"
 #include "gyro_xyz.h"
 #include "io_interface.h"
+#include "logger.h"
 #include "message_coder.h"
+#include <algorithm>
+#include <cerrno>
 #include <cmath>
-#include <csignal>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <ios>
 #include <iostream>
 #include <ostream>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 #include <vector>
 
-// running this as a non-blocking loop
-// this could be entirely event driven, but that's a little on the complicated
-// side of things
-uint8_t rate_mili = 100;
-uint8_t rate_micro = rate_mili * 1000;
+const int64_t NANOS_PER_SEC = 1000000000;
 
 SensorSim::SensorSim(IOInterface &interface)
-    : mode_(MODE_ARG_MANUAL), counter_(0), command_message_coder_(DELIM),
+    : truth_(&default_truth_), mode_(MODE_ARG_MANUAL), counter_(0),
+      burst_samples_(DEFAULT_BURST_SAMPLES), burst_temperature_(false),
+      burst_len_(0), burst_count_(0), start_ns_(0), tick_time_ns_(0),
+      cycle_stats_(), running_(true), drop_when_full_(false),
+      timer_fd_(-1), wake_fd_(-1),
+      tx_len_(0), tx_frames_(0), tx_frame_ends_(), output_stats_(),
+      command_message_coder_(DELIM),
       response_message_coder_(DELIM), data_response_message_coder_(DELIM),
-      io_interface_(interface){};
+      burst_coder_(DELIM), io_interface_(interface) {
+  setOutputRate(DEFAULT_OUTPUT_RATE_HZ);
+  resetRegisters();
+};
 
 SensorSim::SensorSim(MessageCoder<CommandRaw_t> command_coder,
                      MessageCoder<ResponseRaw_t> response_coder,
                      MessageCoder<DataResponseRaw_t> data_response_coder,
                      IOInterface &interface)
-    : mode_(MODE_ARG_MANUAL), counter_(0),
+    : truth_(&default_truth_), mode_(MODE_ARG_MANUAL), counter_(0),
+      burst_samples_(DEFAULT_BURST_SAMPLES), burst_temperature_(false),
+      burst_len_(0), burst_count_(0), start_ns_(0), tick_time_ns_(0),
+      cycle_stats_(), running_(true), drop_when_full_(false),
+      timer_fd_(-1), wake_fd_(-1),
+      tx_len_(0), tx_frames_(0), tx_frame_ends_(), output_stats_(),
       command_message_coder_(command_coder),
       response_message_coder_(response_coder),
       data_response_message_coder_(data_response_coder),
-      io_interface_(interface){};
+      burst_coder_(data_response_coder.getDelimiter()),
+      io_interface_(interface) {
+  setOutputRate(DEFAULT_OUTPUT_RATE_HZ);
+  resetRegisters();
+};
+
+void SensorSim::init() {
+  io_interface_.init();
+  truth_->init();
 
-void SensorSim::init() { io_interface_.init(); }
-void SensorSim::shutdown() { io_interface_.shutdown(); }
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (timer_fd_ < 0 || wake_fd_ < 0) {
+    throw std::runtime_error("Failed to create sim timer");
+  }
+}
+
+void SensorSim::shutdown() {
+  io_interface_.shutdown();
+  truth_->shutdown();
+
+  if (timer_fd_ >= 0) {
+    close(timer_fd_);
+    timer_fd_ = -1;
+  }
+  if (wake_fd_ >= 0) {
+    close(wake_fd_);
+    wake_fd_ = -1;
+  }
+}
 
 void SensorSim::processInput() {
   // this is somewhat similar to the SensorDriver::receiveX() functions
   // although it's a little easier since we only need to receive one type of
   // data (CommandRaw_t's).
-  // And yeah, this is all pretty hacky, and likely not
-  // performant - I'm admittedly pretty weak in this area.
-
-  uint8_t cmd_frame_len;
-  int bytes_avail;
 
-  // no data available - do nothing and move on
-  if ((bytes_avail = io_interface_.availableBytes()) < 1) {
-    return;
-  }
+  const size_t cmd_batch_size = 16;
+  CommandRaw_t cmds[cmd_batch_size];
+  size_t n_cmds;
 
-  // append received bytes to an internal byte buffer, which is used
-  // in case we get a partial message on a cycle
-  std::vector<uint8_t> rxBytes = io_interface_.receive(bytes_avail);
-  rx_.insert(rx_.end(), rxBytes.begin(), rxBytes.end());
+  // read straight into an internal byte ring, which is used in case we get a
+  // partial message. This only runs once epoll says there's something to
+  // read, so a deadline of now just takes what's there (if there's more than
+  // fits, epoll will tell us again).
+  auto result = io_interface_.receiveInto(rx_.writableSpan(),
+                                          std::chrono::steady_clock::now());
+  rx_.commit(result.bytes);
 
-  // no *enough* data available - do nothing and move on
-  if (rx_.size() < (cmd_frame_len = command_message_coder_.getFrameLength())) {
+  if (result.status == IOStatus::Closed) {
+    logger().text(LogLevel::Info, "port closed, stopping");
+    stop();
     return;
   }
 
-  // Parse stream of bytes into a set of commands, if any are found
-  // Note: `deFrame` consumes `rx_` in the process - there's likely a better way
-  // but I just wanted to keep the edge-case logic to a minimum for parsing.
-  std::vector<CommandRaw_t> cmds = command_message_coder_.deFrame(rx_);
-
-  // Add each command to the internal commands queue - I think I could do this
-  // with an in-place `insert`, but I ran out of time and wanted to do it this
-  // way for readability
-  for (auto &cmd : cmds) {
-    printMessage(cmd);
-    commands_.insert(commands_.begin(), cmd);
+  // Parse stream of bytes into a set of commands, if any are found, and add
+  // each one to the internal commands queue.
+  // Note: `deFrame` only consumes complete commands (and junk in front of
+  // them) out of `rx_`, a trailing partial command waits for the next cycle.
+  size_t buffered = rx_.size();
+  size_t total_cmds = 0;
+  while ((n_cmds = command_message_coder_.deFrame(rx_, cmds,
+                                                  cmd_batch_size)) > 0) {
+    for (size_t i = 0; i < n_cmds; i++) {
+      logger().frame(LogLevel::Debug, cmds[i]);
+      commands_.push_back(cmds[i]);
+    }
+    total_cmds += n_cmds;
   }
+
+  // whatever was consumed that didn't make it into a command was junk
+  size_t consumed = buffered - rx_.size();
+  commands_received_.add(total_cmds);
+  discarded_bytes_.add(consumed -
+                       total_cmds * command_message_coder_.getFrameLength());
 }
 
 void SensorSim::processCommands() {
@@ -84,66 +136,206 @@ void SensorSim::processCommands() {
   }
 }
 
-void SensorSim::dispatchCommand(CommandRaw_t &cmd) {
-  // big switch statement to handle all of the command types
-  // The commands really should be an enum, but I got a bit strapped for time
-  // and figured in place of a refactor I could just explain myself.
+// in RegEffect order
+const std::array<SensorSim::RegisterHandler, size_t(RegEffect::Count)>
+    SensorSim::REGISTER_HANDLERS = {
+        &SensorSim::handleStorage,   &SensorSim::handleData,
+        &SensorSim::handleMode,      &SensorSim::handleBurstControl,
+        &SensorSim::handleSoftReset, &SensorSim::handleReadBack,
+};
 
-  switch (cmd.addr) {
-  case DATA_GET_REG:
-    data_responses_.push_back(DataResponseRaw_t{.addr = DATA_GET_REG,
-                                                .count = counter_,
-                                                .x_rate = x_rate_,
-                                                .y_rate = y_rate_,
-                                                .z_rate = z_rate_,
-                                                .delim = DELIM});
-    counter_++;
-    return;
-  case VERSION_GET_REG:
-    responses_.push_back(
-        ResponseRaw_t{.addr = VERSION_GET_REG, .data = 0x23, .delim = DELIM});
-    return;
-  case MODE_SET_REG:
-    setMode(cmd.data);
-    responses_.push_back(
-        ResponseRaw_t{.addr = MODE_SET_REG, .data = mode_, .delim = DELIM});
-    return;
-  case MODE_GET_REG:
-    responses_.push_back(
-        ResponseRaw_t{.addr = MODE_GET_REG, .data = mode_, .delim = DELIM});
-    return;
-  default:
+void SensorSim::dispatchCommand(CommandRaw_t &cmd) {
+  // one lookup for the register, one for its handler - however many
+  // registers there are
+  auto reg = findRegister(cmd.addr);
+  if (!reg) {
     // we could error here, but I figured the real imu wouldn't crash in this
-    // case
-    std::cout << "command not found: " << std::hex << (int)cmd.addr
-              << std::endl;
+    // case - log the offending command instead
+    unknown_commands_.add();
+    logger().text(LogLevel::Error, "command not found:");
+    logger().frame(LogLevel::Error, cmd);
     return;
   }
+  (this->*REGISTER_HANDLERS[size_t(reg->effect)])(*reg, cmd);
+}
+
+void SensorSim::respondWithRegister(uint8_t addr) {
+  responses_.push_back(
+      ResponseRaw_t{.addr = addr, .data = registers_[addr], .delim = DELIM});
+}
+
+void SensorSim::handleStorage(const RegisterDef_t &reg,
+                              const CommandRaw_t &cmd) {
+  if (reg.access == RegAccess::ReadWrite) {
+    registers_[cmd.addr] = cmd.data;
+  }
+  respondWithRegister(cmd.addr);
+}
+
+void SensorSim::handleData(const RegisterDef_t &, const CommandRaw_t &) {
+  data_responses_.push_back(DataResponseRaw_t{.addr = DATA_GET_REG,
+                                              .count = counter_,
+                                              .x_rate = x_rate_,
+                                              .y_rate = y_rate_,
+                                              .z_rate = z_rate_,
+                                              .delim = DELIM});
+  counter_++;
+}
+
+void SensorSim::handleMode(const RegisterDef_t &, const CommandRaw_t &cmd) {
+  setMode(cmd.data);
+  respondWithRegister(cmd.addr);
+}
+
+void SensorSim::handleBurstControl(const RegisterDef_t &,
+                                   const CommandRaw_t &cmd) {
+  registers_[cmd.addr] = setBurstControl(cmd.data);
+  respondWithRegister(cmd.addr);
+}
+
+void SensorSim::handleSoftReset(const RegisterDef_t &,
+                                const CommandRaw_t &cmd) {
+  if (cmd.data & GLOB_CMD_SOFT_RESET) {
+    logger().text(LogLevel::Info, "soft reset");
+    resetRegisters();
+  }
+  respondWithRegister(cmd.addr);
+}
+
+void SensorSim::handleReadBack(const RegisterDef_t &,
+                               const CommandRaw_t &cmd) {
+  if (!isReadable(cmd.data)) {
+    unknown_commands_.add();
+    logger().text(LogLevel::Error, "register not readable:");
+    logger().frame(LogLevel::Error, cmd);
+    return;
+  }
+  respondWithRegister(cmd.data);
+}
+
+void SensorSim::resetRegisters() {
+  registers_.fill(0);
+  for (auto &reg : REGISTER_MAP) {
+    for (size_t offset = 0; offset < reg.width; offset++) {
+      registers_[reg.addr + offset] = uint8_t(reg.reset >> (8 * offset));
+    }
+  }
+
+  // and the state behind them
+  setMode(registers_[MODE_SET_REG]);
+  registers_[BURST_CTRL_REG] = setBurstControl(registers_[BURST_CTRL_REG]);
 }
 
 void SensorSim::processResponses() {
+  // everything pending gets framed back to back into `tx_`, and goes out in
+  // a single write at the end (or sooner, if it fills up)
   while (responses_.size() > 0) {
     auto &resp = *responses_.begin();
-    printMessage(resp);
+    logger().frame(LogLevel::Debug, resp);
     issueResponse(resp);
     responses_.pop_front();
   }
   while (data_responses_.size() > 0) {
     auto &resp = *data_responses_.begin();
-    printMessage(resp);
+    logger().frame(LogLevel::Debug, resp);
     issueResponse(resp);
     data_responses_.pop_front();
   }
+  flushOutput();
 }
 
 void SensorSim::issueResponse(ResponseRaw_t &resp) {
-  io_interface_.send(response_message_coder_.frame(resp));
-  return;
+  size_t len;
+  while ((len = response_message_coder_.frame(
+              resp, std::span<uint8_t>(tx_).subspan(tx_len_))) == 0) {
+    flushOutput();
+  }
+  commitFrame(len);
 }
 
 void SensorSim::issueResponse(DataResponseRaw_t &resp) {
-  io_interface_.send(data_response_message_coder_.frame(resp));
-  return;
+  size_t len;
+  while ((len = data_response_message_coder_.frame(
+              resp, std::span<uint8_t>(tx_).subspan(tx_len_))) == 0) {
+    flushOutput();
+  }
+  commitFrame(len);
+}
+
+void SensorSim::issueBurst() {
+  if (burst_len_ == 0) {
+    return;
+  }
+
+  auto header = BurstHeaderRaw_t{
+      .addr = BURST_DATA_REG,
+      .flags = burst_temperature_ ? BURST_FLAG_TEMPERATURE : (uint8_t)0,
+      .samples = (uint8_t)burst_len_,
+      .count = burst_count_};
+  logger().frame(LogLevel::Debug, header);
+
+  // a couple of degrees of drift around room temperature
+  double temperature_c = 25 + 2 * std::sin(2 * M_PI * tick_time_ns_ / 60e9);
+  auto temperature =
+      (int16_t)std::lround(temperature_c * BURST_TEMPERATURE_SCALE);
+
+  auto samples = std::span<const BurstSampleRaw_t>(burst_.data(), burst_len_);
+  size_t len;
+  while ((len = burst_coder_.frame(header, temperature, samples,
+                                   std::span<uint8_t>(tx_).subspan(tx_len_))) ==
+         0) {
+    flushOutput();
+  }
+  commitFrame(len);
+  burst_len_ = 0;
+}
+
+void SensorSim::commitFrame(size_t len) {
+  tx_len_ += len;
+  tx_frame_ends_[tx_frames_++] = tx_len_;
+}
+
+void SensorSim::flushOutput() {
+  if (tx_len_ == 0) {
+    return;
+  }
+
+  // don't let a reader that isn't keeping up stall the sample clock for
+  // more than a period (or at all, if it's shared) - a real sensor would
+  // just lose the data too
+  auto deadline = std::chrono::steady_clock::now();
+  if (!drop_when_full_) {
+    deadline += std::chrono::nanoseconds(period_ns_);
+  }
+  auto result = io_interface_.sendSome(
+      std::span<const uint8_t>(tx_.data(), tx_len_), deadline);
+
+  // frames that made it all the way out
+  size_t n_sent = 0;
+  while (n_sent < tx_frames_ && tx_frame_ends_[n_sent] <= result.bytes) {
+    n_sent++;
+  }
+
+  auto &stats = output_stats_;
+  stats.writes++;
+  stats.frames += n_sent;
+  stats.dropped_frames += tx_frames_ - n_sent;
+
+  size_t cut_at = n_sent > 0 ? tx_frame_ends_[n_sent - 1] : 0;
+  if (result.status == IOStatus::Timeout && result.bytes > cut_at) {
+    // the reader has the start of a frame - keep the rest of it to go out
+    // ahead of everything else, rather than leave it to resync on garbage
+    size_t end = tx_frame_ends_[n_sent];
+    std::memmove(tx_.data(), tx_.data() + result.bytes, end - result.bytes);
+    stats.dropped_frames--;
+    tx_len_ = end - result.bytes;
+    tx_frame_ends_[0] = tx_len_;
+    tx_frames_ = 1;
+    return;
+  }
+
+  tx_len_ = 0;
+  tx_frames_ = 0;
 }
 
 void SensorSim::processMode() {
@@ -162,68 +354,267 @@ void SensorSim::processMode() {
                                                 .delim = DELIM});
     counter_++;
     return;
+  case MODE_ARG_BURST:
+    // gathered up, and only sent once there's a whole burst's worth
+    if (burst_len_ == 0) {
+      burst_count_ = counter_;
+    }
+    burst_[burst_len_++] = BurstSampleRaw_t{
+        .x_rate = x_rate_, .y_rate = y_rate_, .z_rate = z_rate_};
+    counter_++;
+    if (burst_len_ >= burst_samples_) {
+      issueBurst();
+    }
+    return;
   case MODE_ARG_MANUAL:
     return;
   case MODE_ARG_CONFIG:
     return;
   default:
-    std::cout << "unrecognizd mode: " << std::hex << (int)mode_ << std::endl;
+    // this runs every tick, so it has to stay cheap
+    logger().text(LogLevel::Error, "unrecognized mode");
     return;
   }
 }
 
 void SensorSim::getTruth() {
-  // this is where we'd customize how the sim gets the "truth" data
-  // e.g. retrieve it from a file of timestamps/uptimes + rates
-  // or retrieve it from a udp socket.
-  // In this case we're just setting the data to a sin function.
-
-  float time = (counter_ * rate_mili) / 1000.0; // time in seconds
-  float w = 0.5 * 2 * M_PI;                     // 0.05 Hz oscillation
-  x_rate_ = 0.75 * std::sin(time * w);
-  y_rate_ = 0.75 * std::sin(time * w + 0.66 * M_PI);
-  z_rate_ = 0.75 * std::sin(time * w + 1.22 * M_PI);
-  return;
+  // the sine waves by default, or a recorded trajectory, see
+  // `setTruthSource()`
+  TruthSample_t truth = truth_->at(tick_time_ns_);
+  x_rate_ = truth.x_rate;
+  y_rate_ = truth.y_rate;
+  z_rate_ = truth.z_rate;
 };
 
 void SensorSim::run() {
-  // every "cycle" loop through the standard set of tasks
-  while (1) {
+  // Event driven: everything hangs off one epoll set, which wakes us up for
+  // a.) the sample clock (a timerfd) ticking - generate data, or;
+  // b.) command bytes arriving - answer them straight away, or;
+  // c.) `stop()` being called.
+  // and otherwise we sit idle in epoll_wait.
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    throw std::runtime_error("Failed to create epoll instance");
+  }
+
+  int fds[] = {timer_fd_, io_interface_.fd(), wake_fd_};
+  for (int fd : fds) {
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close(epoll_fd);
+      throw std::runtime_error("Failed to add fd to epoll set");
+    }
+  }
+
+  startClock(monotonicNanos());
+
+  // the timer runs off the same absolute deadlines as the sample clock
+  int64_t first_ns = nextTickNs();
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = first_ns / NANOS_PER_SEC;
+  spec.it_value.tv_nsec = first_ns % NANOS_PER_SEC;
+  spec.it_interval.tv_sec = period_ns_ / NANOS_PER_SEC;
+  spec.it_interval.tv_nsec = period_ns_ % NANOS_PER_SEC;
+  if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+    close(epoll_fd);
+    throw std::runtime_error("Failed to start sample clock");
+  }
+
+  const int max_events = 3;
+  struct epoll_event events[max_events];
+
+  // `running_` starts out true and only `stop()` (or the port closing)
+  // clears it, so a stop that came in before we got here still counts
+  while (running_.load(std::memory_order_acquire)) {
+    int n_events = epoll_wait(epoll_fd, events, max_events, -1);
+    if (n_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      close(epoll_fd);
+      throw std::runtime_error("Failed to wait for events");
+    }
+
+    for (int i = 0; i < n_events; i++) {
+      if (events[i].data.fd == timer_fd_) {
+        handleTimer();
+      } else if (events[i].data.fd == wake_fd_) {
+        // only ever written by `stop()`, loop condition handles the rest
+        uint64_t value;
+        if (read(wake_fd_, &value, sizeof(value)) < 0) {
+          // nothing to do - it was already drained
+        }
+      } else {
+        serviceInput();
+      }
+    }
+  }
+
+  close(epoll_fd);
+}
+
+void SensorSim::stop() {
+  running_.store(false, std::memory_order_release);
+
+  // kick `run()` out of epoll_wait - write() is fine in a signal handler
+  uint64_t value = 1;
+  if (wake_fd_ >= 0 && write(wake_fd_, &value, sizeof(value)) < 0) {
+    // eventfd is already signalled, which is just as good
+  }
+}
+
+void SensorSim::startClock(int64_t start_ns) {
+  // cycles are scheduled against absolute deadlines on CLOCK_MONOTONIC, so
+  // however long the work in a cycle takes, it doesn't push the next one
+  // back - the rate stays put instead of drifting with load.
+  start_ns_ = start_ns;
+  tick_time_ns_ = 0;
+}
+
+void SensorSim::advanceTo(int64_t now_ns) {
+  // normally one cycle is due, more if we fell behind - run a cycle for each,
+  // so the data rate comes out right even after a stall
+  while (nextTickNs() <= now_ns) {
+    tick_time_ns_ += period_ns_;
+    recordCycle(now_ns - (start_ns_ + tick_time_ns_));
+
     getTruth();
 
     processMode();
+  }
 
-    // retrieve bytes from uart, and deframe them as commands
-    // this should be non-blocking, intentionally
-    processInput();
+  processResponses();
+}
 
-    processCommands();
+void SensorSim::handleTimer() {
+  // the timerfd only tells us that a period (or more) has gone by -
+  // `advanceTo` works out how many from the time
+  uint64_t expirations;
+  if (read(timer_fd_, &expirations, sizeof(expirations)) !=
+      sizeof(expirations)) {
+    return;
+  }
 
-    processResponses();
+  advanceTo(monotonicNanos());
+}
 
-    // the time-cycling of this is very poorly done - totally understood that
-    // this loop will take longer than `rate_micro`, and it won't be consistent.
-    // The proper way to do this is one of:
-    // a.) rearchitect the input to be event-driven - which I think makes the
-    // state/mode logic more complicated, or;
-    // b.) run this asyncronously, or calculate some `wait_until` here, or;
-    // c.) run this loop off of an interrupt
-    //
-    // there are probably others, and I'm far from an expert on all the choices
-    usleep(rate_micro);
+void SensorSim::step() {
+  // commands that came in "during" the last period - checked first without
+  // a syscall, as most steps won't have any
+  if (io_interface_.availableBytes() > 0) {
+    serviceInput();
   }
+
+  tick_time_ns_ += period_ns_;
+  getTruth();
+  processMode();
+  processResponses();
 }
 
-void SensorSim::setMode(uint8_t mode) { mode_ = mode; }
+void SensorSim::serviceInput() {
+  // retrieve bytes from uart, and deframe them as commands, then answer them
+  // right away rather than waiting for the next tick
+  uint64_t start_ns = monotonicNanos();
 
-int main() {
-  std::string myport("/tmp/ttySIM");
-  IOInterface myio = IOInterface(myport, 38400);
-  SensorSim mysim = SensorSim(myio);
+  processInput();
 
-  mysim.init();
-  mysim.run();
-  mysim.shutdown();
+  processCommands();
 
-  return 0;
+  processResponses();
+
+  turnaround_ns_.record(monotonicNanos() - start_ns);
+}
+
+void SensorSim::setOutputRate(double rate_hz) {
+  if (rate_hz < MIN_OUTPUT_RATE_HZ || rate_hz > MAX_OUTPUT_RATE_HZ) {
+    throw std::runtime_error("Output rate out of range");
+  }
+  output_rate_hz_ = rate_hz;
+  period_ns_ = std::llround(NANOS_PER_SEC / rate_hz);
+}
+
+void SensorSim::recordCycle(int64_t lateness_ns) {
+  // Welford's running mean/variance - O(1) and nothing stored per cycle
+  auto &stats = cycle_stats_;
+
+  stats.cycles++;
+  if (lateness_ns >= period_ns_) {
+    stats.overruns++;
+  }
+  if (stats.cycles == 1 || lateness_ns < stats.min_lateness_ns) {
+    stats.min_lateness_ns = lateness_ns;
+  }
+  if (stats.cycles == 1 || lateness_ns > stats.max_lateness_ns) {
+    stats.max_lateness_ns = lateness_ns;
+  }
+
+  double delta = lateness_ns - stats.mean_lateness_ns;
+  stats.mean_lateness_ns += delta / stats.cycles;
+  stats.m2_lateness_ns += delta * (lateness_ns - stats.mean_lateness_ns);
+}
+
+double OutputStats::framesPerWrite() const {
+  return writes > 0 ? (double)(frames + dropped_frames) / writes : 0;
+}
+
+double CycleStats::stddevLatenessNs() const {
+  return cycles > 1 ? std::sqrt(m2_lateness_ns / (cycles - 1)) : 0;
+}
+
+void SensorSim::printStats() const {
+  auto &stats = cycle_stats_;
+  std::cout << "cycles: " << stats.cycles << " at " << output_rate_hz_
+            << " Hz, overruns: " << stats.overruns
+            << ", lateness (us) min: " << stats.min_lateness_ns / 1e3
+            << ", max: " << stats.max_lateness_ns / 1e3
+            << ", mean: " << stats.mean_lateness_ns / 1e3
+            << ", stddev: " << stats.stddevLatenessNs() / 1e3 << std::endl;
+
+  auto &output = output_stats_;
+  std::cout << "output frames: " << output.frames << " in " << output.writes
+            << " writes (" << output.framesPerWrite()
+            << " per write), dropped: " << output.dropped_frames << std::endl;
+}
+
+SimMetrics_t SensorSim::metrics() const {
+  return SimMetrics_t{.commands_received = commands_received_.value(),
+                      .unknown_commands = unknown_commands_.value(),
+                      .discarded_bytes = discarded_bytes_.value(),
+                      .turnaround_ns = turnaround_ns_.snapshot(),
+                      .io = io_interface_.metrics()};
+}
+
+void writeJson(std::ostream &os, const SimMetrics_t &metrics) {
+  os << "{\"commands_received\": " << metrics.commands_received
+     << ", \"unknown_commands\": " << metrics.unknown_commands
+     << ", \"discarded_bytes\": " << metrics.discarded_bytes
+     << ", \"turnaround_ns\": ";
+  writeJson(os, metrics.turnaround_ns);
+  os << ", \"io\": ";
+  writeJson(os, metrics.io);
+  os << "}";
+}
+
+void SensorSim::setMode(uint8_t mode) {
+  // send whatever's left of the current burst rather than lose it
+  if (mode_ == MODE_ARG_BURST && mode != MODE_ARG_BURST) {
+    issueBurst();
+  }
+  mode_ = mode;
+  registers_[MODE_SET_REG] = mode_;
+  registers_[MODE_GET_REG] = mode_;
+}
+
+uint8_t SensorSim::setBurstControl(uint8_t control) {
+  // out of range sample counts are clamped rather than rejected, and the
+  // response says what was actually applied
+  burst_samples_ = std::clamp<size_t>(control & BURST_CTRL_SAMPLES_MASK, 1,
+                                      BURST_MAX_SAMPLES);
+  burst_temperature_ = control & BURST_CTRL_TEMPERATURE;
+  if (burst_len_ >= burst_samples_) {
+    issueBurst();
+  }
+  return burst_samples_ | (burst_temperature_ ? BURST_CTRL_TEMPERATURE : 0);
 }
@@ -1,8 +1,68 @@
 #pragma once
+#include "byte_ring.h"
 #include "io_interface.h"
 #include "message_coder.h"
+#include "metrics.h"
+#include "register_map.h"
+#include "truth_source.h"
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <deque>
+#include <ostream>
+
+// data output rates the G370 supports, in Hz (DOUT_RATE register)
+const double G370_DATA_RATES_HZ[] = {2000, 1000, 500, 400, 250, 200,
+                                     125,  100,  80,  62.5, 50, 40,
+                                     31.25, 25,  20,  15.625};
+
+// range of output rates the sim will run at - the table above, plus slower
+// rates for watching things by eye
+const double MIN_OUTPUT_RATE_HZ = 1;
+const double MAX_OUTPUT_RATE_HZ = 2000;
+const double DEFAULT_OUTPUT_RATE_HZ = 10;
+
+// how far the sim's cycles wake up from their deadlines
+struct CycleStats {
+  uint64_t cycles;
+  uint64_t overruns; // cycles that woke up a full period (or more) late
+  int64_t min_lateness_ns;
+  int64_t max_lateness_ns;
+  double mean_lateness_ns;
+  double m2_lateness_ns; // running sum of squared deviations, for the stddev
+
+  double stddevLatenessNs() const;
+};
+
+// size of the buffer responses are batched up in before being written out
+const size_t SIM_TX_BUFFER_SIZE = 4096;
+
+// most frames that fit in it - none is shorter than a plain response
+const size_t SIM_TX_MAX_FRAMES = SIM_TX_BUFFER_SIZE / sizeof(ResponseRaw_t);
+static_assert(SIM_TX_BUFFER_SIZE <= UINT16_MAX,
+              "frame ends in the tx buffer are kept as uint16_t");
+
+// how well output is being coalesced into writes
+struct OutputStats {
+  uint64_t frames;         // frames written out
+  uint64_t writes;         // write syscalls it took
+  uint64_t dropped_frames; // frames thrown away because the port stalled
+
+  double framesPerWrite() const;
+};
+
+// see `SensorSim::metrics()`
+struct SimMetrics {
+  uint64_t commands_received;
+  uint64_t unknown_commands; // received, but not for any register we know
+  uint64_t discarded_bytes;  // junk skipped over between commands
+  // from command bytes coming in to the responses going out
+  HistogramSnapshot_t turnaround_ns;
+  IOMetrics_t io;
+} typedef SimMetrics_t;
+
+// Writes `metrics` as a JSON object
+void writeJson(std::ostream &os, const SimMetrics_t &metrics);
 
 // top-level driver class
 class SensorSim {
@@ -18,7 +78,68 @@ public:
   void run();
   void shutdown();
 
+  // make `run()` return - safe to call from a signal handler or another
+  // thread, and before `run()` has started (it then returns straight away)
+  void stop();
+
+  // Virtual time, in place of `run()`: run one cycle of the sample clock
+  // straight away instead of waiting for the timer, answering any commands
+  // that have come in first. Whatever calls this sets the pace - see
+  // `VirtualInterface`, which steps the sim as fast as a driver reads.
+  void step();
+
+  // how far the sample clock has got, i.e. the time `getTruth` and the
+  // samples are at - in virtual time, the only clock the sim has
+  int64_t simTimeNs() const { return tick_time_ns_; };
+
+  // Hosting, also in place of `run()` - for running the sim off someone
+  // else's event loop (see `SimHost`), which owns the timing:
+  // - `startClock(start_ns)` starts the sample clock at CLOCK_MONOTONIC
+  //   `start_ns`;
+  // - `nextTickNs()` is when its next cycle is due, and `advanceTo(now_ns)`
+  //   runs every cycle due by `now_ns`;
+  // - `serviceInput()` answers commands, whenever `inputFd()` polls
+  //   readable.
+  void startClock(int64_t start_ns);
+  int64_t nextTickNs() const { return start_ns_ + tick_time_ns_ + period_ns_; };
+  void advanceTo(int64_t now_ns);
+  void serviceInput();
+  int inputFd() const { return io_interface_.fd(); };
+
+  // false once `stop()` has been called (or the port has closed)
+  bool isRunning() const { return running_.load(std::memory_order_acquire); };
+
+  // Drop output straight away when the port is full, rather than waiting up
+  // to a period for the reader to catch up - for sims that share a thread,
+  // where one stalled port would hold up all the others
+  void setDropWhenFull(bool drop) { drop_when_full_ = drop; };
+
+  // set the rate `run()` cycles (and emits auto-mode data) at, in Hz
+  void setOutputRate(double rate_hz);
+  double getOutputRate() const { return output_rate_hz_; };
+
+  // timing of `run()`'s cycles so far
+  const CycleStats &getCycleStats() const { return cycle_stats_; };
+
+  // how responses have been written out so far
+  const OutputStats &getOutputStats() const { return output_stats_; };
+
+  // print both of the above
+  void printStats() const;
+
+  // take the rates samples report from `truth` rather than the built-in sine
+  // waves - `truth` has to outlive the sim, and is initialized and shut down
+  // along with it, so set it before `init()`
+  void setTruthSource(TruthSource &truth) { truth_ = &truth; };
+
+  // command/response counters and latencies - unlike the stats above, safe to
+  // call from another thread while `run()` is going
+  SimMetrics_t metrics() const;
+
 private:
+  // the sample clock's timerfd ticked: generate data for each elapsed period
+  void handleTimer();
+
   // retrieve bytes from io, and add to command queue
   void processInput();
 
@@ -29,35 +150,116 @@ private:
   // process responses on the response queue
   void processResponses();
 
-  // dispatch an individual command
+  // dispatch an individual command - looked up in the register map, and
+  // handed to the handler for its register's effect
   void dispatchCommand(CommandRaw_t &cmd);
 
-  // issue an invididual response
+  // Register handlers, one per RegEffect - each applies `cmd` to `reg` and
+  // queues the response
+  typedef void (SensorSim::*RegisterHandler)(const RegisterDef_t &reg,
+                                             const CommandRaw_t &cmd);
+  static const std::array<RegisterHandler, size_t(RegEffect::Count)>
+      REGISTER_HANDLERS;
+  void handleStorage(const RegisterDef_t &reg, const CommandRaw_t &cmd);
+  void handleData(const RegisterDef_t &reg, const CommandRaw_t &cmd);
+  void handleMode(const RegisterDef_t &reg, const CommandRaw_t &cmd);
+  void handleBurstControl(const RegisterDef_t &reg, const CommandRaw_t &cmd);
+  void handleSoftReset(const RegisterDef_t &reg, const CommandRaw_t &cmd);
+  void handleReadBack(const RegisterDef_t &reg, const CommandRaw_t &cmd);
+
+  // queue a response with the register file's value for `addr`
+  void respondWithRegister(uint8_t addr);
+
+  // put every register back to its reset value, along with the state behind
+  // them
+  void resetRegisters();
+
+  // issue an invididual response - this only frames it into `tx_`, it goes
+  // out on the next `flushOutput()`
   void issueResponse(ResponseRaw_t &rsp);
   void issueResponse(DataResponseRaw_t &rsp);
 
+  // frame the samples gathered up in `burst_` into `tx_` as one burst frame
+  void issueBurst();
+
+  // count the `len` bytes just framed onto the end of `tx_` as a frame
+  void commitFrame(size_t len);
+
+  // write out everything in `tx_` in one go. If the port stalls, whole frames
+  // that didn't go out are dropped, but one that was cut off part way is kept
+  // to be finished first next time, so the stream never has half a frame in
+  // it.
+  void flushOutput();
+
   // handle any per-mode logic
   void processMode();
 
   // sets the device to be in `mode`
   void setMode(uint8_t mode);
 
+  // applies a BURST_CTRL_REG write, returns the configuration it ended up
+  // with
+  uint8_t setBurstControl(uint8_t control);
+
   void getTruth();
 
+  // fold one cycle's wake-up lateness into `cycle_stats_`
+  void recordCycle(int64_t lateness_ns);
+
+  // where getTruth gets them from
+  SineTruth default_truth_;
+  TruthSource *truth_;
+
   // current rate values (populated by getTruth)
   float x_rate_;
   float y_rate_;
   float z_rate_;
 
+  // the register file, by address - every readable register's value lives
+  // here. The state behind the ones with side effects (mode, burst
+  // configuration) is kept in step with it.
+  std::array<uint8_t, 256> registers_;
+
   // the current mode
   uint8_t mode_;
 
   // the current sample count - increments for ever data response
   uint16_t counter_;
 
+  // burst mode: samples per frame, whether to add the temperature, and the
+  // samples gathered so far for the next frame
+  size_t burst_samples_;
+  bool burst_temperature_;
+  std::array<BurstSampleRaw_t, BURST_MAX_SAMPLES> burst_;
+  size_t burst_len_;
+  uint16_t burst_count_;
+
+  // cycle timing
+  double output_rate_hz_;
+  int64_t period_ns_;
+  // CLOCK_MONOTONIC time the sample clock started at
+  int64_t start_ns_;
+  // scheduled time of the current cycle, relative to `start_ns_`
+  int64_t tick_time_ns_;
+  CycleStats cycle_stats_;
+  std::atomic<bool> running_;
+  bool drop_when_full_;
+
+  // sample clock, and the eventfd `stop()` uses to wake up `run()`
+  int timer_fd_;
+  int wake_fd_;
+
+  // framed responses waiting to be written out
+  std::array<uint8_t, SIM_TX_BUFFER_SIZE> tx_;
+  size_t tx_len_;
+  size_t tx_frames_;
+  // where each frame in `tx_` ends
+  std::array<uint16_t, SIM_TX_MAX_FRAMES> tx_frame_ends_;
+  OutputStats output_stats_;
+
   // fifo queues for commands and respones
   std::deque<CommandRaw_t> commands_;
-  std::vector<uint8_t> rx_;
+  ByteRing rx_;
   std::deque<ResponseRaw_t> responses_;
   std::deque<DataResponseRaw_t> data_responses_;
 
@@ -65,7 +267,14 @@ private:
   MessageCoder<CommandRaw_t> command_message_coder_;
   MessageCoder<ResponseRaw_t> response_message_coder_;
   MessageCoder<DataResponseRaw_t> data_response_message_coder_;
+  BurstCoder burst_coder_;
 
   // uart io
   IOInterface &io_interface_;
+
+  // instrumentation
+  Counter commands_received_;
+  Counter unknown_commands_;
+  Counter discarded_bytes_;
+  LatencyHistogram turnaround_ns_;
 };
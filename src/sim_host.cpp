@@ -0,0 +1,140 @@
+#include "sim_host.h"
+#include "clock.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// epoll tags for the host's own fds - sims are tagged with their index
+static const uint64_t TIMER_TAG = std::numeric_limits<uint64_t>::max();
+static const uint64_t WAKE_TAG = TIMER_TAG - 1;
+
+// Add `fd` to `epoll_fd`'s set, tagged `tag`
+static void watch(int epoll_fd, int fd, uint64_t tag) {
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = tag;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    throw std::runtime_error("Failed to add fd to epoll set");
+  }
+}
+
+SimHost::SimHost() : running_(true) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || timer_fd_ < 0 || wake_fd_ < 0) {
+    throw std::runtime_error("Failed to set up sim host");
+  }
+  watch(epoll_fd_, timer_fd_, TIMER_TAG);
+  watch(epoll_fd_, wake_fd_, WAKE_TAG);
+}
+
+SimHost::~SimHost() {
+  close(epoll_fd_);
+  close(timer_fd_);
+  close(wake_fd_);
+}
+
+size_t SimHost::addSim(SensorSim &sim) {
+  size_t index = sims_.size();
+  watch(epoll_fd_, sim.inputFd(), index);
+  sim.setDropWhenFull(true);
+  sims_.push_back(&sim);
+  return index;
+}
+
+void SimHost::run() {
+  int64_t start_ns = monotonicNanos();
+  for (auto sim : sims_) {
+    sim->startClock(start_ns);
+  }
+  armTimer();
+
+  struct epoll_event events[SIM_HOST_MAX_EVENTS];
+  while (running_.load(std::memory_order_acquire)) {
+    int n_events = epoll_wait(epoll_fd_, events, SIM_HOST_MAX_EVENTS, -1);
+    if (n_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error("Failed to wait for events");
+    }
+
+    for (int i = 0; i < n_events; i++) {
+      uint64_t tag = events[i].data.u64;
+      if (tag == TIMER_TAG) {
+        handleTimer();
+      } else if (tag == WAKE_TAG) {
+        // only ever written by `stop()`, loop condition handles the rest
+        uint64_t value;
+        if (read(wake_fd_, &value, sizeof(value)) < 0) {
+          // nothing to do - it was already drained
+        }
+      } else {
+        auto sim = sims_[tag];
+        sim->serviceInput();
+        if (!sim->isRunning()) {
+          // its port closed - stop listening to it, and stop its clock
+          logger().text(LogLevel::Info, "sim port closed, dropping it");
+          epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, sim->inputFd(), nullptr);
+        }
+      }
+    }
+  }
+}
+
+void SimHost::stop() {
+  running_.store(false, std::memory_order_release);
+
+  // kick `run()` out of epoll_wait - write() is fine in a signal handler
+  uint64_t value = 1;
+  if (write(wake_fd_, &value, sizeof(value)) < 0) {
+    // eventfd is already signalled, which is just as good
+  }
+}
+
+void SimHost::handleTimer() {
+  uint64_t expirations;
+  if (read(timer_fd_, &expirations, sizeof(expirations)) !=
+      sizeof(expirations)) {
+    return;
+  }
+
+  // a linear scan - for the tens of sims a host is for, it's cheaper than
+  // keeping a heap in order
+  int64_t now_ns = monotonicNanos();
+  for (auto sim : sims_) {
+    if (sim->isRunning() && sim->nextTickNs() <= now_ns) {
+      sim->advanceTo(now_ns);
+    }
+  }
+  armTimer();
+}
+
+void SimHost::armTimer() {
+  int64_t next_ns = std::numeric_limits<int64_t>::max();
+  for (auto sim : sims_) {
+    if (sim->isRunning()) {
+      next_ns = std::min(next_ns, sim->nextTickNs());
+    }
+  }
+  if (next_ns == std::numeric_limits<int64_t>::max()) {
+    // nothing left to run
+    return;
+  }
+
+  // absolute, and one-shot - a deadline that's already gone by fires
+  // straight away
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = next_ns / 1000000000;
+  spec.it_value.tv_nsec = next_ns % 1000000000;
+  if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+    throw std::runtime_error("Failed to arm sim host timer");
+  }
+}
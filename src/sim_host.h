@@ -0,0 +1,56 @@
+#pragma once
+#include "sim.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// most epoll events handled per pass of `SimHost::run()`
+const size_t SIM_HOST_MAX_EVENTS = 64;
+
+// runs any number of SensorSim's from a single thread - the sim side of
+// `SensorManager`
+//
+// rather than a timerfd per sim, there's one for the whole host, armed for
+// whichever sim is due next - so a wakeup serves every sim due at that time
+// (all of them, when they share a rate), and 64 sims at 1 kHz cost a thousand
+// wakeups a second rather than 64 thousand. Every sim's port is in the same
+// epoll set, and commands are answered as soon as they come in. Each sim
+// keeps its own mode, rate, truth source and sample counter.
+//
+// the sims all share the thread, so they're set to drop output for a port
+// that's full rather than waiting for it to drain.
+class SimHost {
+public:
+  SimHost();
+  ~SimHost();
+  SimHost(const SimHost &) = delete;
+  SimHost &operator=(const SimHost &) = delete;
+
+  // Start hosting `sim` (which must already be `init()`'d, and not running
+  // on its own). Returns its index.
+  size_t addSim(SensorSim &sim);
+
+  // Start every sim's sample clock, together, and serve them all until
+  // `stop()` is called
+  void run();
+
+  // make `run()` return - safe to call from a signal handler or another
+  // thread, and before `run()` has started (it then returns straight away)
+  void stop();
+
+  size_t simCount() const { return sims_.size(); };
+
+private:
+  // Run every sim that's due, then set the timer for the next one
+  void handleTimer();
+
+  // Arm the timer for the earliest `nextTickNs()` of any running sim
+  void armTimer();
+
+  int epoll_fd_;
+  int timer_fd_;
+  int wake_fd_;
+  std::atomic<bool> running_;
+  std::vector<SensorSim *> sims_;
+};
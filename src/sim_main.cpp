@@ -0,0 +1,188 @@
+#include "logger.h"
+#include "pty_interface.h"
+#include "sim.h"
+#include "sim_host.h"
+#include "truth_source.h"
+#include "uart_interface.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// when hosting several sensors, each thread runs a `SimHost` over (up to)
+// this many of them - one core handles 64 at 1 kHz, so this leaves room
+const size_t SENSORS_PER_HOST = 32;
+
+// so ctrl+c can stop the sim(s) cleanly (and print their timing)
+static SensorSim *running_sim = nullptr;
+static std::vector<SimHost *> running_hosts;
+static void handleSignal(int) {
+  if (running_sim) {
+    running_sim->stop();
+  }
+  for (auto host : running_hosts) {
+    host->stop();
+  }
+}
+
+// Split a comma separated list, e.g. of rates
+static std::vector<std::string> splitList(const std::string &list) {
+  std::vector<std::string> items;
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = std::min(list.find(',', start), list.size());
+    if (end > start) {
+      items.push_back(list.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  return items;
+}
+
+// A truth source playing back `path` on a loop - a .csv is streamed,
+// anything else is taken to be a binary truth file and mapped
+static std::unique_ptr<TruthSource> openTruth(const std::string &path) {
+  if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0) {
+    return std::make_unique<CsvTruth>(path, TruthEnd::Loop);
+  }
+  return std::make_unique<MappedTruth>(path, TruthEnd::Loop);
+}
+
+// One sensor, on an existing port (e.g. one end of a socat pair)
+static int runOne(const std::string &port, int baud_rate,
+                  double output_rate_hz,
+                  const std::vector<std::string> &truth_files) {
+  std::unique_ptr<TruthSource> truth;
+  if (!truth_files.empty()) {
+    truth = openTruth(truth_files[0]);
+  }
+
+  UartInterface myio = UartInterface(port, baud_rate);
+  SensorSim mysim = SensorSim(myio);
+  mysim.setOutputRate(output_rate_hz);
+  if (truth) {
+    mysim.setTruthSource(*truth);
+  }
+
+  running_sim = &mysim;
+  std::signal(SIGINT, handleSignal);
+  std::signal(SIGTERM, handleSignal);
+
+  mysim.init();
+  mysim.run();
+  logger().stop();
+  mysim.printStats();
+  mysim.shutdown();
+
+  return 0;
+}
+
+// `n_sensors` sensors, each on a pty of its own at `prefix` + its index,
+// with rates and truth files dealt out from the lists in turn
+static int runMany(const std::string &prefix, size_t n_sensors,
+                   const std::vector<double> &rates,
+                   const std::vector<std::string> &truth_files) {
+  // in this order so each outlives whatever uses it
+  std::vector<std::unique_ptr<TruthSource>> truths;
+  std::vector<std::unique_ptr<PtyInterface>> ports;
+  std::vector<std::unique_ptr<SensorSim>> sims;
+
+  for (size_t i = 0; i < n_sensors; i++) {
+    ports.push_back(std::make_unique<PtyInterface>(prefix + std::to_string(i)));
+    auto &sim = *sims.emplace_back(std::make_unique<SensorSim>(*ports.back()));
+    sim.setOutputRate(rates[i % rates.size()]);
+    if (!truth_files.empty()) {
+      truths.push_back(openTruth(truth_files[i % truth_files.size()]));
+      sim.setTruthSource(*truths.back());
+    }
+    sim.init();
+  }
+
+  // sims are dealt out across the hosts, one thread each
+  size_t n_hosts = (n_sensors + SENSORS_PER_HOST - 1) / SENSORS_PER_HOST;
+  n_hosts = std::clamp<size_t>(n_hosts, 1,
+                               std::max(1u, std::thread::hardware_concurrency()));
+  std::vector<std::unique_ptr<SimHost>> hosts;
+  for (size_t i = 0; i < n_hosts; i++) {
+    hosts.push_back(std::make_unique<SimHost>());
+    running_hosts.push_back(hosts.back().get());
+  }
+  for (size_t i = 0; i < n_sensors; i++) {
+    hosts[i % n_hosts]->addSim(*sims[i]);
+  }
+
+  std::signal(SIGINT, handleSignal);
+  std::signal(SIGTERM, handleSignal);
+
+  std::cout << "hosting " << n_sensors << " sensors on " << prefix << "0.."
+            << prefix << n_sensors - 1 << " (" << n_hosts << " threads)"
+            << std::endl;
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < n_hosts; i++) {
+    threads.emplace_back([&hosts, i] { hosts[i]->run(); });
+  }
+  hosts[0]->run();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  logger().stop();
+
+  for (size_t i = 0; i < n_sensors; i++) {
+    std::cout << ports[i]->link() << ": ";
+    sims[i]->printStats();
+  }
+  running_hosts.clear();
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  // port, baud rate, and output rate can be overridden, e.g. to run several
+  // sims side by side. Given a number of sensors too, the sim hosts that many
+  // itself, each on its own pty at the port plus its index (/tmp/ttySIM0,
+  // /tmp/ttySIM1, ...) - no socat needed. The rate can then be a comma
+  // separated list, dealt out to the sensors in turn.
+  std::string myport(argc > 1 ? argv[1] : "/tmp/ttySIM");
+  int baud_rate = argc > 2 ? std::atoi(argv[2]) : 38400;
+  std::vector<double> rates;
+  for (auto &rate : splitList(argc > 3 ? argv[3] : "")) {
+    rates.push_back(std::atof(rate.c_str()));
+  }
+  if (rates.empty()) {
+    rates.push_back(DEFAULT_OUTPUT_RATE_HZ);
+  }
+  size_t n_sensors = 0;
+  if (argc > 4) {
+    char *end = nullptr;
+    long count = std::strtol(argv[4], &end, 10);
+    if (end == argv[4] || *end != '\0' || count <= 0) {
+      std::cerr << "Number of sensors has to be a positive whole number, not "
+                << argv[4] << std::endl;
+      return 1;
+    }
+    n_sensors = count;
+  }
+
+  // SENSOR_TRUTH_FILE plays back a recorded trajectory instead of the sine
+  // waves, looping once it gets to the end. With several sensors it can be
+  // a comma separated list too.
+  std::vector<std::string> truth_files;
+  if (const char *truth_file = std::getenv("SENSOR_TRUTH_FILE")) {
+    truth_files = splitList(truth_file);
+  }
+
+  // every frame in and out is logged at debug - set SENSOR_LOG_LEVEL=info
+  // to quiet it down. That's a lot of frames with many sensors, so they
+  // start out at info.
+  logger().startFromEnvironment(n_sensors > 0 ? LogLevel::Info
+                                              : LogLevel::Debug);
+
+  if (n_sensors > 0) {
+    return runMany(myport, n_sensors, rates, truth_files);
+  }
+  return runOne(myport, baud_rate, rates[0], truth_files);
+}
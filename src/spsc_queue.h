@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+// most x86/arm parts - hard-coded rather than using
+// std::hardware_destructive_interference_size, which gcc warns about
+const size_t CACHE_LINE_SIZE = 64;
+
+// what to do when the producer catches up to the consumer
+enum class OverflowPolicy {
+  DropOldest, // overwrite the oldest unread item
+  DropNewest, // discard the item being pushed
+};
+
+// bounded, lock-free, single-producer/single-consumer queue
+//
+// the producer only ever writes `tail_`, and the consumer `head_` - each lives
+// on its own cache line so the two threads aren't fighting over one. The one
+// exception is DropOldest: there the producer also bumps `head_` when full,
+// so the consumer claims items with a CAS and retries if it lost the race.
+template <typename T, size_t N> class SpscQueue {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SpscQueue items are copied in and out by value");
+
+public:
+  SpscQueue(OverflowPolicy policy = OverflowPolicy::DropOldest)
+      : head_(0), tail_(0), overflows_(0), policy_(policy){};
+
+  // producer side: add `item`. Returns false if something had to be dropped
+  // (which one depends on the overflow policy).
+  bool push(const T &item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    bool overflowed = false;
+
+    if (tail - head >= N) {
+      overflows_.fetch_add(1, std::memory_order_relaxed);
+      if (policy_ == OverflowPolicy::DropNewest) {
+        return false;
+      }
+      // if this fails the consumer just took the oldest item itself, which
+      // frees up the slot all the same
+      head_.compare_exchange_strong(head, head + 1, std::memory_order_acq_rel);
+      overflowed = true;
+    }
+
+    buf_[tail % N] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return !overflowed;
+  }
+
+  // consumer side: remove the oldest item into `item`, false if empty
+  bool pop(T &item) {
+    size_t head = head_.load(std::memory_order_acquire);
+    while (head != tail_.load(std::memory_order_acquire)) {
+      // copy first, then claim the slot - if the producer overwrote it in the
+      // meantime (DropOldest) the CAS fails and we try again with the new head
+      T copy = buf_[head % N];
+      if (head_.compare_exchange_weak(head, head + 1,
+                                      std::memory_order_acq_rel)) {
+        item = copy;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // approximate when called from a thread that is neither end
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+  static constexpr size_t capacity() { return N; }
+
+  // total items dropped because the queue was full
+  size_t overflows() const {
+    return overflows_.load(std::memory_order_relaxed);
+  }
+
+  OverflowPolicy policy() const { return policy_; }
+
+  // only safe while neither side is running
+  void setPolicy(OverflowPolicy policy) { policy_ = policy; }
+
+private:
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_;
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_;
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> overflows_;
+  OverflowPolicy policy_;
+  alignas(CACHE_LINE_SIZE) std::array<T, N> buf_;
+};
@@ -0,0 +1,139 @@
+#include "stream_recorder.h"
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+StreamRecorder::~StreamRecorder() { shutdown(); }
+
+void StreamRecorder::init() {
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("Failed to open recording " + path_);
+  }
+
+  size_ = 0;
+  grow(sizeof(STREAM_RECORDING_MAGIC));
+  std::memcpy(map_, STREAM_RECORDING_MAGIC, sizeof(STREAM_RECORDING_MAGIC));
+  size_ = sizeof(STREAM_RECORDING_MAGIC);
+}
+
+void StreamRecorder::shutdown() {
+  if (fd_ < 0) {
+    return;
+  }
+  munmap(map_, capacity_);
+  map_ = nullptr;
+  capacity_ = 0;
+
+  // drop the unused tail - not much to be done if this fails, and the
+  // recording still reads fine, it just ends in zeros
+  int ret = ftruncate(fd_, size_);
+  (void)ret;
+  close(fd_);
+  fd_ = -1;
+}
+
+void StreamRecorder::record(const uint8_t *data, size_t len,
+                            uint64_t time_ns) {
+  size_t needed = sizeof(StreamChunkHeader_t) + len;
+  if (size_ + needed > capacity_) {
+    grow(needed);
+  }
+
+  StreamChunkHeader_t header = {.time_ns = time_ns, .length = (uint32_t)len};
+  std::memcpy(map_ + size_, &header, sizeof(header));
+  std::memcpy(map_ + size_ + sizeof(header), data, len);
+  size_ += needed;
+}
+
+void StreamRecorder::grow(size_t needed) {
+  size_t capacity = capacity_;
+  while (size_ + needed > capacity) {
+    capacity += STREAM_RECORDER_GROW_BYTES;
+  }
+
+  if (ftruncate(fd_, capacity) != 0) {
+    throw std::runtime_error("Failed to grow recording " + path_);
+  }
+
+  void *map;
+  if (map_) {
+    map = mremap(map_, capacity_, capacity, MREMAP_MAYMOVE);
+  } else {
+    map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  }
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Failed to map recording " + path_);
+  }
+
+  map_ = static_cast<uint8_t *>(map);
+  capacity_ = capacity;
+}
+
+StreamRecording::~StreamRecording() { shutdown(); }
+
+void StreamRecording::init() {
+  int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open recording " + path_);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Failed to stat recording " + path_);
+  }
+  size_ = st.st_size;
+
+  if (size_ < sizeof(STREAM_RECORDING_MAGIC)) {
+    close(fd);
+    throw std::runtime_error("Not a stream recording: " + path_);
+  }
+
+  // the mapping keeps the file open on its own
+  void *map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Failed to map recording " + path_);
+  }
+  map_ = static_cast<const uint8_t *>(map);
+
+  if (std::memcmp(map_, STREAM_RECORDING_MAGIC,
+                  sizeof(STREAM_RECORDING_MAGIC)) != 0) {
+    shutdown();
+    throw std::runtime_error("Not a stream recording: " + path_);
+  }
+  rewind();
+}
+
+void StreamRecording::shutdown() {
+  if (map_) {
+    munmap(const_cast<uint8_t *>(map_), size_);
+    map_ = nullptr;
+  }
+}
+
+bool StreamRecording::next(StreamChunk_t &chunk) {
+  if (offset_ + sizeof(StreamChunkHeader_t) > size_) {
+    return false;
+  }
+
+  StreamChunkHeader_t header;
+  std::memcpy(&header, map_ + offset_, sizeof(header));
+
+  // zero length is the unwritten tail of a recording that wasn't shut down
+  // cleanly, and a chunk running off the end was cut short
+  if (header.length == 0 ||
+      offset_ + sizeof(header) + header.length > size_) {
+    return false;
+  }
+
+  chunk.time_ns = header.time_ns;
+  chunk.data =
+      std::span<const uint8_t>(map_ + offset_ + sizeof(header), header.length);
+  offset_ += sizeof(header) + header.length;
+  return true;
+}
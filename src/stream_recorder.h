@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// raw stream recordings - every chunk of bytes read off a port, with the
+// time it came in, so a field issue can be replayed byte for byte later
+//
+// file layout (host byte order - these are for replaying on the same kind of
+// machine, not for interchange):
+//   8 byte magic, then back to back chunks of
+//   [uint64 time_ns][uint32 length][length bytes]
+// The file is grown ahead of the data, so a recording cut short by a crash
+// ends in zeros - a zero length chunk marks the end.
+
+const char STREAM_RECORDING_MAGIC[8] = {'S', 'D', 'R', 'E', 'C', '0', '0', '1'};
+
+// how much the file (and mapping) grows by each time it fills up
+const size_t STREAM_RECORDER_GROW_BYTES = 16 << 20;
+
+#pragma pack(push, 1)
+struct StreamChunkHeader {
+  uint64_t time_ns; // monotonicNanos() when the chunk was read
+  uint32_t length;
+} typedef StreamChunkHeader_t;
+#pragma pack(pop)
+
+// one chunk of a recording - `data` points into the mapped file
+struct StreamChunk {
+  uint64_t time_ns;
+  std::span<const uint8_t> data;
+} typedef StreamChunk_t;
+
+// appends chunks to a recording through a shared mmap of the file, so
+// recording one is a bounds check and a memcpy - no syscall, except when the
+// file has to grow
+//
+// not thread-safe - it's meant to be fed by whoever is reading the port
+class StreamRecorder {
+public:
+  StreamRecorder(const std::string &path)
+      : path_(path), fd_(-1), map_(nullptr), capacity_(0), size_(0){};
+
+  // Destructor. Runs shutdown().
+  ~StreamRecorder();
+
+  StreamRecorder(const StreamRecorder &) = delete;
+  StreamRecorder &operator=(const StreamRecorder &) = delete;
+
+  // Create (or truncate) the file and map it
+  void init();
+
+  // Unmap, and trim the file down to what was actually recorded
+  void shutdown();
+
+  // Append `len` bytes from `data`, read at `time_ns`
+  void record(const uint8_t *data, size_t len, uint64_t time_ns);
+
+  // bytes in the file so far, including headers
+  size_t size() const { return size_; };
+
+private:
+  // Make room for at least `needed` more bytes
+  void grow(size_t needed);
+
+  std::string path_;
+  int fd_;
+  uint8_t *map_;
+  size_t capacity_;
+  size_t size_;
+};
+
+// read side: maps a recording and walks through its chunks
+class StreamRecording {
+public:
+  StreamRecording(const std::string &path)
+      : path_(path), map_(nullptr), size_(0), offset_(0){};
+
+  // Destructor. Runs shutdown().
+  ~StreamRecording();
+
+  StreamRecording(const StreamRecording &) = delete;
+  StreamRecording &operator=(const StreamRecording &) = delete;
+
+  // Map the file and check it's a recording
+  void init();
+
+  void shutdown();
+
+  // Get the next chunk, false at the end of the recording
+  bool next(StreamChunk_t &chunk);
+
+  // Go back to the first chunk
+  void rewind() { offset_ = sizeof(STREAM_RECORDING_MAGIC); };
+
+private:
+  std::string path_;
+  const uint8_t *map_;
+  size_t size_;
+  size_t offset_;
+};
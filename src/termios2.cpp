@@ -0,0 +1,23 @@
+#include "termios2.h"
+#include <asm/ioctls.h>
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+bool setCustomBaudRate(int fd, int baud_rate) {
+  struct termios2 tty;
+
+  if (ioctl(fd, TCGETS2, &tty) != 0) {
+    return false;
+  }
+
+  // BOTHER says "the speed is in c_ispeed/c_ospeed, not the CBAUD bits"
+  tty.c_cflag &= ~CBAUD;
+  tty.c_cflag |= BOTHER;
+  tty.c_ispeed = baud_rate;
+  tty.c_ospeed = baud_rate;
+
+  // (IBSHIFT bits left clear means input uses the same speed as output)
+  tty.c_cflag &= ~(CBAUD << IBSHIFT);
+
+  return ioctl(fd, TCSETS2, &tty) == 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Set `fd`'s input and output speed to an arbitrary `baud_rate` using the
+// linux termios2/BOTHER interface, for rates with no Bxxx constant. Returns
+// false if the driver won't take it.
+//
+// This lives in its own translation unit since <asm/termbits.h> (which has
+// termios2) can't be included alongside <termios.h>.
+bool setCustomBaudRate(int fd, int baud_rate);
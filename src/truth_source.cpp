@@ -0,0 +1,378 @@
+#include "truth_source.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TruthSample_t interpolate(const TruthSample_t &a, const TruthSample_t &b,
+                          int64_t time_ns) {
+  if (b.time_ns <= a.time_ns) {
+    return a;
+  }
+  float f = (double)(time_ns - a.time_ns) / (b.time_ns - a.time_ns);
+  return TruthSample_t{.time_ns = time_ns,
+                       .x_rate = a.x_rate + f * (b.x_rate - a.x_rate),
+                       .y_rate = a.y_rate + f * (b.y_rate - a.y_rate),
+                       .z_rate = a.z_rate + f * (b.z_rate - a.z_rate)};
+}
+
+TruthSample_t SineTruth::at(int64_t time_ns) {
+  float time = (double)time_ns / 1e9; // time in seconds
+  float w = 0.5 * 2 * M_PI;           // 0.5 Hz oscillation
+  return TruthSample_t{.time_ns = time_ns,
+                       .x_rate = (float)(0.75 * std::sin(time * w)),
+                       .y_rate = (float)(0.75 * std::sin(time * w + 0.66 * M_PI)),
+                       .z_rate =
+                           (float)(0.75 * std::sin(time * w + 1.22 * M_PI))};
+}
+
+MappedTruth::~MappedTruth() { shutdown(); }
+
+void MappedTruth::init() {
+  int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open truth file " + path_);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Failed to stat truth file " + path_);
+  }
+  map_size_ = st.st_size;
+
+  if (map_size_ < sizeof(TRUTH_FILE_MAGIC) + sizeof(TruthSample_t)) {
+    close(fd);
+    throw std::runtime_error("Not a truth file: " + path_);
+  }
+
+  // the mapping keeps the file open on its own
+  map_ = mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map_ == MAP_FAILED) {
+    map_ = nullptr;
+    throw std::runtime_error("Failed to map truth file " + path_);
+  }
+
+  if (std::memcmp(map_, TRUTH_FILE_MAGIC, sizeof(TRUTH_FILE_MAGIC)) != 0) {
+    shutdown();
+    throw std::runtime_error("Not a truth file: " + path_);
+  }
+
+  // playback is mostly front to back, so the kernel can read ahead more
+  // aggressively - on top of what readAhead() asks for
+  madvise(map_, map_size_, MADV_SEQUENTIAL);
+
+  records_ = reinterpret_cast<const TruthSample_t *>(
+      static_cast<const uint8_t *>(map_) + sizeof(TRUTH_FILE_MAGIC));
+  // a record cut short at the end (by a writer that didn't finish) is ignored
+  n_records_ = (map_size_ - sizeof(TRUTH_FILE_MAGIC)) / sizeof(TruthSample_t);
+  mean_interval_ns_ =
+      n_records_ > 1 ? (double)duration() / (n_records_ - 1) : 0;
+  cursor_ = 0;
+  adviseFrom(0);
+}
+
+void MappedTruth::shutdown() {
+  if (map_) {
+    munmap(map_, map_size_);
+    map_ = nullptr;
+    records_ = nullptr;
+    n_records_ = 0;
+  }
+}
+
+int64_t MappedTruth::duration() const {
+  return n_records_ > 0 ? records_[n_records_ - 1].time_ns - records_[0].time_ns
+                        : 0;
+}
+
+TruthSample_t MappedTruth::at(int64_t time_ns) {
+  if (!records_) {
+    throw std::runtime_error("Truth file not open: " + path_);
+  }
+
+  int64_t span = duration();
+  if (end_ == TruthEnd::Loop && span > 0) {
+    time_ns %= span;
+    if (time_ns < 0) {
+      time_ns += span;
+    }
+  }
+  int64_t time = records_[0].time_ns + time_ns;
+
+  size_t i = find(time);
+  if (i + 1 >= n_records_ || time <= records_[i].time_ns) {
+    // before the start, past the end, or right on a record
+    TruthSample_t sample = records_[i];
+    sample.time_ns = time_ns;
+    return sample;
+  }
+
+  TruthSample_t sample = interpolate(records_[i], records_[i + 1], time);
+  sample.time_ns = time_ns;
+  return sample;
+}
+
+size_t MappedTruth::find(int64_t time) {
+  // the usual case - the same record as last time, or one a few further on
+  size_t i = cursor_;
+  if (records_[i].time_ns <= time) {
+    for (size_t steps = 0; steps < TRUTH_MAX_STEPS; steps++) {
+      if (i + 1 >= n_records_ || records_[i + 1].time_ns > time) {
+        cursor_ = i;
+        // the next lookups will want the records just past here
+        __builtin_prefetch(&records_[std::min(i + 4, n_records_ - 1)]);
+        readAhead();
+        return i;
+      }
+      i++;
+    }
+  }
+
+  // a jump - guess from the average spacing, then search out from the guess,
+  // widening until the time is bracketed (it usually already is, for evenly
+  // spaced records)
+  if (time <= records_[0].time_ns) {
+    i = 0;
+  } else {
+    double guess = mean_interval_ns_ > 0
+                       ? (time - records_[0].time_ns) / mean_interval_ns_
+                       : 0;
+    i = std::min((size_t)guess, n_records_ - 1);
+
+    size_t lo = i;
+    size_t hi = i;
+    size_t width = 1;
+    while (lo > 0 && records_[lo].time_ns > time) {
+      hi = lo;
+      lo = lo > width ? lo - width : 0;
+      width *= 2;
+    }
+    width = 1;
+    while (hi + 1 < n_records_ && records_[hi].time_ns <= time) {
+      lo = hi;
+      hi = std::min(hi + width, n_records_ - 1);
+      width *= 2;
+    }
+    // last record at or before `time`, in [lo, hi]
+    auto it = std::upper_bound(
+        records_ + lo, records_ + hi + 1, time,
+        [](int64_t t, const TruthSample_t &r) { return t < r.time_ns; });
+    i = it == records_ + lo ? lo : it - records_ - 1;
+  }
+
+  // no readahead for the jump itself, seeks could be anywhere - but if
+  // playback carries on from here, the first step forward asks for it
+  cursor_ = i;
+  readahead_at_ = i - std::min(i, TRUTH_READAHEAD_STEP_BYTES /
+                                      sizeof(TruthSample_t));
+  return i;
+}
+
+void MappedTruth::readAhead() {
+  if (cursor_ - readahead_at_ >=
+      TRUTH_READAHEAD_STEP_BYTES / sizeof(TruthSample_t)) {
+    adviseFrom(cursor_);
+  }
+}
+
+void MappedTruth::adviseFrom(size_t record) {
+  readahead_at_ = record;
+
+  // madvise wants a page aligned start
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t offset = sizeof(TRUTH_FILE_MAGIC) + record * sizeof(TruthSample_t);
+  size_t start = offset & ~(page - 1);
+  size_t len = std::min(TRUTH_READAHEAD_BYTES, map_size_ - start);
+  madvise(static_cast<uint8_t *>(map_) + start, len, MADV_WILLNEED);
+}
+
+CsvTruth::~CsvTruth() { shutdown(); }
+
+void CsvTruth::init() {
+  fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    throw std::runtime_error("Failed to open truth file " + path_);
+  }
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  duration_ns_ = -1;
+  rewind();
+  first_ns_ = prev_.time_ns;
+}
+
+void CsvTruth::shutdown() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void CsvTruth::rewind() {
+  if (lseek(fd_, 0, SEEK_SET) != 0) {
+    throw std::runtime_error("Failed to rewind truth file " + path_);
+  }
+  len_ = pos_ = 0;
+  eof_ = false;
+  skipping_ = false;
+
+  if (!readRecord(prev_)) {
+    throw std::runtime_error("No records in truth file " + path_);
+  }
+  have_next_ = readRecord(next_);
+}
+
+TruthSample_t CsvTruth::at(int64_t time_ns) {
+  if (fd_ < 0) {
+    throw std::runtime_error("Truth file not open: " + path_);
+  }
+
+  if (end_ == TruthEnd::Loop && duration_ns_ > 0) {
+    time_ns %= duration_ns_;
+    if (time_ns < 0) {
+      time_ns += duration_ns_;
+    }
+  }
+  int64_t time = first_ns_ + time_ns;
+
+  if (time < prev_.time_ns && prev_.time_ns != first_ns_) {
+    rewind();
+  }
+
+  while (have_next_ && next_.time_ns <= time) {
+    prev_ = next_;
+    have_next_ = readRecord(next_);
+    if (!have_next_) {
+      duration_ns_ = prev_.time_ns - first_ns_;
+      if (end_ == TruthEnd::Loop && duration_ns_ > 0) {
+        // now the length is known, wrap around like `MappedTruth` does
+        rewind();
+        return at(time_ns);
+      }
+    }
+  }
+
+  TruthSample_t sample = have_next_ && time > prev_.time_ns
+                             ? interpolate(prev_, next_, time)
+                             : prev_;
+  sample.time_ns = time_ns;
+  return sample;
+}
+
+bool CsvTruth::readRecord(TruthSample_t &out) {
+  const char *begin;
+  const char *end;
+  while (readLine(begin, end)) {
+    // time_s,x_rate,y_rate,z_rate - from_chars doesn't allocate or care
+    // about the locale
+    double time_s;
+    float rates[3];
+    auto result = std::from_chars(begin, end, time_s);
+    bool ok = result.ec == std::errc();
+    for (size_t i = 0; ok && i < 3; i++) {
+      const char *p = result.ptr;
+      while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+      }
+      if (p == end || *p != ',') {
+        ok = false;
+        break;
+      }
+      p++;
+      while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+      }
+      result = std::from_chars(p, end, rates[i]);
+      ok = result.ec == std::errc();
+    }
+
+    // anything that isn't a record, like a header, is skipped
+    if (ok) {
+      out = TruthSample_t{.time_ns = std::llround(time_s * 1e9),
+                          .x_rate = rates[0],
+                          .y_rate = rates[1],
+                          .z_rate = rates[2]};
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CsvTruth::readLine(const char *&begin, const char *&end) {
+  while (true) {
+    auto newline = static_cast<const char *>(
+        std::memchr(buf_.data() + pos_, '\n', len_ - pos_));
+    if (skipping_ && (newline || eof_)) {
+      // the end of an over-long line - the next one starts after it
+      pos_ = newline ? newline - buf_.data() + 1 : len_;
+      skipping_ = false;
+      continue;
+    }
+    if (newline || (eof_ && pos_ < len_)) {
+      begin = buf_.data() + pos_;
+      end = newline ? newline : buf_.data() + len_;
+      pos_ = end - buf_.data() + (newline ? 1 : 0);
+      if (end > begin && end[-1] == '\r') {
+        end--;
+      }
+      return true;
+    }
+    if (eof_) {
+      return false;
+    }
+
+    // move the partial line down to the front, and read in more after it
+    std::memmove(buf_.data(), buf_.data() + pos_, len_ - pos_);
+    len_ -= pos_;
+    pos_ = 0;
+    if (len_ == buf_.size() || skipping_) {
+      // a line longer than the whole buffer can't be a record - drop it, and
+      // whatever more of it comes in up to the next newline
+      len_ = 0;
+      skipping_ = true;
+    }
+    ssize_t n = read(fd_, buf_.data() + len_, buf_.size() - len_);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error("Failed to read truth file " + path_);
+    }
+    if (n == 0) {
+      eof_ = true;
+    }
+    len_ += n;
+  }
+}
+
+TruthWriter::~TruthWriter() { shutdown(); }
+
+void TruthWriter::init() {
+  file_ = std::fopen(path_.c_str(), "wb");
+  if (!file_) {
+    throw std::runtime_error("Failed to create truth file " + path_);
+  }
+  if (std::fwrite(TRUTH_FILE_MAGIC, sizeof(TRUTH_FILE_MAGIC), 1, file_) != 1) {
+    throw std::runtime_error("Failed to write truth file " + path_);
+  }
+}
+
+void TruthWriter::shutdown() {
+  if (file_) {
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+void TruthWriter::write(const TruthSample_t &sample) {
+  if (std::fwrite(&sample, sizeof(sample), 1, file_) != 1) {
+    throw std::runtime_error("Failed to write truth file " + path_);
+  }
+}
@@ -0,0 +1,205 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// where the sim gets the "true" rates its samples report
+//
+// sources are asked for the rates at the sim's current time, which almost
+// always moves forward a period at a time - they're all built around that, so
+// a lookup is O(1) and nothing is allocated per sample.
+
+// rates at one instant - also the record format of truth files
+#pragma pack(push, 1)
+struct TruthSample {
+  int64_t time_ns;
+  float x_rate;
+  float y_rate;
+  float z_rate;
+} typedef TruthSample_t;
+#pragma pack(pop)
+
+// binary truth file layout (host byte order, like stream recordings):
+//   8 byte magic, then back to back TruthSample_t records, in time order
+const char TRUTH_FILE_MAGIC[8] = {'S', 'D', 'T', 'R', 'U', 'T', 'H', '1'};
+
+// what a recorded source does once time runs past its last record
+enum class TruthEnd {
+  Hold, // keep reporting the last record
+  Loop, // start over from the first
+};
+
+// interface every truth source implements
+class TruthSource {
+public:
+  virtual ~TruthSource() = default;
+
+  virtual void init(){};
+  virtual void shutdown(){};
+
+  // The rates at `time_ns` past the start of the sim's clock (and of the
+  // trajectory), interpolated between records where there are any
+  virtual TruthSample_t at(int64_t time_ns) = 0;
+
+protected:
+  TruthSource(){};
+};
+
+// the original made up trajectory - each axis a 0.5 Hz sine, out of phase
+// with the others
+class SineTruth final : public TruthSource {
+public:
+  SineTruth(){};
+  TruthSample_t at(int64_t time_ns) override;
+};
+
+// how many records `MappedTruth` steps through looking for the next one,
+// before it gives up and jumps straight to it instead
+const size_t TRUTH_MAX_STEPS = 16;
+
+// how far ahead of playback `MappedTruth` asks the kernel to read, and how
+// often it asks
+const size_t TRUTH_READAHEAD_BYTES = 4 << 20;
+const size_t TRUTH_READAHEAD_STEP_BYTES = 1 << 20;
+
+// plays back a binary truth file through a read-only mmap
+//
+// nothing is read up front but the header, so an hour long multi-GB
+// recording starts playing straight away - pages come in as playback gets to
+// them, with readahead requested a few MB in front. Lookups pick up from the
+// last record used (O(1) amortized going forward), and anything else jumps
+// to an estimate from the average record spacing before searching.
+class MappedTruth final : public TruthSource {
+public:
+  MappedTruth(const std::string &path, TruthEnd end = TruthEnd::Hold)
+      : path_(path), end_(end), map_(nullptr), map_size_(0),
+        records_(nullptr), n_records_(0), cursor_(0), mean_interval_ns_(0),
+        readahead_at_(0){};
+
+  // Destructor. Runs shutdown().
+  ~MappedTruth();
+
+  MappedTruth(const MappedTruth &) = delete;
+  MappedTruth &operator=(const MappedTruth &) = delete;
+
+  // Map the file and check it's a truth file
+  void init() override;
+  void shutdown() override;
+
+  TruthSample_t at(int64_t time_ns) override;
+
+  size_t size() const { return n_records_; };
+
+  // time between the first and last records
+  int64_t duration() const;
+
+private:
+  // Index of the last record at or before `time` (an absolute file time)
+  size_t find(int64_t time);
+
+  // Ask for the pages past `cursor_` to be read in, if it's moved on far
+  // enough since the last time
+  void readAhead();
+
+  // Ask for TRUTH_READAHEAD_BYTES from `record` on to be read in
+  void adviseFrom(size_t record);
+
+  std::string path_;
+  TruthEnd end_;
+  void *map_;
+  size_t map_size_;
+  const TruthSample_t *records_;
+  size_t n_records_;
+
+  // record the last lookup landed on
+  size_t cursor_;
+  double mean_interval_ns_;
+  size_t readahead_at_;
+};
+
+// size of `CsvTruth`'s read buffer
+const size_t TRUTH_CSV_BUFFER_SIZE = 64 << 10;
+
+// streams a CSV of `time_s,x_rate,y_rate,z_rate` lines (anything else, like a
+// header, is skipped) through a fixed buffer - only the two records either
+// side of the current time are kept, so files of any size play in constant
+// memory. Going back in time means reading from the top again.
+class CsvTruth final : public TruthSource {
+public:
+  CsvTruth(const std::string &path, TruthEnd end = TruthEnd::Hold)
+      : path_(path), end_(end), fd_(-1), len_(0), pos_(0), eof_(false),
+        skipping_(false), have_next_(false), first_ns_(0),
+        duration_ns_(-1){};
+
+  // Destructor. Runs shutdown().
+  ~CsvTruth();
+
+  CsvTruth(const CsvTruth &) = delete;
+  CsvTruth &operator=(const CsvTruth &) = delete;
+
+  // Open the file and read up to the first record
+  void init() override;
+  void shutdown() override;
+
+  TruthSample_t at(int64_t time_ns) override;
+
+private:
+  // Go back to the top of the file and load the first two records
+  void rewind();
+
+  // Parse the next record into `out`, false at the end of the file
+  bool readRecord(TruthSample_t &out);
+
+  // Next line out of the buffer (refilling it as needed), false at the end
+  bool readLine(const char *&begin, const char *&end);
+
+  std::string path_;
+  TruthEnd end_;
+  int fd_;
+
+  std::array<char, TRUTH_CSV_BUFFER_SIZE> buf_;
+  size_t len_;
+  size_t pos_;
+  bool eof_;
+  // partway through a line too long for `buf_`, dropping it up to the next
+  // newline
+  bool skipping_;
+
+  // the records either side of the last lookup
+  TruthSample_t prev_;
+  TruthSample_t next_;
+  bool have_next_;
+
+  int64_t first_ns_;
+  // only known once the end has been reached, -1 until then
+  int64_t duration_ns_;
+};
+
+// writes a binary truth file, e.g. to convert a CSV for `MappedTruth`
+class TruthWriter {
+public:
+  TruthWriter(const std::string &path) : path_(path), file_(nullptr){};
+
+  // Destructor. Runs shutdown().
+  ~TruthWriter();
+
+  TruthWriter(const TruthWriter &) = delete;
+  TruthWriter &operator=(const TruthWriter &) = delete;
+
+  // Create (or truncate) the file
+  void init();
+  void shutdown();
+
+  // Add a record - records must be in time order
+  void write(const TruthSample_t &sample);
+
+private:
+  std::string path_;
+  FILE *file_;
+};
+
+// Linear interpolation between `a` and `b` at `time_ns`
+TruthSample_t interpolate(const TruthSample_t &a, const TruthSample_t &b,
+                          int64_t time_ns);
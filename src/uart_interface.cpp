@@ -0,0 +1,143 @@
+#include "uart_interface.h"
+#include "termios2.h"
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/types.h>
+#include <termios.h>
+#include <unistd.h>
+
+// map a baud rate in bits/sec onto its termios `Bxxx` constant, or B0 if
+// there isn't one (in which case it has to go through termios2)
+static speed_t baudToSpeed(int baud_rate) {
+  switch (baud_rate) {
+  case 1200:
+    return B1200;
+  case 2400:
+    return B2400;
+  case 4800:
+    return B4800;
+  case 9600:
+    return B9600;
+  case 19200:
+    return B19200;
+  case 38400:
+    return B38400;
+  case 57600:
+    return B57600;
+  case 115200:
+    return B115200;
+  case 230400:
+    return B230400;
+  case 460800:
+    return B460800;
+  case 500000:
+    return B500000;
+  case 576000:
+    return B576000;
+  case 921600:
+    return B921600;
+  case 1000000:
+    return B1000000;
+  case 1500000:
+    return B1500000;
+  case 2000000:
+    return B2000000;
+  case 3000000:
+    return B3000000;
+  case 4000000:
+    return B4000000;
+  default:
+    return B0;
+  }
+}
+
+UartInterface::UartInterface(const std::string &port, int baud_rate)
+    : UartInterface::UartInterface(port, baud_rate,
+                                   O_RDWR | O_NOCTTY | O_SYNC){};
+
+UartInterface::UartInterface(const std::string &port, int baud_rate,
+                             int flags)
+    : port_(port), baud_rate_(baud_rate), flags_(flags){};
+
+void UartInterface::init() {
+  // always non-blocking, regardless of `flags_` - waits happen in poll()
+  int fd = open(port_.c_str(), flags_ | O_NONBLOCK);
+
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open port " + port_);
+  }
+  read_fd_ = write_fd_ = fd;
+
+  configurePort(baud_rate_);
+  flush();
+}
+
+void UartInterface::flush() {
+  if (tcflush(read_fd_, TCIFLUSH) != 0) {
+    throw std::runtime_error("Failed to clear input buffer");
+  }
+}
+
+void UartInterface::configurePort(int baud_rate) {
+  // I'll be honest that I hacked these settings together here.
+  // I consider myself fairly familar with messaging standards (like UART), so I
+  // understand the fundamentals of control bits, stop bits, baud rate, etc. But
+  // I just haven't had much experience interfacing with uarts from unix c. If I
+  // had more time I'd spend it coming up to speed on how unix general terminal
+  // interfaces are described, and how termios settings work.
+
+  struct termios tty;
+
+  // read in state of fd into a `termios` struct
+  if (tcgetattr(read_fd_, &tty) != 0) {
+    throw std::runtime_error("Failed to get UART attributes");
+  }
+
+  // set input and output baud rate the same - these take a `Bxxx` constant,
+  // not the rate itself. Non-standard rates are set separately below.
+  speed_t speed = baudToSpeed(baud_rate);
+  if (baud_rate <= 0) {
+    throw std::runtime_error("Invalid baud rate " + std::to_string(baud_rate));
+  }
+  if (speed != B0) {
+    cfsetospeed(&tty, speed);
+    cfsetispeed(&tty, speed);
+  }
+
+  // set all the flags
+  tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;
+  tty.c_iflag &= ~IGNBRK;
+  tty.c_lflag = 0;
+  tty.c_oflag = 0;
+
+  // control characters
+  // the port is non-blocking and all waiting is done in poll(). VMIN has to
+  // stay at 1 though - with VMIN=0 an empty read returns 0 instead of EAGAIN,
+  // which is indistinguishable from the other end hanging up
+  tty.c_cc[VMIN] = 1;
+  tty.c_cc[VTIME] = 0;
+
+  // input modes
+  // no software flow control, and no translating/stripping bytes on the way
+  // in - ICRNL in particular would turn every DELIM (0x0D) into a 0x0A
+  tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+  tty.c_iflag &= ~(BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL);
+
+  // control modes
+  tty.c_cflag |= (CLOCAL | CREAD);
+  tty.c_cflag &= ~(PARENB | PARODD);
+  tty.c_cflag &= ~CSTOPB;
+  tty.c_cflag &= ~CRTSCTS;
+
+  if (tcsetattr(read_fd_, TCSANOW, &tty) != 0) {
+    throw std::runtime_error("Failed to set UART attributes");
+  }
+
+  if (speed == B0 && !setCustomBaudRate(read_fd_, baud_rate)) {
+    throw std::runtime_error("Failed to set baud rate " +
+                             std::to_string(baud_rate));
+  }
+}
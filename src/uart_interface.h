@@ -0,0 +1,30 @@
+#pragma once
+#include "fd_interface.h"
+#include <string>
+
+// handles instantiating and sending data to hardware-level interface
+// in this case it's a UART - but there might be another one for SPI, etc.
+//
+// the port is always opened O_NONBLOCK; any waiting is done in poll(), which
+// is what lets every call be bounded by a deadline
+class UartInterface final : public FdInterface {
+public:
+  // Dumb initializers - separate from `init()`
+  // so we can chose when to call `init()` if needed
+  UartInterface(const std::string &port, int baud_rate);
+  UartInterface(const std::string &port, int baud_rate, int flags);
+
+  // Attempt to initialize the port
+  void init() override;
+
+  // Flush the input
+  void flush() override;
+
+private:
+  std::string port_;
+  int baud_rate_;
+  int flags_;
+
+  // Configure the port
+  void configurePort(int baud_rate);
+};
@@ -0,0 +1,52 @@
+#include "virtual_interface.h"
+#include <chrono>
+
+VirtualInterface::~VirtualInterface() { shutdown(); }
+
+void VirtualInterface::init() {
+  link_.init();
+  link_.setWakeups(false);
+}
+
+void VirtualInterface::shutdown() {
+  link_.shutdown();
+  link_.setWakeups(true);
+}
+
+bool VirtualInterface::stepUntilReadable(Deadline deadline) {
+  // always at least one step, so a deadline of now still moves time along
+  // (and e.g. `serviceInput()` gets the next sample)
+  while (true) {
+    sim_.step();
+    if (link_.availableBytes() > 0) {
+      return true;
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+  }
+}
+
+bool VirtualInterface::waitReadable(Deadline deadline) {
+  return link_.availableBytes() > 0 || stepUntilReadable(deadline);
+}
+
+ReceiveResult VirtualInterface::readInto(std::span<uint8_t> buffer,
+                                         Deadline deadline) {
+  if (buffer.empty()) {
+    return ReceiveResult{.bytes = 0, .status = IOStatus::Ok};
+  }
+  if (link_.availableBytes() == 0 && !stepUntilReadable(deadline)) {
+    // the deadline has gone, and waiting on the link would only wait longer
+    return ReceiveResult{.bytes = 0, .status = IOStatus::Timeout};
+  }
+
+  // whatever the sim sent is already there, so this never waits
+  return link_.receiveInto(buffer, std::chrono::steady_clock::now());
+}
+
+SendResult VirtualInterface::writeFrom(const struct iovec *iov, int iovcnt,
+                                       Deadline deadline) {
+  // commands just queue up on the link, the sim reads them on its next step
+  return link_.sendvSome(iov, iovcnt, deadline);
+}
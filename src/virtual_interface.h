@@ -0,0 +1,65 @@
+#pragma once
+#include "io_interface.h"
+#include "loopback_interface.h"
+#include "sim.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// drives a `SensorSim` in virtual time, lock-step with whoever reads from it
+//
+// wraps the host's end of a `LoopbackLink`, with the sim on the other end.
+// Whenever a read finds nothing waiting, rather than waiting on the sim's
+// timer it calls `sim.step()` - so the sim's clock moves on exactly as fast
+// as the reader drains the data, with no sleeps or wakeups anywhere, and a
+// driver on top can be pushed through tens of millions of samples in
+// seconds. Input is stamped with the sim's time rather than the host's, so
+// the sample clock model sees the device's timing exactly.
+//
+// the sim is only ever stepped from inside a read, so whichever thread reads
+// (the driver's streaming reader, or its caller) is the one running the sim -
+// don't also `run()` it. A read that times out has stepped the sim
+// repeatedly until the (wall clock) deadline, like a device that stayed
+// quiet.
+class VirtualInterface final : public IOInterface {
+public:
+  VirtualInterface(LoopbackInterface &link, SensorSim &sim)
+      : link_(link), sim_(sim){};
+
+  // Destructor. Runs shutdown().
+  ~VirtualInterface();
+
+  // Attempt to initialize the wrapped link - the sim is initialized
+  // separately, the same as ever. Nothing ever waits on the link, so the sim
+  // is told not to bother waking it up.
+  void init() override;
+  void shutdown() override;
+
+  int availableBytes() override { return link_.availableBytes(); };
+
+  using IOInterface::waitReadable;
+  bool waitReadable(Deadline deadline) override;
+
+  void flush() override { link_.flush(); };
+
+  // nothing to poll - input only turns up when it's read, since reading is
+  // what moves the sim along
+  int fd() const override { return -1; };
+
+  // the sim's time
+  uint64_t receiveClockNs() const override { return sim_.simTimeNs(); };
+
+protected:
+  ReceiveResult readInto(std::span<uint8_t> buffer,
+                         Deadline deadline) override;
+  SendResult writeFrom(const struct iovec *iov, int iovcnt,
+                       Deadline deadline) override;
+
+private:
+  // Step the sim until it has written something back, true if it did before
+  // `deadline`
+  bool stepUntilReadable(Deadline deadline);
+
+  LoopbackInterface &link_;
+  SensorSim &sim_;
+};
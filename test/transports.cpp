@@ -0,0 +1,188 @@
+// Runs the whole stack - a `SensorSim` and a `SensorDriver` in this process -
+// over each of the in-process transports: a `LoopbackLink`, a socketpair and
+// a pair of pipes. Over each one it:
+//
+// - makes `round_trips` round trips, alternating `getMode()` with a register
+//   write and read back, checking every answer
+// - reads the product id back in one batch
+// - streams auto-mode data for a while, checking the samples come in order
+//   with nothing lost, resynced past or left unanswered
+// - streams onto the sample queue and stops with samples still on it,
+//   checking they all come back out, in order, once streaming has stopped
+//
+// and prints a line per transport. Exits non-zero on the first mismatch.
+//
+// usage: test_transports [round_trips] [stream_seconds]
+
+#include "driver.h"
+#include "fd_interface.h"
+#include "gyro_xyz.h"
+#include "loopback_interface.h"
+#include "register_map.h"
+#include "sim.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// throws with `what` unless `ok`
+static void expect(bool ok, const std::string &what) {
+  if (!ok) {
+    throw std::runtime_error(what);
+  }
+}
+
+static void checkRoundTrips(SensorDriver &driver, size_t round_trips) {
+  for (size_t i = 0; i < round_trips; i++) {
+    if (i % 2 == 0) {
+      expect(driver.getMode() == MODE_ARG_MANUAL, "getMode mismatch");
+      continue;
+    }
+    uint8_t value = i & 0xFF;
+    expect(driver.writeRegister(FILTER_CTRL_REG, value),
+           "register write didn't stick");
+    expect(driver.sendRegisterRead(FILTER_CTRL_REG) == value,
+           "register read back mismatch");
+  }
+
+  std::vector<uint8_t> addrs;
+  for (size_t offset = 0; offset < 8; offset++) {
+    addrs.push_back(PROD_ID_REG + offset);
+  }
+  std::vector<uint8_t> values(addrs.size());
+  driver.readRegisters(addrs, values);
+  expect(std::string(values.begin(), values.end()) == "G370PDF1",
+         "batched product id mismatch");
+}
+
+// returns the number of samples streamed
+static size_t checkStreaming(SensorDriver &driver, double seconds) {
+  size_t n_samples = 0;
+  size_t mismatches = 0;
+  uint64_t expected = 0;
+  driver.startStreaming([&](const TimedSample_t &sample) {
+    if (n_samples > 0 &&
+        (sample.lost != 0 || sample.sequence != expected)) {
+      mismatches++;
+    }
+    expected = sample.sequence + 1;
+    n_samples++;
+  });
+
+  driver.setMode(MODE_ARG_AUTO);
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  expect(driver.setMode(MODE_ARG_MANUAL) == MODE_ARG_MANUAL,
+         "setMode mismatch");
+  driver.stopStreaming();
+
+  expect(n_samples > 0, "no samples streamed");
+  expect(mismatches == 0, "samples lost or out of order");
+  return n_samples;
+}
+
+// returns the number of samples left queued at `stopStreaming()`
+static size_t checkQueuedAfterStop(SensorDriver &driver, double seconds) {
+  driver.startStreaming();
+  driver.setMode(MODE_ARG_AUTO);
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  expect(driver.setMode(MODE_ARG_MANUAL) == MODE_ARG_MANUAL,
+         "setMode mismatch");
+  driver.stopStreaming();
+
+  size_t n_samples = 0;
+  uint64_t expected = 0;
+  TimedSample_t sample;
+  while (driver.popSample(sample)) {
+    expect(n_samples == 0 || sample.sequence == expected,
+           "queued samples out of order");
+    expected = sample.sequence + 1;
+    n_samples++;
+  }
+  expect(n_samples > 0, "queued samples lost at stopStreaming");
+  return n_samples;
+}
+
+// Runs the checks with a sim on `sim_io` and a driver on `driver_io`
+static void testTransport(const char *name, IOInterface &driver_io,
+                          IOInterface &sim_io, size_t round_trips,
+                          double stream_seconds) {
+  SensorSim sim(sim_io);
+  sim.setOutputRate(MAX_OUTPUT_RATE_HZ);
+  sim.init();
+  std::thread sim_thread([&] { sim.run(); });
+
+  SensorDriver driver(driver_io);
+  driver.init();
+
+  size_t n_samples = 0;
+  size_t n_queued = 0;
+  std::string failure;
+  try {
+    checkRoundTrips(driver, round_trips);
+    n_samples = checkStreaming(driver, stream_seconds);
+    n_queued = checkQueuedAfterStop(driver, stream_seconds / 10);
+
+    auto metrics = driver.metrics();
+    expect(metrics.timeouts == 0, "commands timed out");
+    expect(metrics.unclaimed_responses == 0, "responses went unclaimed");
+    expect(metrics.decoder.resyncs == 0 &&
+               metrics.decoder.discarded_bytes == 0,
+           "decoder had to resync");
+  } catch (const std::exception &e) {
+    failure = e.what();
+  }
+
+  driver.shutdown();
+  sim.stop();
+  sim_thread.join();
+  sim.shutdown();
+
+  if (!failure.empty()) {
+    throw std::runtime_error(std::string(name) + ": " + failure);
+  }
+  std::cout << name << ": ok - " << round_trips << " round trips, "
+            << n_samples << " samples, " << n_queued
+            << " left queued at stop" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  size_t round_trips = argc > 1 ? std::atol(argv[1]) : 20000;
+  double stream_seconds = argc > 2 ? std::atof(argv[2]) : 0.5;
+
+  try {
+    {
+      LoopbackLink link;
+      testTransport("loopback", link.first(), link.second(), round_trips,
+                    stream_seconds);
+    }
+    {
+      int a, b;
+      openSocketPair(a, b);
+      FdInterface driver_io(a, a);
+      FdInterface sim_io(b, b);
+      testTransport("socketpair", driver_io, sim_io, round_trips,
+                    stream_seconds);
+    }
+    {
+      // one pipe each way
+      int to_sim[2], to_driver[2];
+      if (pipe2(to_sim, O_NONBLOCK | O_CLOEXEC) != 0 ||
+          pipe2(to_driver, O_NONBLOCK | O_CLOEXEC) != 0) {
+        throw std::runtime_error("Failed to open pipes");
+      }
+      FdInterface driver_io(to_driver[0], to_sim[1]);
+      FdInterface sim_io(to_sim[0], to_driver[1]);
+      testTransport("pipe", driver_io, sim_io, round_trips, stream_seconds);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "FAILED " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
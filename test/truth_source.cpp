@@ -0,0 +1,57 @@
+// Plays a CSV through `CsvTruth` with a line in it longer than the whole read
+// buffer - made so that whatever's left of it once the buffer fills up reads
+// as a record - and checks the line is skipped as a whole, rather than its
+// tail being taken for a record.
+//
+// usage: test_truth_source [dir]
+
+#include "truth_source.h"
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+// throws with `what` unless `ok`
+static void expect(bool ok, const std::string &what) {
+  if (!ok) {
+    throw std::runtime_error(what);
+  }
+}
+
+static bool near(float a, float b) { return std::fabs(a - b) < 1e-4; }
+
+int main(int argc, char *argv[]) {
+  std::string dir = argc > 1 ? argv[1] : "/tmp";
+  std::string path = dir + "/test_truth_" + std::to_string(getpid()) + ".csv";
+
+  try {
+    FILE *file = std::fopen(path.c_str(), "w");
+    expect(file != nullptr, "couldn't write " + path);
+    std::fputs("time_s,x_rate,y_rate,z_rate\n0,1,1,1\n", file);
+    // the first buffer's worth gets dropped, leaving a record-shaped tail
+    std::string junk(TRUTH_CSV_BUFFER_SIZE, 'x');
+    std::fputs(junk.c_str(), file);
+    std::fputs("0.001,100,100,100\n0.002,3,3,3\n", file);
+    std::fclose(file);
+
+    CsvTruth truth(path);
+    truth.init();
+    auto halfway = truth.at(1000000);
+    auto last = truth.at(2000000);
+    truth.shutdown();
+
+    expect(near(halfway.x_rate, 2) && near(halfway.z_rate, 2),
+           "over-long line read as a record");
+    expect(near(last.x_rate, 3), "record after an over-long line lost");
+  } catch (const std::exception &e) {
+    unlink(path.c_str());
+    std::cerr << "FAILED " << e.what() << std::endl;
+    return 1;
+  }
+  unlink(path.c_str());
+
+  std::cout << "csv: ok - over-long line skipped" << std::endl;
+  return 0;
+}